@@ -1,6 +1,7 @@
 
 #include "common.h"
 #include "settingskeys.h"
+#include "global.h"
 
 #include "initiation/negotiation/sdptypes.h"
 
@@ -317,3 +318,44 @@ uint32_t findMID(const MediaInfo &media)
 
   return 0;
 }
+
+
+unsigned int simulcastLayers()
+{
+  int layers = settingValue(SettingsKey::videoSimulcastLayers);
+
+  if (layers < 1)
+  {
+    return 1;
+  }
+  else if (layers > MAX_SIMULCAST_LAYERS)
+  {
+    return MAX_SIMULCAST_LAYERS;
+  }
+
+  return layers;
+}
+
+
+QSize simulcastLayerSize(QSize full, unsigned int layer)
+{
+  int width = full.width() >> layer;
+  int height = full.height() >> layer;
+
+  // video dimensions must be even
+  return QSize(width - width%2, height - height%2);
+}
+
+
+bool acceptsResolutionChanges(const MediaInfo &media)
+{
+  for (auto& attribute : media.valueAttributes)
+  {
+    if (attribute.type == A_IMAGEATTR && attribute.value.contains("recv"))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
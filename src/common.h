@@ -4,6 +4,7 @@
 #include "qhostaddress.h"
 
 #include <QString>
+#include <QSize>
 
 #include <stdint.h>
 
@@ -54,3 +55,13 @@ quint16 getLocalPort(std::shared_ptr<ICEInfo> info);
 
 uint32_t findSSRC(const MediaInfo &media);
 uint32_t findMID(const MediaInfo &media);
+
+// the number of video resolutions encoded at the same time, 1 without simulcast
+unsigned int simulcastLayers();
+
+// the resolution of a simulcast layer, each layer halves the one before it
+QSize simulcastLayerSize(QSize full, unsigned int layer);
+
+// Whether the peer can receive video which changes its resolution between
+// the simulcast layers, see RFC 6236
+bool acceptsResolutionChanges(const MediaInfo &media);
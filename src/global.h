@@ -25,7 +25,6 @@ const unsigned int INVITE_TIMEOUT = 60000;
 #ifdef __linux__
 // linux uses such large audio frames, that the buffers can't keep up with
 // smaller packet sizes
-// TODO: Make filter buffer sizes relative to this number so the latency stays constant
 const uint16_t AUDIO_FRAMES_PER_SECOND = 50;
 #else
 const uint16_t AUDIO_FRAMES_PER_SECOND = 100;
@@ -34,6 +33,18 @@ const uint16_t AUDIO_FRAMES_PER_SECOND = 100;
 const uint16_t MIN_ICE_PORT   = 23000;
 const uint16_t MAX_ICE_PORT   = 24000;
 
+// Intra frames are asked from the peer with an RTCP APP packet carrying the
+// SSRC of the stream, like the FCI of a picture loss indication.
+const char KEYFRAME_REQUEST_NAME[] = "KVZU";
+const uint8_t KEYFRAME_REQUEST_SUBTYPE = 1;
+
+// full, half and quarter resolution
+const int MAX_SIMULCAST_LAYERS = 3;
+
+// The encoder references only every other frame, so the frames between them
+// can be left out for peers that cannot receive the full frame rate.
+const uint8_t TEMPORAL_LAYERS = 2;
+
 // this macro checks the condition and quits in debug mode and exits the current function in
 #define CHECKERROR(condition, errorString, errorReturnValue) \
   Q_ASSERT(condition); \
@@ -5,6 +5,7 @@
 #include "initiation/negotiation/sdpmeshconference.h"
 
 #include "common.h"
+#include "settingskeys.h"
 #include "logger.h"
 
 #include <QVariant>
@@ -180,6 +181,7 @@ bool SDPNegotiation::sdpToContent(QVariant& content)
     {
       setSSRC(i, ourSDP->media[i]);
       setMID(i, ourSDP->media[i]);
+      setImageAttributes(ourSDP->media[i]);
     }
   }
   else
@@ -469,6 +471,7 @@ std::shared_ptr<SDPMessageInfo> SDPNegotiation::findCommonSDP(const SDPMessageIn
   {
     setSSRC(i, newInfo->media[i]);
     setMID(i, newInfo->media[i]);
+    setImageAttributes(newInfo->media[i]);
   }
 
   return newInfo;
@@ -605,6 +608,47 @@ void SDPNegotiation::setMID(unsigned int mediaIndex, MediaInfo& media)
 }
 
 
+void SDPNegotiation::setImageAttributes(MediaInfo& media)
+{
+  if (media.type != "video" || media.rtpNums.empty())
+  {
+    return;
+  }
+
+  for (unsigned int j = 0; j < media.valueAttributes.size(); ++j)
+  {
+    if (media.valueAttributes.at(j).type == A_IMAGEATTR)
+    {
+      return;
+    }
+  }
+
+  // the simulcast layers we may switch between when sending
+  QString sendSizes = "";
+  QSize full(settingValue(SettingsKey::videoResolutionWidth),
+             settingValue(SettingsKey::videoResolutionHeight));
+
+  unsigned int layers = simulcastLayers();
+  for (unsigned int layer = 0; layer < layers && layers > 1; ++layer)
+  {
+    QSize size = simulcastLayerSize(full, layer);
+    sendSizes += " [x=" + QString::number(size.width()) +
+        ",y=" + QString::number(size.height()) + "]";
+  }
+
+  QString value = QString::number(media.rtpNums.first());
+  if (!sendSizes.isEmpty())
+  {
+    value += " send" + sendSizes;
+  }
+
+  // the decoder follows the resolution of the stream
+  value += " recv *";
+
+  media.valueAttributes.push_back({A_IMAGEATTR, value});
+}
+
+
 uint32_t SDPNegotiation::generateSSRC()
 {
   std::mt19937 rng{std::random_device{}()};
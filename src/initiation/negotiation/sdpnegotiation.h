@@ -90,6 +90,10 @@ private:
   void setSSRC(unsigned int mediaIndex, MediaInfo& media);
   void setMID(unsigned int mediaIndex, MediaInfo& media);
 
+  // tells the peer which video resolutions we may send and that we can
+  // receive changing resolutions
+  void setImageAttributes(MediaInfo& media);
+
   uint32_t generateSSRC();
 
   uint32_t sessionID_;
@@ -41,7 +41,8 @@ enum SDPAttributeType{A_NO_ATTRIBUTE,
                       A_LABEL,       // RFC 4574
                       A_ZRTP_HASH,   // RFC 6189
                       A_SSRC,        // RFC 5576
-                      A_SSRC_GROUP   // RFC 5576
+                      A_SSRC_GROUP,  // RFC 5576
+                      A_IMAGEATTR    // RFC 6236
                      };
 
 struct SDPAttribute
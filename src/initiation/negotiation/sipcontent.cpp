@@ -708,6 +708,13 @@ bool parseMediaAtributes(QStringListIterator &lineIterator, char &type, QStringL
         rValue = parseZRTPHash(words, value, zrtp);
         break;
       }
+      case A_IMAGEATTR: // RFC 6236, the value is kept whole
+      {
+        QStringList valueWords = words.mid(1);
+        valueWords.push_front(value);
+        parseValueAttribute(attribute, valueWords.join(" "), parsedValues);
+        break;
+      }
       default:
       {
         Logger::getLogger()->printWarning("SIPContent", "Unrecognized media attribute, ignoring",
@@ -1067,7 +1074,8 @@ SDPAttributeType stringToAttributeType(QString attribute)
     {"label",      A_LABEL},
     {"zrtp-hash",  A_ZRTP_HASH},
     {"ssrc",       A_SSRC},
-    {"ssrc-group", A_SSRC_GROUP}
+    {"ssrc-group", A_SSRC_GROUP},
+    {"imageattr",  A_IMAGEATTR}
   };
 
   if (xmap.find(attribute) == xmap.end())
@@ -1109,7 +1117,8 @@ QString attributeTypeToString(SDPAttributeType type)
     {A_LABEL,      "label"},
     {A_ZRTP_HASH,  "zrtp-hash"},
     {A_SSRC,       "ssrc"},
-    {A_SSRC_GROUP, "ssrc-group"}
+    {A_SSRC_GROUP, "ssrc-group"},
+    {A_IMAGEATTR,  "imageattr"}
   };
 
   if (xmap.find(type) == xmap.end())
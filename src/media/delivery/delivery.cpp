@@ -309,6 +309,10 @@ bool Delivery::addMediaStream(uint32_t sessionID, DeliverySession &session,
   // This makes the uvgRTP keep the firewall open even if the other side is not sending media
   int flags = RCE_HOLEPUNCH_KEEPALIVE;
 
+  // The reports drive the bitrate adaptation and intra frames are requested
+  // with RTCP. ICE has already opened the RTCP component next to RTP.
+  flags |= RCE_RTCP;
+
   if (fmt == RTP_FORMAT_H264 ||
       fmt == RTP_FORMAT_H265 ||
       fmt == RTP_FORMAT_H266)
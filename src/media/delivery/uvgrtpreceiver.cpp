@@ -4,6 +4,7 @@
 #include "src/media/resourceallocator.h"
 
 #include "common.h"
+#include "global.h"
 #include "logger.h"
 
 #include <QDateTime>
@@ -15,6 +16,15 @@
 #define RTP_HEADER_SIZE 2
 #define FU_HEADER_SIZE  1
 
+// How often an intra frame is asked for until one arrives. The request may
+// be lost, but the sender also needs time to produce the frame.
+const std::chrono::milliseconds KEYFRAME_REQUEST_INTERVAL = std::chrono::milliseconds(2000);
+
+// HEVC NAL unit types that a decoder can start from
+const uint8_t FIRST_IRAP_NUT = 16;
+const uint8_t LAST_IRAP_NUT = 23;
+const uint8_t VPS_NUT = 32;
+
 static void __receiveHook(void *arg, uvg_rtp::frame::rtp_frame *frame)
 {
   if (arg && frame)
@@ -28,7 +38,9 @@ UvgRTPReceiver::UvgRTPReceiver(uint32_t sessionID, QString id, StatisticsInterfa
                                DataType type, QString media, QFuture<uvg_rtp::media_stream *> stream,
                                uint32_t localSSRC, uint32_t remoteSSRC):
   Filter(id, "RTP Receiver " + media, stats, hwResources, DT_NONE, type),
-  discardUntilIntra_(false),
+  discardUntilIntra_(type == DT_HEVCVIDEO),
+  keyframeMutex_(),
+  lastKeyframeRequest_(),
   lastSeq_(0),
   sessionID_(sessionID),
   watcher_(),
@@ -109,6 +121,21 @@ void UvgRTPReceiver::receiveHook(uvg_rtp::frame::rtp_frame *frame)
 
   lastSeq_ = frame->header.seq;
 
+  // The peer sends an intra frame when asked, so a joining participant does
+  // not have to wait for the next intra period.
+  if (discardUntilIntra_)
+  {
+    if (!startsSequence(frame->payload, frame->payload_len))
+    {
+      requestKeyframe();
+      (void)uvg_rtp::frame::dealloc_frame(frame);
+      return;
+    }
+
+    Logger::getLogger()->printNormal(this, "Received the first intra frame");
+    discardUntilIntra_ = false;
+  }
+
   std::unique_ptr<Data> received_picture = initializeData(output_, DS_REMOTE);
 
   if (!received_picture)
@@ -127,7 +154,7 @@ void UvgRTPReceiver::receiveHook(uvg_rtp::frame::rtp_frame *frame)
     Logger::getLogger()->printWarning(this, "uvgRTP did not add the start code. Please use newer version"
                                             " of uvgRTP and make sure RCE_H26X_PREPEND_SC flag is used");
     received_picture->data_size = (uint32_t)frame->payload_len + 4;
-    received_picture->data = std::unique_ptr<uchar[]>(new uchar[received_picture->data_size]);
+    received_picture->data = std::shared_ptr<uchar[]>(new uchar[received_picture->data_size]);
 
     memcpy(received_picture->data.get() + 4, frame->payload, received_picture->data_size - 4);
 
@@ -141,13 +168,69 @@ void UvgRTPReceiver::receiveHook(uvg_rtp::frame::rtp_frame *frame)
     // We use the memory provided by uvgRTP so we don't have to copy the data.
     // The RCE_H26X_PREPEND_SC flag set in delivery adds NAL start codes to frames so we don't have to
     received_picture->data_size = (uint32_t)frame->payload_len;
-    received_picture->data = std::unique_ptr<uchar[]>(frame->payload);
+    received_picture->data = std::shared_ptr<uchar[]>(frame->payload);
     frame->payload = nullptr;    // avoid memory deletion
   }
 
   (void)uvg_rtp::frame::dealloc_frame(frame);
   sendOutput(std::move(received_picture));
 }
+void UvgRTPReceiver::requestKeyframe()
+{
+  if (!mstream_ || output_ != DT_HEVCVIDEO)
+  {
+    return;
+  }
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+  keyframeMutex_.lock();
+  if (now - lastKeyframeRequest_ < KEYFRAME_REQUEST_INTERVAL)
+  {
+    keyframeMutex_.unlock();
+    return;
+  }
+  lastKeyframeRequest_ = now;
+  keyframeMutex_.unlock();
+
+  // the SSRC of the stream that needs the intra frame in network byte order
+  uint8_t payload[4] = {(uint8_t)(remoteSSRC_ >> 24), (uint8_t)(remoteSSRC_ >> 16),
+                        (uint8_t)(remoteSSRC_ >> 8),  (uint8_t)remoteSSRC_};
+
+  if (mstream_->get_rtcp()->send_app_packet(KEYFRAME_REQUEST_NAME, KEYFRAME_REQUEST_SUBTYPE,
+                                            sizeof(payload), payload) != RTP_OK)
+  {
+    Logger::getLogger()->printWarning(this, "Failed to send intra frame request");
+    return;
+  }
+
+  Logger::getLogger()->printNormal(this, "Requested an intra frame from peer");
+}
+
+
+bool UvgRTPReceiver::startsSequence(const uint8_t* payload, size_t size) const
+{
+  // the start code is not there if uvgRTP did not add it
+  size_t offset = 0;
+  if (size >= 4 && payload[0] == 0 && payload[1] == 0 && payload[2] == 0 && payload[3] == 1)
+  {
+    offset = 4;
+  }
+  else if (size >= 3 && payload[0] == 0 && payload[1] == 0 && payload[2] == 1)
+  {
+    offset = 3;
+  }
+
+  if (size <= offset)
+  {
+    return false;
+  }
+
+  uint8_t nalType = (payload[offset] >> 1) & 0x3f;
+  return nalType == VPS_NUT || (nalType >= FIRST_IRAP_NUT && nalType <= LAST_IRAP_NUT);
+}
+
+
 void UvgRTPReceiver::processRTCPSenderReport(std::unique_ptr<uvgrtp::frame::rtcp_sender_report> sr)
 {
   uint32_t ourSSRC = mstream_->get_ssrc();
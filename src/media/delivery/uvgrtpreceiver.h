@@ -2,8 +2,11 @@
 
 #include <uvgrtp/lib.hh>
 #include <QFutureWatcher>
+#include <QMutex>
 #include "media/processing/filter.h"
 
+#include <chrono>
+
 class UvgRTPReceiver : public Filter
 {
   Q_OBJECT
@@ -16,6 +19,10 @@ public:
 
   void receiveHook(uvg_rtp::frame::rtp_frame *frame);
 
+  // Asks the peer for an intra frame, for example when the decoder has lost
+  // its references. Requests are sent at most once per interval.
+  void requestKeyframe();
+
   void uninit();
 
 protected:
@@ -28,8 +35,15 @@ private:
 
   void processRTCPSenderReport(std::unique_ptr<uvgrtp::frame::rtcp_sender_report> sr);
 
+  // whether the decoder can start from the frame
+  bool startsSequence(const uint8_t* payload, size_t size) const;
+
+  // frames before the first intra frame cannot be decoded
   bool discardUntilIntra_;
 
+  QMutex keyframeMutex_;
+  std::chrono::steady_clock::time_point lastKeyframeRequest_;
+
   uint16_t lastSeq_;
   uint32_t sessionID_;
 
@@ -4,13 +4,31 @@
 #include "src/media/resourceallocator.h"
 
 #include "common.h"
+#include "global.h"
 #include "settingskeys.h"
 #include "logger.h"
 
+#include <QRandomGenerator>
 #include <QSettings>
 
+#include <algorithm>
+#include <cstring>
 #include <functional>
 
+// the RTP clock rate of video formats
+const uint32_t VIDEO_CLOCK_RATE = 90000;
+
+// seconds from the NTP epoch in 1900 to the Unix epoch
+const uint64_t NTP_UNIX_OFFSET = 2208988800;
+
+// how often the simulcast layer for the peer is reconsidered
+const std::chrono::milliseconds LAYER_CHECK_INTERVAL = std::chrono::milliseconds(1000);
+
+// HEVC NAL unit types that a decoder can start from
+const uint8_t FIRST_IRAP_NUT = 16;
+const uint8_t LAST_IRAP_NUT = 23;
+const uint8_t VPS_NUT = 32;
+
 UvgRTPSender::UvgRTPSender(uint32_t sessionID, QString id, StatisticsInterface *stats,
                            std::shared_ptr<ResourceAllocator> hwResources,
                            DataType type, QString media,
@@ -23,7 +41,12 @@ UvgRTPSender::UvgRTPSender(uint32_t sessionID, QString id, StatisticsInterface *
   framerateNumerator_(0),
   framerateDenominator_(0),
   localSSRC_(localSSRC),
-  remoteSSRC_(remoteSSRC)
+  remoteSSRC_(remoteSSRC),
+  timestampBase_(QRandomGenerator::global()->generate()),
+  layerSelection_(false),
+  currentLayer_(0),
+  targetLayer_(0),
+  lastLayerCheck_()
 {
   UvgRTPSender::updateSettings();
 
@@ -50,6 +73,9 @@ UvgRTPSender::UvgRTPSender(uint32_t sessionID, QString id, StatisticsInterface *
               {
                 mstream_->configure_ctx(RCC_REMOTE_SSRC, remoteSSRC_);
               }
+
+              mstream_->get_rtcp()->install_app_hook(std::bind(&UvgRTPSender::processRTCPAppPacket,
+                                                               this, std::placeholders::_1));
             }
           });
 
@@ -70,13 +96,32 @@ void UvgRTPSender::updateSettings()
   {
     uint32_t vps   = settingValue(SettingsKey::videoVPS);
     uint16_t intra = (uint16_t)settingValue(SettingsKey::videoIntra);
-    maxBufferSize_ = vps * intra;
-    Logger::getLogger()->printDebug(DEBUG_NORMAL, this,  "Updated buffersize",
-                                    {"Size"}, {QString::number(maxBufferSize_)});
 
     framerateNumerator_ = settingValue(SettingsKey::videoFramerateNumerator);
     framerateDenominator_ = settingValue(SettingsKey::videoFramerateDenominator);
 
+    // buffer at most one period of parameter sets
+    uint32_t bufferDelay = 0;
+    if (framerateNumerator_ > 0)
+    {
+      bufferDelay = vps*intra*1000*framerateDenominator_/framerateNumerator_;
+    }
+
+    // the layers are chosen before queuing so the queue only has frames
+    // that are sent
+    setBackpressurePolicy(std::make_shared<LayeredHEVCPolicy>(bufferDelay,
+                                                              [this](const Data& frame)
+    {
+      return sendsLayer(frame) && sendsTemporalLayer(frame);
+    },
+    [this]()
+    {
+      // the peer can't decode anything until the next intra frame
+      getHWManager()->requestKeyframe(currentLayer_);
+    }));
+    Logger::getLogger()->printDebug(DEBUG_NORMAL, this,  "Updated buffer delay",
+                                    {"Delay"}, {QString::number(bufferDelay) + " ms"});
+
     if (mstream_)
     {
       mstream_->configure_ctx(RCC_FPS_NUMERATOR, framerateNumerator_);
@@ -86,6 +131,12 @@ void UvgRTPSender::updateSettings()
 }
 
 
+void UvgRTPSender::setLayerSelection(bool enabled)
+{
+  layerSelection_ = enabled;
+}
+
+
 void UvgRTPSender::process()
 {
   if (!mstream_)
@@ -97,7 +148,16 @@ void UvgRTPSender::process()
   // TODO: For HEVC, make sure that the first frame we send is intra
   while (input)
   {
-    ret = mstream_->push_frame(std::move(input->data), input->data_size, rtpFlags_);
+    // The payload may be shared with the other senders, so we give uvgRTP only a
+    // pointer to it. uvgRTP has sent the frame by the time push_frame returns.
+    if (input->vInfo)
+    {
+      ret = pushVideoFrame(*input);
+    }
+    else
+    {
+      ret = mstream_->push_frame(input->data.get(), input->data_size, rtpFlags_);
+    }
 
     if (ret != RTP_OK)
     {
@@ -112,6 +172,147 @@ void UvgRTPSender::process()
 }
 
 
+rtp_error_t UvgRTPSender::pushVideoFrame(const Data& frame)
+{
+  // Every video frame gets its timestamp from the same base. The NTP time of
+  // the frame is given as well, so that the sender reports map the
+  // timestamps to the same clock.
+  uint32_t timestamp = timestampBase_ +
+      (uint32_t)(frame.presentationTime*(VIDEO_CLOCK_RATE/1000));
+
+  uint64_t ntpTimestamp = ((frame.presentationTime/1000 + NTP_UNIX_OFFSET) << 32) |
+      (((uint64_t)(frame.presentationTime%1000) << 32)/1000);
+
+  uint8_t* data = frame.data.get();
+  size_t size = frame.data_size;
+  int flags = rtpFlags_;
+
+  // uvgRTP sets the marker bit at the end of every push and has no way to
+  // leave it out, so pushing the NAL units of a frame one by one would mark
+  // each of them. Only a frame of one NAL unit can skip the search for start
+  // codes, others are pushed whole and uvgRTP searches them again.
+  if (frame.vInfo->nalUnits && frame.vInfo->nalUnits->size() == 1)
+  {
+    const NalUnit& nal = frame.vInfo->nalUnits->front();
+    data += nal.offset;
+    size = nal.size;
+    flags |= RTP_NO_H26X_SCL;
+  }
+
+  return mstream_->push_frame(data, size, timestamp, ntpTimestamp, flags);
+}
+
+
+bool UvgRTPSender::sendsLayer(const Data& frame)
+{
+  unsigned int layers = getHWManager()->getSimulcastLayers();
+
+  if (!layerSelection_ || layers <= 1)
+  {
+    return frame.vInfo->spatialLayer == 0;
+  }
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (now - lastLayerCheck_ >= LAYER_CHECK_INTERVAL)
+  {
+    lastLayerCheck_ = now;
+    uint8_t target = targetLayer(layers);
+
+    // Asked once per new target, otherwise the switch waits for the next
+    // intra period. Only the encoder of that layer is affected.
+    if (target != targetLayer_ && target != currentLayer_)
+    {
+      getHWManager()->requestKeyframe(target);
+    }
+    targetLayer_ = target;
+  }
+
+  if (frame.vInfo->spatialLayer == currentLayer_)
+  {
+    return true;
+  }
+
+  // the resolution changes, so the peer needs new parameter sets and an
+  // intra frame to continue decoding
+  if (frame.vInfo->spatialLayer == targetLayer_ && startsSequence(frame))
+  {
+    Logger::getLogger()->printNormal(this, "Switching simulcast layer",
+                                     {"Previous", "New"},
+                                     {QString::number(currentLayer_.load()),
+                                      QString::number(targetLayer_)});
+    currentLayer_ = targetLayer_;
+    return true;
+  }
+
+  return false;
+}
+
+
+uint8_t UvgRTPSender::targetLayer(unsigned int layers)
+{
+  int bitrate = getHWManager()->getStreamBitrate(sessionID_, DT_HEVCVIDEO);
+  if (bitrate <= 0)
+  {
+    return 0;
+  }
+
+  for (unsigned int layer = 0; layer < layers; ++layer)
+  {
+    if (bitrate >= getHWManager()->getLayerBitrate(layer))
+    {
+      return layer;
+    }
+  }
+
+  return layers - 1;
+}
+
+
+bool UvgRTPSender::sendsTemporalLayer(const Data& frame)
+{
+  uint8_t layer = frame.vInfo->temporalLayer;
+
+  // the stream may also mark its sub-layers in the NAL unit header
+  const uint8_t* header = nalHeader(frame);
+  if (header != nullptr && (header[1] & 0x07) > 1)
+  {
+    layer = std::max(layer, (uint8_t)((header[1] & 0x07) - 1));
+  }
+
+  return layer < getHWManager()->getTemporalLayers(sessionID_);
+}
+
+
+bool UvgRTPSender::startsSequence(const Data& frame) const
+{
+  const uint8_t* header = nalHeader(frame);
+  if (header == nullptr)
+  {
+    return false;
+  }
+
+  uint8_t nalType = (header[0] >> 1) & 0x3f;
+  return nalType == VPS_NUT || (nalType >= FIRST_IRAP_NUT && nalType <= LAST_IRAP_NUT);
+}
+
+
+const uint8_t* UvgRTPSender::nalHeader(const Data& frame) const
+{
+  uint32_t offset = 4; // start code
+  if (frame.vInfo->nalUnits && !frame.vInfo->nalUnits->empty())
+  {
+    offset = frame.vInfo->nalUnits->front().offset;
+  }
+
+  if (frame.data_size < offset + 2)
+  {
+    return nullptr;
+  }
+
+  return frame.data.get() + offset;
+}
+
+
 void UvgRTPSender::processRTCPReceiverReport(std::unique_ptr<uvgrtp::frame::rtcp_receiver_report> rr)
 {
   uint32_t ourSSRC = mstream_->get_ssrc();
@@ -140,3 +341,28 @@ void UvgRTPSender::processRTCPReceiverReport(std::unique_ptr<uvgrtp::frame::rtcp
     }
   }
 }
+
+
+void UvgRTPSender::processRTCPAppPacket(std::unique_ptr<uvgrtp::frame::rtcp_app_packet> app)
+{
+  if (!app || memcmp(app->name, KEYFRAME_REQUEST_NAME, 4) != 0 ||
+      app->header.count != KEYFRAME_REQUEST_SUBTYPE ||
+      app->payload == nullptr || app->payload_len < 4)
+  {
+    return;
+  }
+
+  uint32_t ssrc = ((uint32_t)app->payload[0] << 24) | ((uint32_t)app->payload[1] << 16) |
+                  ((uint32_t)app->payload[2] << 8)  |  (uint32_t)app->payload[3];
+
+  if (ssrc != mstream_->get_ssrc())
+  {
+    return;
+  }
+
+  // the other layers and the other peers are not affected
+  uint8_t layer = currentLayer_;
+  Logger::getLogger()->printNormal(this, "Peer requested an intra frame",
+                                   "Layer", QString::number(layer));
+  getHWManager()->requestKeyframe(layer);
+}
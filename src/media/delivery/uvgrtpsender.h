@@ -7,6 +7,9 @@
 #include <QSemaphore>
 #include <QFutureWatcher>
 
+#include <atomic>
+#include <chrono>
+
 class StatisticsInterface;
 
 class UvgRTPSender : public Filter
@@ -21,6 +24,10 @@ public:
 
   void updateSettings();
 
+  // Lets the sender switch between simulcast layers based on the bitrate
+  // estimated for this peer. Otherwise only the full resolution is sent.
+  void setLayerSelection(bool enabled);
+
 protected:
   void process();
 
@@ -29,8 +36,30 @@ signals:
 
 private:
 
+  // sends one access unit with a timestamp from the base of this sender
+  rtp_error_t pushVideoFrame(const Data& frame);
+
+  // Whether the frame is from the simulcast layer sent to this peer. Called
+  // by the backpressure policy in the thread of the encoders.
+  bool sendsLayer(const Data& frame);
+
+  // the largest layer the bitrate estimate of this peer allows
+  uint8_t targetLayer(unsigned int layers);
+
+  // whether the peer currently receives the temporal layer of the frame
+  bool sendsTemporalLayer(const Data& frame);
+
+  // whether the decoder can start from this frame
+  bool startsSequence(const Data& frame) const;
+
+  // the two byte header of the first NAL unit, nullptr if the frame is too short
+  const uint8_t* nalHeader(const Data& frame) const;
+
   void processRTCPReceiverReport(std::unique_ptr<uvgrtp::frame::rtcp_receiver_report> rr);
 
+  // intra frame requests from the peer
+  void processRTCPAppPacket(std::unique_ptr<uvgrtp::frame::rtcp_app_packet> app);
+
   uvg_rtp::media_stream * mstream_;
   QFutureWatcher<uvg_rtp::media_stream *> watcher_;
   uint32_t sessionID_;
@@ -42,4 +71,14 @@ private:
 
   uint32_t localSSRC_;
   uint32_t remoteSSRC_;
+
+  // random like the one uvgRTP would use, added to all video timestamps
+  uint32_t timestampBase_;
+
+  std::atomic<bool> layerSelection_;
+
+  // also read when the peer asks for an intra frame
+  std::atomic<uint8_t> currentLayer_;
+  uint8_t targetLayer_;
+  std::chrono::steady_clock::time_point lastLayerCheck_;
 };
@@ -3,6 +3,8 @@
 #include "media/processing/filtergraph.h"
 #include "media/processing/filter.h"
 #include "media/delivery/delivery.h"
+#include "media/delivery/uvgrtpsender.h"
+#include "media/delivery/uvgrtpreceiver.h"
 #include "initiation/negotiation/sdptypes.h"
 #include "statisticsinterface.h"
 #include "videoviewfactory.h"
@@ -284,6 +286,13 @@ void MediaManager::createOutgoingMedia(uint32_t sessionID,
     }
     else if(remoteMedia.type == "video")
     {
+      // smaller simulcast layers are only sent to peers that accept them
+      std::shared_ptr<UvgRTPSender> videoSender = std::dynamic_pointer_cast<UvgRTPSender>(senderFilter);
+      if (videoSender)
+      {
+        videoSender->setLayerSelection(acceptsResolutionChanges(remoteMedia));
+      }
+
       fg_->sendVideoto(sessionID, senderFilter, id);
     }
     else
@@ -357,7 +366,23 @@ void MediaManager::createIncomingMedia(uint32_t sessionID,
       Q_ASSERT(videoView);
       if (videoView != nullptr)
       {
-        fg_->receiveVideoFrom(sessionID, receiverFilter, videoView, id);
+        // the decoder asks the peer for intra frames through the receiver
+        std::function<void()> keyframeRequest = nullptr;
+        std::weak_ptr<UvgRTPReceiver> receiver =
+            std::dynamic_pointer_cast<UvgRTPReceiver>(receiverFilter);
+
+        if (!receiver.expired())
+        {
+          keyframeRequest = [receiver]()
+          {
+            if (std::shared_ptr<UvgRTPReceiver> current = receiver.lock())
+            {
+              current->requestKeyframe();
+            }
+          };
+        }
+
+        fg_->receiveVideoFrom(sessionID, receiverFilter, videoView, id, keyframeRequest);
       }
       else
       {
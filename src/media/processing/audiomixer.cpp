@@ -70,14 +70,14 @@ std::unique_ptr<Data> AudioMixer::mixAudio(std::unique_ptr<Data> input,
 }
 
 
-std::unique_ptr<uchar[]> AudioMixer::doMixing(uint32_t frameSize)
+std::shared_ptr<uchar[]> AudioMixer::doMixing(uint32_t frameSize)
 {
   // don't do mixing if we have only one stream.
   if (mixingBuffer_.size() == 1)
   {
     if (!mixingBuffer_.begin()->second.empty())
     {
-    std::unique_ptr<uchar[]> oneSample =
+    std::shared_ptr<uchar[]> oneSample =
         std::move(mixingBuffer_.begin()->second.front()->data);
     mixingBuffer_.begin()->second.pop_front();
     mixingBuffer_.clear();
@@ -90,8 +90,8 @@ std::unique_ptr<uchar[]> AudioMixer::doMixing(uint32_t frameSize)
     }
   }
 
-  std::unique_ptr<uchar[]> result =
-      std::unique_ptr<uint8_t[]>(new uint8_t[frameSize]);
+  std::shared_ptr<uchar[]> result =
+      std::shared_ptr<uint8_t[]>(new uint8_t[frameSize]);
   int16_t * output_ptr = (int16_t*)result.get();
 
   for (unsigned int i = 0; i < frameSize/2; ++i)
@@ -39,7 +39,7 @@ public:
 
 private:
 
-  std::unique_ptr<uchar[]> doMixing(uint32_t frameSize);
+  std::shared_ptr<uchar[]> doMixing(uint32_t frameSize);
 
   int32_t inputs_;
 
@@ -15,9 +15,9 @@ AudioOutputFilter::AudioOutputFilter(QString id, StatisticsInterface* stats,
   // linux uses very large audio frames at mic for some reason. That is why there
   // will be many audio samples arriving simultaneously at this filter and we
   // need a relatively large buffer
-  maxBufferSize_ = AUDIO_FRAMES_PER_SECOND/5;
+  setBackpressurePolicy(std::make_shared<DropOldestPolicy>(200));
 #else
-  maxBufferSize_ = AUDIO_FRAMES_PER_SECOND/2;
+  setBackpressurePolicy(std::make_shared<DropOldestPolicy>(500));
 #endif
   output_.init(format);
 
@@ -0,0 +1,397 @@
+#include "backpressurepolicy.h"
+
+#include "inputqueue.h"
+#include "filter.h"
+
+#include "global.h"
+
+#include <thread>
+
+// used when the frame rate of video is not known
+const uint32_t DEFAULT_FRAME_DURATION_MS = 33;
+
+// HEVC NAL unit types of random access points
+const uint8_t FIRST_IRAP_TYPE = 16;
+const uint8_t LAST_IRAP_TYPE = 23;
+
+// how often a blocked producer checks whether there is room
+const std::chrono::milliseconds BLOCK_CHECK_INTERVAL = std::chrono::milliseconds(1);
+
+
+// the duration of media in one Data
+static uint32_t mediaDuration(const Data& data)
+{
+  uint32_t duration = DEFAULT_FRAME_DURATION_MS;
+
+  if (data.vInfo != nullptr &&
+      data.vInfo->framerateNumerator > 0 && data.vInfo->framerateDenominator > 0)
+  {
+    duration = 1000*data.vInfo->framerateDenominator/data.vInfo->framerateNumerator;
+  }
+  else if (data.aInfo != nullptr)
+  {
+    // audio is always handled in frames of this size
+    duration = 1000/AUDIO_FRAMES_PER_SECOND;
+  }
+
+  if (duration == 0)
+  {
+    duration = 1;
+  }
+
+  return duration;
+}
+
+
+// what HEVCGOPPolicy needs to know about an item of an HEVC stream
+struct HEVCItem
+{
+  // begins with parameter sets or with the first slice of an IRAP picture
+  bool randomAccess = false;
+
+  // has nothing but parameter sets, which belong to the item after it
+  bool parameterSetsOnly = false;
+
+  // has the first slice of a picture
+  bool beginsPicture = false;
+};
+
+
+// Looks at the NAL units of the item up to the first slice. Only the
+// parameter sets and other small units in front of it are searched.
+static HEVCItem classifyHEVC(const Data& data)
+{
+  HEVCItem item;
+  bool first = true;
+  bool onlyParameterSets = true;
+
+  auto visit = [&](const uint8_t* nal, uint32_t size)
+  {
+    if (size < 2)
+    {
+      return true;
+    }
+
+    uint8_t type = (nal[0] >> 1) & 0x3f;
+    bool parameterSet = type == VPS_NUT || type == SPS_NUT || type == PPS_NUT;
+    bool vcl = type < 32;
+
+    // first_slice_segment_in_pic_flag is the first bit after the header
+    bool firstSlice = vcl && size > 2 && (nal[2] & 0x80);
+
+    if (first)
+    {
+      item.randomAccess = parameterSet ||
+          (type >= FIRST_IRAP_TYPE && type <= LAST_IRAP_TYPE && firstSlice);
+      first = false;
+    }
+
+    if (!parameterSet)
+    {
+      onlyParameterSets = false;
+    }
+
+    if (vcl)
+    {
+      item.beginsPicture = firstSlice;
+      return false;
+    }
+    return true;
+  };
+
+  const uint8_t* buffer = data.data.get();
+  if (data.vInfo && data.vInfo->nalUnits)
+  {
+    for (const NalUnit& nal : *data.vInfo->nalUnits)
+    {
+      if (!visit(buffer + nal.offset, nal.size))
+      {
+        break;
+      }
+    }
+  }
+  else
+  {
+    // a four byte start code ends with the three byte one
+    for (uint32_t i = 0; i + 2 < data.data_size; ++i)
+    {
+      if (buffer[i] == 0 && buffer[i + 1] == 0 && buffer[i + 2] == 1)
+      {
+        if (!visit(buffer + i + 3, data.data_size - i - 3))
+        {
+          break;
+        }
+        i += 2;
+      }
+    }
+  }
+
+  item.parameterSetsOnly = !first && onlyParameterSets;
+  return item;
+}
+
+
+BackpressurePolicy::BackpressurePolicy(uint32_t maxDelayMs):
+  maxDelayMs_(maxDelayMs)
+{}
+
+
+BackpressurePolicy::~BackpressurePolicy()
+{}
+
+
+uint32_t BackpressurePolicy::itemLimit(const Data& input, uint32_t capacity) const
+{
+  if (maxDelayMs_ == 0)
+  {
+    return capacity;
+  }
+
+  uint32_t limit = maxDelayMs_/mediaDuration(input);
+
+  if (limit == 0)
+  {
+    limit = 1;
+  }
+  else if (limit > capacity)
+  {
+    limit = capacity;
+  }
+
+  return limit;
+}
+
+
+std::unique_ptr<Data> BackpressurePolicy::take(InputQueue& queue, uint32_t& discarded)
+{
+  Q_UNUSED(discarded);
+  return queue.pop();
+}
+
+
+uint32_t BackpressurePolicy::discardAll(InputQueue& queue)
+{
+  uint32_t discarded = 0;
+  while (queue.pop() != nullptr)
+  {
+    ++discarded;
+  }
+  return discarded;
+}
+
+
+DropOldestPolicy::DropOldestPolicy(uint32_t maxDelayMs):
+  BackpressurePolicy(maxDelayMs)
+{}
+
+
+uint32_t DropOldestPolicy::admit(InputQueue& queue, std::unique_ptr<Data>& input)
+{
+  uint32_t limit = itemLimit(*input, queue.capacity());
+  uint32_t discarded = 0;
+
+  // the consumer may empty the queue while we are doing this
+  while (queue.size() >= limit && queue.pop() != nullptr)
+  {
+    ++discarded;
+  }
+
+  return discarded;
+}
+
+
+DropNewestPolicy::DropNewestPolicy(uint32_t maxDelayMs):
+  BackpressurePolicy(maxDelayMs)
+{}
+
+
+uint32_t DropNewestPolicy::admit(InputQueue& queue, std::unique_ptr<Data>& input)
+{
+  if (queue.size() >= itemLimit(*input, queue.capacity()))
+  {
+    input.reset();
+    return 1;
+  }
+
+  return 0;
+}
+
+
+KeepLatestPolicy::KeepLatestPolicy():
+  BackpressurePolicy(0)
+{}
+
+
+uint32_t KeepLatestPolicy::admit(InputQueue& queue, std::unique_ptr<Data>& input)
+{
+  Q_UNUSED(input);
+  return discardAll(queue);
+}
+
+
+BlockProducerPolicy::BlockProducerPolicy(uint32_t maxDelayMs):
+  BackpressurePolicy(maxDelayMs)
+{}
+
+
+uint32_t BlockProducerPolicy::admit(InputQueue& queue, std::unique_ptr<Data>& input)
+{
+  uint32_t limit = itemLimit(*input, queue.capacity());
+
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(getMaxDelay());
+
+  while (queue.size() >= limit && std::chrono::steady_clock::now() < deadline)
+  {
+    std::this_thread::sleep_for(BLOCK_CHECK_INTERVAL);
+  }
+
+  uint32_t discarded = 0;
+  while (queue.size() >= limit && queue.pop() != nullptr)
+  {
+    ++discarded;
+  }
+
+  return discarded;
+}
+
+
+HEVCGOPPolicy::HEVCGOPPolicy(uint32_t maxDelayMs, std::function<void()> keyframeRequest):
+  BackpressurePolicy(maxDelayMs),
+  keyframeRequest_(keyframeRequest),
+  dropChain_(false),
+  queuedPictures_(0),
+  admitWaiting_(false),
+  admittedParameterSets_(false),
+  waitingForIRAP_(false),
+  previousParameterSets_(false)
+{}
+
+
+uint32_t HEVCGOPPolicy::admit(InputQueue& queue, std::unique_ptr<Data>& input)
+{
+  HEVCItem info = classifyHEVC(*input);
+
+  bool resumes = info.randomAccess && !admittedParameterSets_;
+  admittedParameterSets_ = info.parameterSetsOnly;
+
+  // the rest of a chain is useless once a part of it has been discarded
+  if (admitWaiting_ && !resumes)
+  {
+    input.reset();
+    return 1;
+  }
+  admitWaiting_ = false;
+
+  // without a delay limit, only the capacity limits the queue
+  uint32_t limit = queue.capacity();
+  if (getMaxDelay() > 0)
+  {
+    limit = itemLimit(*input, queue.capacity());
+  }
+
+  // Popping and pushing back frames here could reorder them with the pops
+  // of the filter, so the filter is only told to discard.
+  if ((info.beginsPicture && queuedPictures_ >= (int32_t)limit) ||
+      queue.size() + 1 >= queue.capacity())
+  {
+    dropChain_ = true;
+  }
+
+  if (queue.size() >= queue.capacity())
+  {
+    input.reset();
+    admitWaiting_ = true;
+    if (keyframeRequest_)
+    {
+      keyframeRequest_();
+    }
+    return 1;
+  }
+
+  if (info.beginsPicture)
+  {
+    ++queuedPictures_;
+  }
+
+  return 0;
+}
+
+
+std::unique_ptr<Data> HEVCGOPPolicy::take(InputQueue& queue, uint32_t& discarded)
+{
+  bool dropChain = dropChain_.exchange(false);
+  uint32_t dropped = 0;
+
+  while (std::unique_ptr<Data> item = queue.pop())
+  {
+    HEVCItem info = classifyHEVC(*item);
+
+    // the parameter sets in front of an IRAP picture start the chain
+    bool resumes = info.randomAccess && !previousParameterSets_;
+    previousParameterSets_ = info.parameterSetsOnly;
+
+    if (info.beginsPicture && queuedPictures_ > 0)
+    {
+      --queuedPictures_;
+    }
+
+    // the oldest chain is discarded up to the point the next one starts
+    if (dropChain && (dropped == 0 || !resumes))
+    {
+      ++dropped;
+      continue;
+    }
+    dropChain = false;
+
+    if (waitingForIRAP_)
+    {
+      if (!resumes)
+      {
+        ++dropped;
+        continue;
+      }
+      waitingForIRAP_ = false;
+    }
+
+    discarded += dropped;
+    return item;
+  }
+
+  // also corrects the count if the queue was emptied without the policy
+  queuedPictures_ = 0;
+
+  if (dropChain && !waitingForIRAP_)
+  {
+    // Nothing queued can be decoded without what was discarded. Waiting for
+    // the next intra period could take seconds.
+    waitingForIRAP_ = true;
+    if (keyframeRequest_)
+    {
+      keyframeRequest_();
+    }
+  }
+
+  discarded += dropped;
+  return nullptr;
+}
+
+
+LayeredHEVCPolicy::LayeredHEVCPolicy(uint32_t maxDelayMs,
+                                     std::function<bool(const Data&)> sends,
+                                     std::function<void()> keyframeRequest):
+  HEVCGOPPolicy(maxDelayMs, keyframeRequest),
+  sends_(sends)
+{}
+
+
+uint32_t LayeredHEVCPolicy::admit(InputQueue& queue, std::unique_ptr<Data>& input)
+{
+  if (input->vInfo && sends_ && !sends_(*input))
+  {
+    input.reset();
+    return 0;
+  }
+
+  return HEVCGOPPolicy::admit(queue, input);
+}
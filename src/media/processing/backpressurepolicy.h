@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+struct Data;
+class InputQueue;
+
+/* Backpressure policies decide what happens when input arrives faster than a
+ * filter can process it. The limit is given as milliseconds of media instead
+ * of number of items, so the latency stays the same regardless of frame rate
+ * or audio frame size. A limit of 0 means that only the capacity of the
+ * input buffer limits the input.
+ *
+ * The policy is called by the thread putting input to the filter before the
+ * input is added to the buffer. Only one thread calls the policy at a time.
+ * The filter also takes its input through the policy, so that policies which
+ * discard several related items can do it in the thread of the filter. */
+
+class BackpressurePolicy
+{
+public:
+  BackpressurePolicy(uint32_t maxDelayMs);
+  virtual ~BackpressurePolicy();
+
+  // Makes room for input by discarding items from queue. May also discard
+  // the input itself by resetting it. Returns the number of discarded items.
+  virtual uint32_t admit(InputQueue& queue, std::unique_ptr<Data>& input) = 0;
+
+  // Takes the oldest item for the filter, nullptr if there is none. Called
+  // only by the filter thread. Items discarded on the way are added to
+  // discarded.
+  virtual std::unique_ptr<Data> take(InputQueue& queue, uint32_t& discarded);
+
+  // how many items fit within the delay limit, based on duration of input
+  uint32_t itemLimit(const Data& input, uint32_t capacity) const;
+
+  uint32_t getMaxDelay() const
+  {
+    return maxDelayMs_;
+  }
+
+protected:
+
+  // pops and deletes all items from queue. Returns the number of items.
+  uint32_t discardAll(InputQueue& queue);
+
+private:
+
+  uint32_t maxDelayMs_;
+};
+
+
+// discards the oldest queued item. The default policy.
+class DropOldestPolicy : public BackpressurePolicy
+{
+public:
+  DropOldestPolicy(uint32_t maxDelayMs);
+  virtual uint32_t admit(InputQueue& queue, std::unique_ptr<Data>& input);
+};
+
+
+// discards the arriving input, keeping what is already queued
+class DropNewestPolicy : public BackpressurePolicy
+{
+public:
+  DropNewestPolicy(uint32_t maxDelayMs);
+  virtual uint32_t admit(InputQueue& queue, std::unique_ptr<Data>& input);
+};
+
+
+// only the newest input is kept, useful when outdated input has no value
+class KeepLatestPolicy : public BackpressurePolicy
+{
+public:
+  KeepLatestPolicy();
+  virtual uint32_t admit(InputQueue& queue, std::unique_ptr<Data>& input);
+};
+
+
+// Makes the producer wait until there is room. The wait is limited to the
+// delay limit so that a stuck filter cannot stop the whole graph, after which
+// the oldest item is discarded.
+class BlockProducerPolicy : public BackpressurePolicy
+{
+public:
+  BlockProducerPolicy(uint32_t maxDelayMs);
+  virtual uint32_t admit(InputQueue& queue, std::unique_ptr<Data>& input);
+};
+
+
+// Discards HEVC frames in whole dependency chains. The items may be whole
+// frames or single NAL units, so the delay limit is counted in pictures.
+// Without a delay limit, only the capacity of the queue limits input.
+// When the queue is over the limit, the filter discards the oldest chain up
+// to the next random access point, which is the first of the parameter sets
+// sent in front of an IRAP picture or the IRAP picture itself. If there is
+// no such point in queue, all input is discarded until the next one arrives
+// and an intra frame is requested, since the rest could not be decoded.
+class HEVCGOPPolicy : public BackpressurePolicy
+{
+public:
+  HEVCGOPPolicy(uint32_t maxDelayMs, std::function<void()> keyframeRequest = nullptr);
+  virtual uint32_t admit(InputQueue& queue, std::unique_ptr<Data>& input);
+  virtual std::unique_ptr<Data> take(InputQueue& queue, uint32_t& discarded);
+
+private:
+
+  std::function<void()> keyframeRequest_;
+
+  // set by the producer, the filter does the discarding
+  std::atomic<bool> dropChain_;
+  std::atomic<int32_t> queuedPictures_;
+
+  // used only by the producer
+  bool admitWaiting_;
+  bool admittedParameterSets_;
+
+  // used only by the filter thread
+  bool waitingForIRAP_;
+  bool previousParameterSets_;
+};
+
+
+// HEVCGOPPolicy for senders of layered video. The frames of the layers the
+// peer does not receive are left out before they are queued, so that they do
+// not use the delay limit and an IRAP frame of another layer does not end
+// the wait for an IRAP frame. Leaving a frame out is not counted as a discard.
+class LayeredHEVCPolicy : public HEVCGOPPolicy
+{
+public:
+  // sends tells whether a frame is sent. It is called for every video frame
+  // in the order they arrive.
+  LayeredHEVCPolicy(uint32_t maxDelayMs, std::function<bool(const Data&)> sends,
+                    std::function<void()> keyframeRequest = nullptr);
+  virtual uint32_t admit(InputQueue& queue, std::unique_ptr<Data>& input);
+
+private:
+
+  std::function<bool(const Data&)> sends_;
+};
@@ -354,12 +354,7 @@ void CameraFilter::handleFrame(const QVideoFrame &frame)
 
 void CameraFilter::process()
 {
-  if(frames_.empty())
-  {
-    Logger::getLogger()->printWarning(this, "No frame.");
-    return;
-  }
-
+  // the frames may have already been handled during previous wake up
   while(!frames_.empty())
   {
     QVideoFrame frame = frames_.front(); // TODO: Crash here if call is started before camera has initialized in debugger
@@ -390,14 +385,29 @@ void CameraFilter::process()
       totalSize += cloneFrame.mappedBytes(plane);
     }
 
-    newImage->data = std::unique_ptr<uchar[]>(new uchar[totalSize]);
+    newImage->data = getDataBuffer(output_, totalSize);
 
-    uint8_t* ptr = newImage->data.get();
+    // The planes are copied as they are mapped, with the camera strides. The
+    // strides are told to the following filters so the planes do not need to
+    // be repacked, which also allows cropping without copying.
+    bool knownLayout = (unsigned int)cloneFrame.planeCount() == videoPlaneCount(output_);
+    uint32_t offset = 0;
     for (int plane = 0; plane < cloneFrame.planeCount(); ++plane)
     {
-      uchar *bits = cloneFrame.bits(plane);
-      memcpy(ptr, bits, cloneFrame.mappedBytes(plane));
-      ptr += cloneFrame.mappedBytes(plane);
+      memcpy(newImage->data.get() + offset, cloneFrame.bits(plane), cloneFrame.mappedBytes(plane));
+
+      if (knownLayout)
+      {
+        newImage->vInfo->planeOffsets[plane] = offset;
+        newImage->vInfo->planeStrides[plane] = cloneFrame.bytesPerLine(plane);
+      }
+
+      offset += cloneFrame.mappedBytes(plane);
+    }
+
+    if (knownLayout)
+    {
+      newImage->vInfo->planeCount = cloneFrame.planeCount();
     }
 
     newImage->data_size = totalSize;
@@ -1,6 +1,10 @@
 #include "displayfilter.h"
 
+#include "yuvconversions.h"
+#include "rowbandpool.h"
+
 #include "ui/gui/videointerface.h"
+#include "media/resourceallocator.h"
 #include "statisticsinterface.h"
 
 #include "logger.h"
@@ -14,8 +18,11 @@ DisplayFilter::DisplayFilter(QString id, StatisticsInterface *stats,
                              QList<VideoInterface *> widgets, uint32_t sessionID):
   Filter(id, "Display", stats, hwResources, DT_RGB32VIDEO, DT_NONE, false),
   horizontalMirroring_(false),
+  widgetFormat_(DT_RGB32VIDEO),
+  convertYUV_(false),
   widgets_(widgets),
-  sessionID_(sessionID)
+  sessionID_(sessionID),
+  bandPool_(hwResources->getRowBandPool())
 {
 
   if (widgets.empty())
@@ -46,6 +53,7 @@ DisplayFilter::DisplayFilter(QString id, StatisticsInterface *stats,
     }
 
     widgets.at(0)->setStats(stats);
+    widgetFormat_ = input_;
   }
   else {
     Q_ASSERT(false);
@@ -61,6 +69,19 @@ DisplayFilter::~DisplayFilter()
 {}
 
 
+std::vector<FormatCost> DisplayFilter::inputFormats() const
+{
+  if (convertYUV_)
+  {
+    // our conversion is cheaper than a separate conversion filter since it
+    // only produces the pixels that are shown
+    return {{DT_YUV420VIDEO, 0}, {DT_RGB32VIDEO, 0}};
+  }
+
+  return Filter::inputFormats();
+}
+
+
 void DisplayFilter::process()
 {
   // TODO: The display should try to mimic the framerate if possible,
@@ -87,8 +108,12 @@ void DisplayFilter::process()
       break;
     }
 
-    if (input->type == input_)
+    if (input->type == input_ ||
+        (convertYUV_ && (input->type == DT_YUV420VIDEO || input->type == DT_RGB32VIDEO)))
     {
+      // the widgets expect packed frames
+      packVideo(input.get());
+
       for (int i = widgets_.size() - 1; i > -1; --i)
       {
         if (widgets_.at(i)->isVisible())
@@ -96,14 +121,18 @@ void DisplayFilter::process()
           /* This is a bit of a hack in that multiple widgets are only used for
          * the self view. The first index contains the self view (if this display filter
          * is used for selfviews and not peer views) and needs the horizontal mirroring
-         * whereas other don't want it. We also must copy the data for all but the
-         * last one since the life of the the data in widgets differs.
-         *
-         * TODO: This copying could probably be eliminated by using shared_ptr in widgets */
-
-          input = deliverFrame(widgets_.at(i), std::move(input),
-                               format, i != 0,
-                               horizontalMirroring_ && i == 0);
+         * whereas other don't want it. The widgets share the frame data so no
+         * copying is needed for multiple widgets. */
+
+          if (convertYUV_ && input->type == DT_YUV420VIDEO)
+          {
+            deliverYUVFrame(widgets_.at(i), input.get(), horizontalMirroring_ && i == 0);
+          }
+          else
+          {
+            input = deliverFrame(widgets_.at(i), std::move(input),
+                                 format, horizontalMirroring_ && i == 0);
+          }
         }
       }
 
@@ -121,23 +150,14 @@ void DisplayFilter::process()
 std::unique_ptr<Data> DisplayFilter::deliverFrame(VideoInterface* screen,
                                                   std::unique_ptr<Data> input,
                                                   QImage::Format format,
-                                                  bool useCopy, bool mirrorHorizontally)
+                                                  bool mirrorHorizontally)
 {
-  std::unique_ptr<uchar[]> tmpData = nullptr;
-
-  // replace input data with copy
-  if (useCopy)
-  {
-    // save input data temporarily
-    tmpData = std::move(input->data);
-
-    // create a copy to input data structure for normalize orientation
-    input->data = std::unique_ptr<uchar[]>(new uchar[input->data_size]);
-    memcpy(input->data.get(), tmpData.get(), input->data_size);
-  }
-
+  // The widget shares the frame with us, so we keep a reference to the
+  // original in case normalization creates a new frame for this widget
+  std::shared_ptr<uchar[]> original = input->data;
   bool verticalOrientation = input->vInfo->flippedVertically;
   bool horizontalOrientation = input->vInfo->flippedHorizontally;
+
   input = normalizeOrientation(std::move(input), mirrorHorizontally);
 
   QImage image(
@@ -146,14 +166,60 @@ std::unique_ptr<Data> DisplayFilter::deliverFrame(VideoInterface* screen,
         input->vInfo->height,
         format);
 
-  screen->inputImage(std::move(input->data), image, input->presentationTime);
+  screen->inputImage(input->data, image, input->presentationTime);
+
+  input->vInfo->flippedVertically = verticalOrientation;
+  input->vInfo->flippedHorizontally = horizontalOrientation;
+  input->data = std::move(original);
 
-  if (useCopy)
+  return input;
+}
+
+
+void DisplayFilter::deliverYUVFrame(VideoInterface* screen, Data* input,
+                                    bool mirrorHorizontally)
+{
+  uint16_t width = input->vInfo->width;
+  uint16_t height = input->vInfo->height;
+
+  // Converted at the size the view draws it, since the view would only scale
+  // the rest of the pixels away. Before the first frame has been drawn the
+  // size is not known, and the frame is never scaled up.
+  QSize drawSize = screen->drawSize();
+  if (!drawSize.isEmpty() && drawSize.width() < width && drawSize.height() < height)
   {
-    input->vInfo->flippedVertically = verticalOrientation;
-    input->vInfo->flippedHorizontally = horizontalOrientation;
-    input->data = std::move(tmpData);
+    width = drawSize.width();
+    height = drawSize.height();
   }
 
-  return input;
+  bool mirror = mirrorHorizontally || input->vInfo->flippedHorizontally;
+
+  std::shared_ptr<uchar[]> rgb = getDataBuffer(DT_RGB32VIDEO, width*height*4);
+
+  uint8_t* in = input->data.get();
+  uint8_t* out = rgb.get();
+  uint16_t inWidth = input->vInfo->width;
+  uint16_t inHeight = input->vInfo->height;
+  bool flip = input->vInfo->flippedVertically;
+
+  // the bands are output rows, each of which samples its own input row
+  if (getHWManager()->isAVX2Enabled())
+  {
+    bandPool_->run(width, height, [=](uint16_t firstRow, uint16_t lastRow)
+    {
+      yuv420_to_rgb_scaled_avx2_rows(in, out, inWidth, inHeight, width, height,
+                                     mirror, flip, firstRow, lastRow);
+    });
+  }
+  else
+  {
+    bandPool_->run(width, height, [=](uint16_t firstRow, uint16_t lastRow)
+    {
+      yuv420_to_rgb_scaled_c_rows(in, out, inWidth, inHeight, width, height,
+                                  mirror, flip, firstRow, lastRow);
+    });
+  }
+
+  QImage image(rgb.get(), width, height, QImage::Format_RGB32);
+  screen->inputImage(rgb, image, input->presentationTime);
 }
@@ -4,6 +4,7 @@
 #include <QImage>
 
 class VideoInterface;
+class RowBandPool;
 
 class DisplayFilter : public Filter
 {
@@ -13,29 +14,55 @@ public:
                 QList<VideoInterface*> widgets, uint32_t peer);
   ~DisplayFilter();
 
+  virtual bool isFusable() const
+  {
+    return true;
+  }
+
   void setHorizontalMirroring(bool status)
   {
     horizontalMirroring_ = status;
   }
 
+  // Lets the RGB32 widgets take YUV420 input, which is then converted,
+  // scaled and mirrored in one pass. Must be set before connecting.
+  void setYUVConversion(bool status)
+  {
+    convertYUV_ = status && widgetFormat_ == DT_RGB32VIDEO;
+  }
+
+  bool convertsYUV() const
+  {
+    return convertYUV_;
+  }
+
+  virtual std::vector<FormatCost> inputFormats() const;
+
 protected:
   void process();
 
 private:
 
   /* The purpose of this function is to deliver frames to widgets
-   * that draw the frames. The copy is needed since the final life
-   * of the frames can be different. Non-copy operations
-   * invalidate the data */
+   * that draw the frames. The widget shares the frame data with
+   * the returned input so the data must not be modified afterwards. */
   std::unique_ptr<Data> deliverFrame(VideoInterface* screen,
                                      std::unique_ptr<Data> input,
                                      QImage::Format format,
-                                     bool useCopy, bool mirrorHorizontally);
+                                     bool mirrorHorizontally);
+
+  // converts YUV420 frame for an RGB32 widget with the self view kernel
+  void deliverYUVFrame(VideoInterface* screen, Data* input, bool mirrorHorizontally);
 
   bool horizontalMirroring_;
 
+  DataType widgetFormat_;
+  bool convertYUV_;
+
   // Owned by Conference view
   QList<VideoInterface*> widgets_;
 
   uint32_t sessionID_;
+
+  std::shared_ptr<RowBandPool> bandPool_;
 };
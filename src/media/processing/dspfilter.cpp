@@ -60,6 +60,8 @@ void DSPFilter::process()
     // do dsp operation such as denoise, dereverb and agc
     if (doDSP_ && dsp_)
     {
+      // speex processes the frame in place
+      makeDataWritable(input.get());
       input->data = dsp_->processInputFrame(std::move(input->data), input->data_size);
     }
 
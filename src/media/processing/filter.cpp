@@ -1,16 +1,32 @@
 #include "filter.h"
 
+#include "filterscheduler.h"
+#include "framepool.h"
 #include "statisticsinterface.h"
 #include "yuvconversions.h"
 
+#include "media/resourceallocator.h"
+
 #include "logger.h"
 
 #include <QImage>
 #include <QDebug>
 
+#include <libyuv.h>
+
 #include <thread>
 
 
+// The input buffer cannot grow beyond this. Also used as the buffer size for
+// filters which have disabled the buffer limit.
+const uint32_t INPUT_BUFFER_CAPACITY = 256;
+
+// how much input is buffered unless the filter sets its own policy
+const uint32_t DEFAULT_MAX_INPUT_DELAY_MS = 200;
+
+// how often latency statistics are reported
+const int64_t LATENCY_REPORT_INTERVAL_US = 1000000;
+
 const std::map<DataType, QString> typeString = {
   {DT_NONE, "None"},
   {DT_YUV420VIDEO, "YUV 420"},
@@ -42,10 +58,130 @@ QString datatypeToString(const DataType type)
   return typeString.at(type);
 }
 
+unsigned int videoPlaneCount(DataType type)
+{
+  switch (type)
+  {
+  case DT_YUV420VIDEO:
+  case DT_YUV422VIDEO:
+    return 3;
+  case DT_NV12VIDEO:
+  case DT_NV21VIDEO:
+    return 2;
+  case DT_YUYVVIDEO:
+  case DT_UYVYVIDEO:
+  case DT_ARGBVIDEO:
+  case DT_BGRAVIDEO:
+  case DT_ABGRVIDEO:
+  case DT_RGB32VIDEO:
+  case DT_RGB24VIDEO:
+  case DT_BGRXVIDEO:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+
+void videoPlaneSize(DataType type, uint32_t width, uint32_t height, unsigned int plane,
+                    uint32_t& rowBytes, uint32_t& rows)
+{
+  rowBytes = width;
+  rows = height;
+
+  switch (type)
+  {
+  case DT_YUV420VIDEO:
+    if (plane > 0)
+    {
+      rowBytes = (width + 1)/2;
+      rows = (height + 1)/2;
+    }
+    break;
+  case DT_YUV422VIDEO:
+    if (plane > 0)
+    {
+      rowBytes = (width + 1)/2;
+    }
+    break;
+  case DT_NV12VIDEO:
+  case DT_NV21VIDEO:
+    if (plane > 0)
+    {
+      // interleaved chroma
+      rowBytes = 2*((width + 1)/2);
+      rows = (height + 1)/2;
+    }
+    break;
+  case DT_YUYVVIDEO:
+  case DT_UYVYVIDEO:
+    rowBytes = 2*width;
+    break;
+  case DT_RGB24VIDEO:
+  case DT_BGRXVIDEO:
+    rowBytes = 3*width;
+    break;
+  default:
+    rowBytes = 4*width;
+    break;
+  }
+}
+
+
+uint8_t* videoPlane(const Data* data, unsigned int plane, uint32_t& stride)
+{
+  Q_ASSERT(data->vInfo && plane < videoPlaneCount(data->type));
+
+  if (data->vInfo->planeCount > plane)
+  {
+    stride = data->vInfo->planeStrides[plane];
+    return data->data.get() + data->vInfo->planeOffsets[plane];
+  }
+
+  // the planes are packed after each other
+  uint32_t offset = 0;
+  uint32_t rows = 0;
+  for (unsigned int i = 0; i < plane; ++i)
+  {
+    videoPlaneSize(data->type, data->vInfo->width, data->vInfo->height, i, stride, rows);
+    offset += stride*rows;
+  }
+
+  videoPlaneSize(data->type, data->vInfo->width, data->vInfo->height, plane, stride, rows);
+  return data->data.get() + offset;
+}
+
+
+bool isPackedVideo(const Data* data)
+{
+  if (data->vInfo == nullptr || data->vInfo->planeCount == 0)
+  {
+    return true;
+  }
+
+  uint32_t offset = 0;
+  for (unsigned int plane = 0; plane < data->vInfo->planeCount; ++plane)
+  {
+    uint32_t rowBytes = 0;
+    uint32_t rows = 0;
+    videoPlaneSize(data->type, data->vInfo->width, data->vInfo->height, plane, rowBytes, rows);
+
+    if (data->vInfo->planeOffsets[plane] != offset ||
+        data->vInfo->planeStrides[plane] != rowBytes)
+    {
+      return false;
+    }
+
+    offset += rowBytes*rows;
+  }
+
+  return true;
+}
+
+
 Filter::Filter(QString id, QString name, StatisticsInterface *stats,
                std::shared_ptr<ResourceAllocator> hwResources,
                DataType input, DataType output, bool enforceFramerate):
-  maxBufferSize_(10),
   input_(input),
   output_(output),
   name_(name),
@@ -53,8 +189,24 @@ Filter::Filter(QString id, QString name, StatisticsInterface *stats,
   stats_(stats),
   waitMutex_(new QMutex),
   hasInput_(),
-  running_(true),
+  inputPending_(false),
+  sleeping_(false),
+  scheduler_(nullptr),
+  scheduleState_(SCHEDULE_IDLE),
+  schedulerThread_(),
+  running_(false),
+  inBuffer_(INPUT_BUFFER_CAPACITY),
+  inputPolicy_(std::make_shared<DropOldestPolicy>(DEFAULT_MAX_INPUT_DELAY_MS)),
+  upstreamFilters_(0),
+  producerMutex_(),
+  fused_(false),
+  fusionMutex_(),
+  bufferSource_(nullptr),
   inputTaken_(0),
+  queueLatency_(),
+  processingLatency_(),
+  inputTakenTime_(-1),
+  latencyReportTime_(0),
   inputDiscarded_(0),
   hwResources_(hwResources),
   filterID_(0),
@@ -112,9 +264,45 @@ bool Filter::isAudio(DataType type) const
 
 void Filter::addOutConnection(std::shared_ptr<Filter> out)
 {
+  // a filter with several inputs could otherwise be run by several threads
+  if (++out->upstreamFilters_ > 1 && out->isFused())
+  {
+    Logger::getLogger()->printNormal(this, "Unfusing filter because of a second input",
+                                     "Filter", out->getName());
+    out->setFusion(false);
+  }
+
+  connectionMutex_.lock();
   outConnections_.push_back(out);
+  connectionMutex_.unlock();
+}
+
+std::vector<std::shared_ptr<Filter>> Filter::getOutConnections()
+{
+  connectionMutex_.lock();
+  std::vector<std::shared_ptr<Filter>> connections = outConnections_;
+  connectionMutex_.unlock();
+  return connections;
 }
 
+
+bool Filter::selectInputFormat(DataType type)
+{
+  for (auto& format : inputFormats())
+  {
+    if (format.type == type)
+    {
+      input_ = type;
+      return true;
+    }
+  }
+
+  Logger::getLogger()->printProgramError(this, "Tried to select an unsupported input format",
+                                         "Format", datatypeToString(type));
+  return false;
+}
+
+
 void Filter::removeOutConnection(std::shared_ptr<Filter> out)
 {
   bool removed = false;
@@ -123,6 +311,7 @@ void Filter::removeOutConnection(std::shared_ptr<Filter> out)
   {
     if(outConnections_[i].get() == out.get())
     {
+      --out->upstreamFilters_;
       outConnections_.erase(outConnections_.begin() + i);
       removed = true;
       break;
@@ -137,13 +326,22 @@ void Filter::removeOutConnection(std::shared_ptr<Filter> out)
   }
 }
 
+
+void Filter::removeOutConnections()
+{
+  connectionMutex_.lock();
+  for (auto& out : outConnections_)
+  {
+    --out->upstreamFilters_;
+  }
+  outConnections_.clear();
+  connectionMutex_.unlock();
+}
+
 void Filter::emptyBuffer()
 {
-  bufferMutex_.lock();
-  //std::queue<std::unique_ptr<Data>> empty;
-  std::deque<std::unique_ptr<Data>> empty;
-  std::swap( inBuffer_, empty );
-  bufferMutex_.unlock();
+  while (inBuffer_.pop() != nullptr)
+  {}
 }
 
 void Filter::putInput(std::unique_ptr<Data> data)
@@ -161,62 +359,144 @@ void Filter::putInput(std::unique_ptr<Data> data)
   }
 #endif
 
+  // only one filter may push to the buffer at a time
+  bool multipleProducers = upstreamFilters_.load() > 1;
+  if (multipleProducers)
+  {
+    producerMutex_.lock();
+  }
+
   ++inputTaken_;
 
-  bufferMutex_.lock();
+  // may be replaced by another thread at any time
+  std::shared_ptr<BackpressurePolicy> policy = std::atomic_load(&inputPolicy_);
 
   if(inputTaken_%30 == 0)
   {
-    stats_->updateBufferStatus(filterID_, (uint16_t)inBuffer_.size(), maxBufferSize_);
+    stats_->updateBufferStatus(filterID_, (uint16_t)inBuffer_.size(),
+                               (uint16_t)policy->itemLimit(*data, inBuffer_.capacity()));
   }
 
-  inBuffer_.push_back(std::move(data));
+  uint32_t discarded = policy->admit(inBuffer_, data);
 
-  if(maxBufferSize_ != -1 && inBuffer_.size() >= (uint32_t)maxBufferSize_)
+  if (data)
   {
-    if(inBuffer_[0]->type == DT_HEVCVIDEO)
+    data->queuedTime = monotonicTime();
+
+    if (!inBuffer_.push(std::move(data)))
     {
-      // Search for intra frames and discard everything up to it
-      for(uint32_t i = 0; i < inBuffer_.size(); ++i)
+      Logger::getLogger()->printProgramError(this, "Input buffer full after backpressure policy");
+      ++discarded;
+    }
+  }
+
+  if (discarded > 0)
+  {
+    inputDropped(discarded);
+  }
+
+  if (multipleProducers)
+  {
+    producerMutex_.unlock();
+  }
+
+  if (fused_)
+  {
+    fusionMutex_.lock();
+    // check again in case we were unfused while waiting
+    if (fused_)
+    {
+      if (running_)
       {
-        const unsigned char *buff = inBuffer_.at(i)->data.get();
-        if(!isHEVCIntra(buff))
-        {
-          Logger::getLogger()->printWarning(this, "Discarding HEVC frames from buffer. Finding next intra",
-                                            "Frames discarded", QString::number(i));
-
-          for(int j = i; j != 0; --j)
-          {
-            inBuffer_.pop_front();
-          }
-          break;
-        }
+        schedulerThread_.store(std::this_thread::get_id());
+        process();
+        schedulerThread_.store(std::thread::id());
       }
+      fusionMutex_.unlock();
+      return;
     }
-    else
+    fusionMutex_.unlock();
+  }
+
+  wakeUp();
+}
+
+
+bool Filter::setFusion(bool fused)
+{
+  if (fused == fused_)
+  {
+    return true;
+  }
+
+  if (fused && (!isFusable() || upstreamFilters_.load() > 1 || running_))
+  {
+    Logger::getLogger()->printDebug(DEBUG_NORMAL, this, "Filter can only be fused before "
+                                                        "starting and with a single input");
+    return false;
+  }
+
+  // waits until the upstream filter is no longer running this filter
+  fusionMutex_.lock();
+  fused_ = fused;
+  fusionMutex_.unlock();
+
+  // the filter was started without a thread of its own
+  if (!fused && running_)
+  {
+    if (!scheduler_)
     {
-      if(inBuffer_[0]->type == DT_OPUSAUDIO)
+      // the thread registers itself to statistics
+      if (stats_ != nullptr && filterID_ != 0)
       {
-        Logger::getLogger()->printDebug(DEBUG_WARNING, this,  
-                                        "Should input Null pointer to opus decoder.");
+        stats_->removeFilter(filterID_);
+        filterID_ = 0;
       }
-      inBuffer_.pop_front(); // discard the oldest
+      QThread::start();
     }
 
-    ++inputDiscarded_;
+    // process anything that was left in buffer
+    wakeUp();
+  }
+
+  return true;
+}
+
+
+void Filter::setBackpressurePolicy(std::shared_ptr<BackpressurePolicy> policy)
+{
+  Q_ASSERT(policy);
+  std::atomic_store(&inputPolicy_, policy);
+}
+
+
+void Filter::setBufferSource(std::shared_ptr<BufferSource> source)
+{
+  std::atomic_store(&bufferSource_, source);
+}
+
+
+void Filter::inputDropped(uint32_t amount)
+{
+  if(input_ == DT_OPUSAUDIO)
+  {
+    Logger::getLogger()->printDebug(DEBUG_WARNING, this,
+                                    "Should input Null pointer to opus decoder.");
+  }
+
+  for (uint32_t i = 0; i < amount; ++i)
+  {
+    unsigned int discarded = ++inputDiscarded_;
     stats_->packetDropped(filterID_);
 
-    if (inputDiscarded_ == 1 || inputDiscarded_%10 == 0)
+    if (discarded == 1 || discarded%10 == 0)
     {
       Logger::getLogger()->printDebug(DEBUG_WARNING, this, "Buffer too full",
                                       {"Name", "Discarded/total input"},
-                                      {name_, QString::number(inputDiscarded_) + "/" +
+                                      {name_, QString::number(discarded) + "/" +
                                               QString::number(inputTaken_)});
     }
   }
-  wakeUp();
-
-  bufferMutex_.unlock();
 }
 
 
@@ -230,7 +510,7 @@ std::unique_ptr<Data> Filter::initializeData(DataType type, DataSource source) c
 
   if (isVideo(type))
   {
-    data->vInfo = std::unique_ptr<VideoInfo> (new VideoInfo);
+    data->vInfo.emplace();
     data->vInfo->width = 0; // not known at this point. Decoder tells the correct resolution
     data->vInfo->height = 0;
     data->vInfo->framerateNumerator = 0;
@@ -240,12 +520,10 @@ std::unique_ptr<Data> Filter::initializeData(DataType type, DataSource source) c
 
     data->vInfo->roiWidth = 0;
     data->vInfo->roiHeight = 0;
-
-    std::shared_ptr<uint8_t[]> roiArray = nullptr;
   }
   else if (isAudio(type))
   {
-    data->aInfo = std::unique_ptr<AudioInfo> (new AudioInfo);
+    data->aInfo.emplace();
     data->aInfo->sampleRate = 0;
   }
   else
@@ -270,12 +548,21 @@ std::unique_ptr<Data> Filter::normalizeOrientation(std::unique_ptr<Data> video,
   if (forceHorizontalFlip || video->vInfo->flippedHorizontally ||
       video->vInfo->flippedVertically)
   {
+    packVideo(video.get());
 
     uint32_t finalDataSize = video->vInfo->width*video->vInfo->height*4;
-    std::unique_ptr<uchar[]> flipped_data(new uchar[finalDataSize]);
+    std::shared_ptr<uchar[]> flipped_data = getDataBuffer(DT_RGB32VIDEO, finalDataSize);
 
-    flip_rgb(video->data.get(), flipped_data.get(), video->vInfo->width, video->vInfo->height,
-             forceHorizontalFlip || video->vInfo->flippedHorizontally, video->vInfo->flippedVertically);
+    if (hwResources_->isAVX2Enabled())
+    {
+      flip_rgb_avx2(video->data.get(), flipped_data.get(), video->vInfo->width, video->vInfo->height,
+                    forceHorizontalFlip || video->vInfo->flippedHorizontally, video->vInfo->flippedVertically);
+    }
+    else
+    {
+      flip_rgb(video->data.get(), flipped_data.get(), video->vInfo->width, video->vInfo->height,
+               forceHorizontalFlip || video->vInfo->flippedHorizontally, video->vInfo->flippedVertically);
+    }
 
 
     if (forceHorizontalFlip || video->vInfo->flippedHorizontally)
@@ -285,6 +572,7 @@ std::unique_ptr<Data> Filter::normalizeOrientation(std::unique_ptr<Data> video,
     video->vInfo->flippedVertically = false;
 
     video->data = std::move(flipped_data);
+    video->vInfo->planeCount = 0;
   }
 
   return video;
@@ -293,14 +581,24 @@ std::unique_ptr<Data> Filter::normalizeOrientation(std::unique_ptr<Data> video,
 
 std::unique_ptr<Data> Filter::getInput()
 {
-  bufferMutex_.lock();
-  std::unique_ptr<Data> r;
-  if(!inBuffer_.empty())
+  // the policy may discard queued input that has become useless
+  uint32_t discarded = 0;
+  std::unique_ptr<Data> r = std::atomic_load(&inputPolicy_)->take(inBuffer_, discarded);
+
+  if (discarded > 0)
   {
-    r = std::move(inBuffer_.front());
-    inBuffer_.pop_front();
+    inputDropped(discarded);
+  }
+
+  if (r)
+  {
+    inputTakenTime_ = monotonicTime();
+    if (r->queuedTime >= 0)
+    {
+      queueLatency_.record(inputTakenTime_ - r->queuedTime);
+    }
+    reportLatencies(inputTakenTime_);
   }
-  bufferMutex_.unlock();
 
   // optional enforcement of smooth frame rate, only done if there was input
   // TODO: Does not work at the moment
@@ -337,6 +635,41 @@ std::unique_ptr<Data> Filter::getInput()
 }
 
 
+int64_t Filter::monotonicTime() const
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void Filter::reportLatencies(int64_t now)
+{
+  if (now - latencyReportTime_ < LATENCY_REPORT_INTERVAL_US)
+  {
+    return;
+  }
+
+  latencyReportTime_ = now;
+
+  if (stats_ == nullptr || filterID_ == 0)
+  {
+    return;
+  }
+
+  if (queueLatency_.count() > 0)
+  {
+    stats_->updateQueueLatency(filterID_, queueLatency_.percentiles());
+    queueLatency_.reset();
+  }
+
+  if (processingLatency_.count() > 0)
+  {
+    stats_->updateProcessingLatency(filterID_, processingLatency_.percentiles());
+    processingLatency_.reset();
+  }
+}
+
+
 std::chrono::time_point<std::chrono::high_resolution_clock> Filter::getFrameTimepoint()
 {
   int flexibility1ms = 1000000;
@@ -362,6 +695,13 @@ void Filter::sendOutput(std::unique_ptr<Data> output)
 {
   Q_ASSERT(output);
 
+  // filters which produce output without input (e.g. sources) have no
+  // processing latency
+  if (inputTakenTime_ >= 0)
+  {
+    processingLatency_.record(monotonicTime() - inputTakenTime_);
+  }
+
   if(outDataCallbacks_.size() == 0 && outConnections_.size() == 0)
   {
     Logger::getLogger()->printDebug(DEBUG_WARNING, this, 
@@ -369,26 +709,22 @@ void Filter::sendOutput(std::unique_ptr<Data> output)
     return;
   }
 
-  // TODO: If data is HEVC, I think we can safely use shallowcopy
-
   connectionMutex_.lock();
-  // copy data to callbacks expect the last one is moved
-  // in either callbacks or outconnections(default).
+  // The payload is shared with all receivers, only the Data structure is
+  // copied for all expect the last one which gets the original.
   if(outDataCallbacks_.size() != 0)
   {
     // all expect the last
     for(unsigned int i = 0; i < outDataCallbacks_.size() - 1; ++i)
     {
-      Data* copy = deepDataCopy(output.get());
-      std::unique_ptr<Data> u_copy(copy);
+      std::unique_ptr<Data> u_copy(sharedDataCopy(output.get()));
       outDataCallbacks_[i](std::move(u_copy));
     }
 
     // copy last callback and move last connection
     if(outConnections_.size() != 0)
     {
-      Data* copy = deepDataCopy(output.get());
-      std::unique_ptr<Data> u_copy(copy);
+      std::unique_ptr<Data> u_copy(sharedDataCopy(output.get()));
       outDataCallbacks_.back()(std::move(u_copy));
     }
     else // move last callback
@@ -403,8 +739,7 @@ void Filter::sendOutput(std::unique_ptr<Data> output)
     // all expect the last
     for(unsigned int i = 0; i < outConnections_.size() - 1; ++i)
     {
-      Data* copy = deepDataCopy(output.get());
-      std::unique_ptr<Data> u_copy(copy);
+      std::unique_ptr<Data> u_copy(sharedDataCopy(output.get()));
       outConnections_[i]->putInput(std::move(u_copy));
     }
     // always move the last outconnection
@@ -413,10 +748,138 @@ void Filter::sendOutput(std::unique_ptr<Data> output)
   connectionMutex_.unlock();
 }
 
+void Filter::start()
+{
+  running_ = true;
+  scheduler_ = hwResources_->getFilterScheduler();
+
+  // a fused filter is run by the thread of its upstream filter
+  if (!scheduler_ && !fused_)
+  {
+    QThread::start();
+    return;
+  }
+
+  // there is no filter thread which would register us
+  if (stats_ != nullptr && filterID_ == 0)
+  {
+    filterID_ = stats_->addFilter(name_, id_, 0);
+  }
+
+  // process input that arrived before start. A fused filter gets processed
+  // with the next input instead.
+  if (inBuffer_.size() > 0 && !fused_)
+  {
+    scheduleProcessing();
+  }
+}
+
+
 void Filter::stop()
 {
   running_ = false;
-  hasInput_.wakeAll();
+
+  // wait for the upstream thread to finish processing this filter
+  if (fused_ && schedulerThread_.load() != std::this_thread::get_id())
+  {
+    fusionMutex_.lock();
+    fusionMutex_.unlock();
+  }
+
+  if (!scheduler_ && !fused_)
+  {
+    wakeUp();
+    return;
+  }
+
+  // Wait until no worker is processing this filter so the filter can be
+  // safely destroyed after stopping. If stop is called from process, there
+  // is nothing to wait for.
+  if (schedulerThread_.load() != std::this_thread::get_id())
+  {
+    while (scheduleState_.load() != SCHEDULE_IDLE)
+    {
+      std::this_thread::yield();
+    }
+  }
+
+  if (stats_ != nullptr && filterID_ != 0)
+  {
+    stats_->removeFilter(filterID_);
+    filterID_ = 0;
+  }
+}
+
+
+void Filter::scheduleProcessing()
+{
+  if (!running_)
+  {
+    return;
+  }
+
+  int state = scheduleState_.load();
+  while (true)
+  {
+    if (state == SCHEDULE_IDLE)
+    {
+      if (scheduleState_.compare_exchange_weak(state, SCHEDULE_QUEUED))
+      {
+        scheduler_->schedule(this, isPriority());
+        return;
+      }
+    }
+    else if (state == SCHEDULE_RUNNING)
+    {
+      if (scheduleState_.compare_exchange_weak(state, SCHEDULE_RERUN))
+      {
+        return;
+      }
+    }
+    else
+    {
+      // already waiting to be processed
+      return;
+    }
+  }
+}
+
+
+void Filter::runScheduled()
+{
+  scheduleState_.store(SCHEDULE_RUNNING);
+  schedulerThread_.store(std::this_thread::get_id());
+
+  if (running_)
+  {
+    process();
+  }
+
+  schedulerThread_.store(std::thread::id());
+
+  // the filter may be destroyed as soon as it is idle, so we must return
+  // right after setting the state
+  if (!running_)
+  {
+    scheduleState_.store(SCHEDULE_IDLE);
+    return;
+  }
+
+  int expected = SCHEDULE_RUNNING;
+  if (scheduleState_.compare_exchange_strong(expected, SCHEDULE_IDLE))
+  {
+    return;
+  }
+
+  // new input arrived while processing
+  scheduleState_.store(SCHEDULE_QUEUED);
+  scheduler_->schedule(this, isPriority());
+}
+
+
+bool Filter::isPriority() const
+{
+  return isAudio(input_) || isAudio(output_);
 }
 
 void Filter::run()
@@ -451,24 +914,10 @@ Data* Filter::shallowDataCopy(Data* original) const
 
     copy->data_size = 0; // no data in shallow copy
 
-    if (original->vInfo != nullptr)
-    {
-      copy->vInfo = std::unique_ptr<VideoInfo> (new VideoInfo);
-
-      copy->vInfo->width               = original->vInfo->width;
-      copy->vInfo->height              = original->vInfo->height;
-      copy->vInfo->framerateNumerator  = original->vInfo->framerateNumerator;
-      copy->vInfo->framerateDenominator  = original->vInfo->framerateDenominator;
-      copy->vInfo->flippedHorizontally = original->vInfo->flippedHorizontally;
-      copy->vInfo->flippedVertically   = original->vInfo->flippedVertically;
-    }
-
-    if (original->aInfo != nullptr)
-    {
-      copy->aInfo = std::unique_ptr<AudioInfo> (new AudioInfo);
-
-      copy->aInfo->sampleRate = original->aInfo->sampleRate;
-    }
+    // The whole info is copied, since the receivers of a shared frame need
+    // for example its layers and NAL units as much as the last one does.
+    copy->vInfo = original->vInfo;
+    copy->aInfo = original->aInfo;
 
     return copy;
   }
@@ -482,7 +931,7 @@ Data* Filter::deepDataCopy(Data* original) const
   if(original != nullptr)
   {
     Data* copy = shallowDataCopy(original);
-    copy->data = std::unique_ptr<uchar[]>(new uchar[original->data_size]);
+    copy->data = std::shared_ptr<uchar[]>(new uchar[original->data_size]);
     memcpy(copy->data.get(), original->data.get(), original->data_size);
     copy->data_size = original->data_size;
 
@@ -494,16 +943,121 @@ Data* Filter::deepDataCopy(Data* original) const
 }
 
 
+Data* Filter::sharedDataCopy(Data* original) const
+{
+  if(original != nullptr)
+  {
+    Data* copy = shallowDataCopy(original);
+    copy->data = original->data;
+    copy->data_size = original->data_size;
+
+    return copy;
+  }
+  Logger::getLogger()->printDebug(DEBUG_WARNING, this,
+                                  "Trying to copy nullptr Data pointer.");
+  return nullptr;
+}
+
+
+void Filter::makeDataWritable(Data* data) const
+{
+  // If we are the only owner, nobody else can start sharing the payload
+  if (data->data != nullptr && data->data.use_count() > 1)
+  {
+    std::shared_ptr<uchar[]> copy = getDataBuffer(data->type, data->data_size);
+    memcpy(copy.get(), data->data.get(), data->data_size);
+    data->data = std::move(copy);
+  }
+}
+
+
+void Filter::packVideo(Data* data) const
+{
+  if (isPackedVideo(data))
+  {
+    if (data->vInfo != nullptr)
+    {
+      data->vInfo->planeCount = 0;
+    }
+    return;
+  }
+
+  unsigned int planes = videoPlaneCount(data->type);
+  uint32_t finalDataSize = 0;
+  for (unsigned int plane = 0; plane < planes; ++plane)
+  {
+    uint32_t rowBytes = 0;
+    uint32_t rows = 0;
+    videoPlaneSize(data->type, data->vInfo->width, data->vInfo->height, plane, rowBytes, rows);
+    finalDataSize += rowBytes*rows;
+  }
+
+  std::shared_ptr<uchar[]> packed = getDataBuffer(data->type, finalDataSize);
+  uint8_t* destination = packed.get();
+
+  for (unsigned int plane = 0; plane < planes; ++plane)
+  {
+    uint32_t rowBytes = 0;
+    uint32_t rows = 0;
+    videoPlaneSize(data->type, data->vInfo->width, data->vInfo->height, plane, rowBytes, rows);
+
+    uint32_t stride = 0;
+    uint8_t* source = videoPlane(data, plane, stride);
+
+    libyuv::CopyPlane(source, stride, destination, rowBytes, rowBytes, rows);
+    destination += rowBytes*rows;
+  }
+
+  data->data = std::move(packed);
+  data->data_size = finalDataSize;
+  data->vInfo->planeCount = 0;
+}
+
+
+std::shared_ptr<uchar[]> Filter::getDataBuffer(DataType type, uint32_t size) const
+{
+  std::shared_ptr<BufferSource> source = std::atomic_load(&bufferSource_);
+  if (source)
+  {
+    std::shared_ptr<uchar[]> buffer = (*source)(type, size);
+    if (buffer)
+    {
+      return buffer;
+    }
+  }
+
+  return hwResources_->getFramePool()->allocate(type, size);
+}
+
+
+std::shared_ptr<int8_t[]> Filter::getRoiBuffer(uint32_t size) const
+{
+  // RoI maps are not media so they have their own group in the pool. The
+  // returned pointer shares the ownership of the pooled buffer.
+  std::shared_ptr<uchar[]> buffer = hwResources_->getFramePool()->allocate(DT_NONE, size);
+  return std::shared_ptr<int8_t[]>(buffer, reinterpret_cast<int8_t*>(buffer.get()));
+}
+
+
 QString Filter::printOutputs()
 {
   QString outs = "";
 
   for(auto& out : outConnections_)
   {
-    outs += "   \"" + name_ + "\" -> \"" + out->name_ + "\";" + "\r\n";
+    outs += "   \"" + name_ + "\" -> \"" + out->name_ + "\"";
+    if (out->isFused())
+    {
+      outs += " [label=\"fused\", style=bold]";
+    }
+    outs += ";\r\n";
   }
 
-  outs += "plus " + QString::number(outDataCallbacks_.size()) + " callbacks";
+  if (!outDataCallbacks_.empty())
+  {
+    outs += "   // \"" + name_ + "\" plus " + QString::number(outDataCallbacks_.size()) +
+        " callbacks\r\n";
+  }
   return outs;
 }
 
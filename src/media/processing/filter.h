@@ -1,5 +1,9 @@
 #pragma once
 
+#include "backpressurepolicy.h"
+#include "inputqueue.h"
+#include "latencyhistogram.h"
+
 #include <QWaitCondition>
 #include <QThread>
 #include <QMutex>
@@ -16,6 +20,8 @@
 #include <memory>
 #include <functional>
 #include <chrono>
+#include <atomic>
+#include <thread>
 
 // One of the most fundamental classes of Kvazzup. A filter is an indipendent data processing
 // unit running on its own thread. Filters can be linked together to form a data processing pipeline
@@ -55,6 +61,15 @@ enum HEVC_NAL_UNIT_TYPE {TRAIL_R = 1, IDR_W_RADL = 19,
 
 QString datatypeToString(const DataType type);
 
+const unsigned int MAX_VIDEO_PLANES = 3;
+
+// A NAL unit inside the payload of an encoded frame, without its start code
+struct NalUnit
+{
+  uint32_t offset;
+  uint32_t size;
+};
+
 struct VideoInfo
 {
   int16_t width;
@@ -65,9 +80,29 @@ struct VideoInfo
   bool flippedVertically = false;
   bool flippedHorizontally = false;
 
+  // Where each plane starts in data and how many bytes there are between the
+  // starts of its rows. This lets producers pass padded or cropped frames
+  // without repacking them. Zero planes means the planes are tightly packed
+  // one after another, so filters writing a new payload should set it to zero.
+  uint8_t planeCount = 0;
+  uint32_t planeOffsets[MAX_VIDEO_PLANES] = {0, 0, 0};
+  uint32_t planeStrides[MAX_VIDEO_PLANES] = {0, 0, 0};
+
+  // The RoI map is shared by all frames using the same map and it must not
+  // be modified after it has been given to a frame.
   int roiWidth = 0;
   int roiHeight = 0;
-  std::unique_ptr<int8_t[]> roiArray = nullptr;
+  std::shared_ptr<int8_t[]> roiArray = nullptr;
+
+  // The NAL units of an encoded frame if the encoder has found them, so that
+  // the senders do not have to search frames of one NAL unit for start codes.
+  std::shared_ptr<const std::vector<NalUnit>> nalUnits = nullptr;
+
+  // the simulcast layer of an encoded frame, 0 is the full resolution
+  uint8_t spatialLayer = 0;
+
+  // frames of a layer are only referenced by frames of the same or higher layer
+  uint8_t temporalLayer = 0;
 };
 
 struct AudioInfo
@@ -75,21 +110,117 @@ struct AudioInfo
   uint16_t sampleRate = 0;
 };
 
+// Media info stored inside Data so that creating Data does not need separate
+// allocations for it. Used like a pointer which is either set or nullptr.
+template <typename Info>
+class InlineInfo
+{
+public:
+  InlineInfo(std::nullptr_t = nullptr):
+    info_(),
+    set_(false)
+  {}
+
+  // sets the info with default values
+  void emplace()
+  {
+    info_ = Info();
+    set_ = true;
+  }
+
+  void reset()
+  {
+    info_ = Info();
+    set_ = false;
+  }
+
+  Info* get()
+  {
+    return set_ ? &info_ : nullptr;
+  }
+
+  const Info* get() const
+  {
+    return set_ ? &info_ : nullptr;
+  }
+
+  Info* operator->()
+  {
+    Q_ASSERT(set_);
+    return &info_;
+  }
+
+  const Info* operator->() const
+  {
+    Q_ASSERT(set_);
+    return &info_;
+  }
+
+  explicit operator bool() const
+  {
+    return set_;
+  }
+
+  bool operator==(std::nullptr_t) const
+  {
+    return !set_;
+  }
+
+  bool operator!=(std::nullptr_t) const
+  {
+    return set_;
+  }
+
+private:
+  Info info_;
+  bool set_;
+};
+
 struct Data
 {
   DataSource source = DS_UNKNOWN;
   DataType type = DT_NONE;
-  std::unique_ptr<uchar[]> data = nullptr;
+
+  // The payload is shared between all the copies made when a filter fans its
+  // output out to several filters, so it must be treated as read-only. Use
+  // Filter::makeDataWritable before modifying the payload in place.
+  std::shared_ptr<uchar[]> data = nullptr;
   uint32_t data_size = 0;
 
   int64_t presentationTime = -1;
 
-  std::unique_ptr<VideoInfo> vInfo = nullptr;
-  std::unique_ptr<AudioInfo> aInfo = nullptr;
+  // monotonic time in microseconds when this was put to the input of a filter
+  int64_t queuedTime = -1;
+
+  InlineInfo<VideoInfo> vInfo = nullptr;
+  InlineInfo<AudioInfo> aInfo = nullptr;
 };
 
+// A format and the relative cost of handling it, used when the filter graph
+// negotiates formats. The cost is roughly CPU time per pixel where 1 is about
+// the cost of copying the frame.
+struct FormatCost
+{
+  DataType type;
+  uint32_t cost;
+};
+
+// number of planes in a raw video frame of this type, zero for compressed video
+unsigned int videoPlaneCount(DataType type);
+
+// the bytes of pixels on one row and the number of rows of a plane
+void videoPlaneSize(DataType type, uint32_t width, uint32_t height, unsigned int plane,
+                    uint32_t& rowBytes, uint32_t& rows);
+
+// the start and row stride of a video plane, also for tightly packed frames
+uint8_t* videoPlane(const Data* data, unsigned int plane, uint32_t& stride);
+
+// whether the planes follow each other without any padding
+bool isPackedVideo(const Data* data);
+
 class StatisticsInterface;
 class ResourceAllocator;
+class FilterScheduler;
 
 class Filter : public QThread
 {
@@ -111,6 +242,10 @@ public:
   void addOutConnection(std::shared_ptr<Filter> out);
   void removeOutConnection(std::shared_ptr<Filter> out);
 
+  // removes all outbound connections so the filters after this one no longer
+  // count it as an input
+  void removeOutConnections();
+
   // callback registeration enables other classes besides Filter
   // to receive output data
   template <typename Class>
@@ -127,6 +262,53 @@ public:
 
   void putInput(std::unique_ptr<Data> data);
 
+  // sets how input is discarded when this filter cannot keep up
+  void setBackpressurePolicy(std::shared_ptr<BackpressurePolicy> policy);
+
+  // Provides payload buffers instead of the frame pool. Returns nullptr for
+  // the buffers it does not provide.
+  typedef std::function<std::shared_ptr<uchar[]>(DataType type, uint32_t size)> BufferSource;
+
+  // Lets the filter write its output directly to memory owned by the next
+  // filter, for example to the input pictures of the encoder.
+  void setBufferSource(std::shared_ptr<BufferSource> source);
+
+  // Redefine this to return true if the filter handles each input independently
+  // and produces at most one output for it. These filters may be fused.
+  virtual bool isFusable() const
+  {
+    return false;
+  }
+
+  // A fused filter is run by the thread of its upstream filter right after
+  // receiving input, which saves a wake up and a thread switch per frame.
+  // Fusing is only possible before start. Fusion only lasts while the filter
+  // has a single upstream filter.
+  bool setFusion(bool fused);
+
+  bool isFused() const
+  {
+    return fused_;
+  }
+
+  // Redefine this if the filter can take several input formats. The graph
+  // picks the format which is cheapest to produce and sets it before init.
+  virtual std::vector<FormatCost> inputFormats() const
+  {
+    return {{input_, 0}};
+  }
+
+  // sets the input type to one of inputFormats
+  bool selectInputFormat(DataType type);
+
+  // Conversion filters are reused by other filters needing the same format
+  virtual bool isFormatConversion() const
+  {
+    return false;
+  }
+
+  std::vector<std::shared_ptr<Filter>> getOutConnections();
+
   // for debugging filter graphs
   virtual DataType inputType() const
   {
@@ -137,20 +319,22 @@ public:
     return output_;
   }
 
-  virtual void start()
-  {
-    running_ = true;
-    QThread::start();
-  }
+  // starts the filter thread or, if the filter thread pool is enabled,
+  // schedules the filter on the pool.
+  virtual void start();
 
   virtual void stop();
 
+  // the out connections in Graphviz dot format
   QString printOutputs();
 
   // helper function for copying Data
   Data* shallowDataCopy(Data* original) const;
   Data* deepDataCopy(Data* original) const;
 
+  // copy which shares the payload with original instead of copying it
+  Data* sharedDataCopy(Data* original) const;
+
   QString getName() const
   {
     return name_;
@@ -163,6 +347,21 @@ protected:
   std::unique_ptr<Data> normalizeOrientation(std::unique_ptr<Data> video,
                                              bool forceHorizontalFlip = false);
 
+  // copies the payload if it is shared with other Data so that it can be
+  // modified in place without affecting the other filters.
+  void makeDataWritable(Data* data) const;
+
+  // Repacks the planes of a padded video frame tightly. Filters which do not
+  // support strides call this, it does nothing if the frame is already packed.
+  void packVideo(Data* data) const;
+
+  // Gets a payload buffer from the buffer source or the frame pool. The
+  // buffer returns to its owner when the last Data using it is destroyed.
+  std::shared_ptr<uchar[]> getDataBuffer(DataType type, uint32_t size) const;
+
+  // gets a RoI map from the frame pool, works like getDataBuffer
+  std::shared_ptr<int8_t[]> getRoiBuffer(uint32_t size) const;
+
   // return: oldest element in buffer, empty if none found
   std::unique_ptr<Data> getInput();
 
@@ -180,16 +379,40 @@ protected:
 
   void wakeUp()
   {
-    waitMutex_->lock();
-    hasInput_.wakeOne();
-    waitMutex_->unlock();
+    if (scheduler_)
+    {
+      scheduleProcessing();
+      return;
+    }
+
+    inputPending_.store(true);
+
+    // a running filter checks for pending input before going to sleep,
+    // so the mutex is only needed if the filter is actually sleeping
+    if (sleeping_.load())
+    {
+      waitMutex_->lock();
+      hasInput_.wakeOne();
+      waitMutex_->unlock();
+    }
   }
 
   void waitForInput()
   {
+    // there has been input while we were processing
+    if (inputPending_.exchange(false))
+    {
+      return;
+    }
+
     waitMutex_->lock();
-    // unlocks the mutex
-    hasInput_.wait(waitMutex_);
+    sleeping_.store(true);
+    while (!inputPending_.exchange(false))
+    {
+      // unlocks the mutex
+      hasInput_.wait(waitMutex_);
+    }
+    sleeping_.store(false);
     waitMutex_->unlock();
   }
 
@@ -204,9 +427,6 @@ protected:
     return hwResources_;
   }
 
-  // -1 disables buffer, but its not recommended because delay
-  int maxBufferSize_;
-
   DataType input_;
   DataType output_;
 
@@ -216,11 +436,36 @@ protected:
   void printDataBytes(QString type, const uint8_t *payload, size_t size,
                       int bytes, int shift);
 
-  unsigned int inputDiscarded_;
+  // also counted by the filter thread when the policy discards in getInput
+  std::atomic<unsigned int> inputDiscarded_;
 private:
 
+  friend class FilterScheduler;
+
+  // The states of a filter in the filter thread pool. RERUN means that new
+  // input arrived during processing and the filter must be processed again.
+  enum ScheduleState {SCHEDULE_IDLE, SCHEDULE_QUEUED, SCHEDULE_RUNNING, SCHEDULE_RERUN};
+
+  // adds this filter to the thread pool unless it is already waiting there
+  void scheduleProcessing();
+
+  // called by the thread pool worker
+  void runScheduled();
+
+  // whether this filter uses the priority lane of the thread pool
+  bool isPriority() const;
+
   std::unique_ptr<Data> validityCheck(std::unique_ptr<Data> data, bool &ok);
 
+  // records input discarded by backpressure policy
+  void inputDropped(uint32_t amount);
+
+  // reports the latency histograms to statistics once a second
+  void reportLatencies(int64_t now);
+
+  // monotonic clock in microseconds
+  int64_t monotonicTime() const;
+
   std::chrono::time_point<std::chrono::high_resolution_clock> getFrameTimepoint();
   void resetSynchronizationPoint(int32_t framerateNumerator,
                                  int32_t framerateDenominator);
@@ -232,19 +477,43 @@ private:
   QMutex *waitMutex_;
   QWaitCondition hasInput_;
 
-  bool running_;
+  std::atomic<bool> inputPending_;
+  std::atomic<bool> sleeping_;
+
+  // nullptr if the filter runs on its own thread
+  std::shared_ptr<FilterScheduler> scheduler_;
+  std::atomic<int> scheduleState_;
+  std::atomic<std::thread::id> schedulerThread_;
+
+  std::atomic<bool> running_;
 
   std::vector<std::function<void(std::unique_ptr<Data>)> > outDataCallbacks_;
 
   QMutex connectionMutex_;
   std::vector<std::shared_ptr<Filter>> outConnections_;
 
-  QMutex bufferMutex_;
-  //std::queue<std::unique_ptr<Data>> inBuffer_;
-  std::deque<std::unique_ptr<Data>> inBuffer_;
+  // The input buffer is lock-free when there is only one filter feeding this
+  // one. Additional upstream filters have to take turns with producerMutex_.
+  InputQueue inBuffer_;
+  std::shared_ptr<BackpressurePolicy> inputPolicy_;
+  std::atomic<int> upstreamFilters_;
+  QMutex producerMutex_;
+
+  // held while the upstream thread runs this filter
+  std::atomic<bool> fused_;
+  QMutex fusionMutex_;
+
+  // nullptr if all buffers come from the frame pool
+  std::shared_ptr<BufferSource> bufferSource_;
 
   unsigned int inputTaken_;
 
+  // Latencies are recorded and reported by the thread processing the filter
+  LatencyHistogram queueLatency_;
+  LatencyHistogram processingLatency_;
+  int64_t inputTakenTime_;
+  int64_t latencyReportTime_;
+
   std::shared_ptr<ResourceAllocator> hwResources_;
 
   uint32_t filterID_;
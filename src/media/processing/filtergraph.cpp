@@ -9,6 +9,7 @@
 
 #include "media/processing/yuvtorgb32.h"
 #include "media/processing/halfrgbfilter.h"
+#include "media/processing/scalefilter.h"
 #include "media/processing/libyuvconverter.h"
 
 #include "media/processing/displayfilter.h"
@@ -39,7 +40,9 @@
 #include <QTextStream>
 #include <QAudioFormat>
 
+#include <algorithm>
 #include <chrono>
+#include <map>
 #include <thread>
 
 
@@ -62,6 +65,33 @@ const int AUDIO_INPUT_GAIN = 10; // dB
 const int32_t AUDIO_OUTPUT_VOLUME = INT32_MAX - INT32_MAX/4;
 const int AUDIO_OUTPUT_GAIN = 20; // dB
 
+// Each added conversion filter costs a queue and a buffer even if the
+// conversion itself is cheap, so fewer conversions are preferred.
+const uint32_t CONVERSION_HOP_COST = 1;
+
+// a conversion the filter graph can add and its cost
+struct FormatConversion
+{
+  DataType from;
+  DataType to;
+  uint32_t cost;
+};
+
+// the conversions offered by conversion filters
+static std::vector<FormatConversion> availableConversions()
+{
+  std::vector<FormatConversion> conversions;
+
+  for (auto& input : LibYUVConverter::supportedInputs())
+  {
+    conversions.push_back({input.type, DT_YUV420VIDEO, input.cost});
+  }
+
+  conversions.push_back({DT_YUV420VIDEO, DT_RGB32VIDEO, YUVtoRGB32::CONVERSION_COST});
+
+  return conversions;
+}
+
 void changeState(std::shared_ptr<Filter> f, bool state);
 
 FilterGraph::FilterGraph(): QObject(),
@@ -71,6 +101,8 @@ FilterGraph::FilterGraph(): QObject(),
   stats_(nullptr),
   cameraGraph_(),
   screenShareGraph_(),
+  simulcastGraph_(),
+  simulcastResolution_(),
   selfviewFilter_(nullptr),
   roiInterface_(nullptr),
   videoFormat_(""),
@@ -116,6 +148,10 @@ void FilterGraph::init(QList<VideoInterface *> selfViews, StatisticsInterface* s
   selfviewFilter_ =
       std::shared_ptr<DisplayFilter>(new DisplayFilter("Self", stats_, hwResources_, selfViews, 1111));
 
+  // The camera is converted, scaled and mirrored for the self view in one
+  // pass instead of separate filters. This has no effect on views drawing YUV.
+  selfviewFilter_->setYUVConversion(true);
+
   initCameraSelfView();
 }
 
@@ -149,7 +185,7 @@ void FilterGraph::updateVideoSettings()
         {
           for (auto& senderFilter : peer.second->videoSenders)
           {
-            cameraGraph_.back()->addOutConnection(senderFilter);
+            connectVideoSender(senderFilter);
           }
         }
       }
@@ -162,6 +198,36 @@ void FilterGraph::updateVideoSettings()
     {
       filter->updateSettings();
     }
+
+    QSize resolution(settingValue(SettingsKey::videoResolutionWidth),
+                     settingValue(SettingsKey::videoResolutionHeight));
+
+    // Rebuilding the layers restarts their encoders, so it is only done when
+    // the number of layers or the resolution they are scaled from changes.
+    if (videoSendIniated_ &&
+        (simulcastLayers() != hwResources_->getSimulcastLayers() ||
+         (simulcastLayers() > 1 && resolution != simulcastResolution_)))
+    {
+      initSimulcast(cameraGraph_.back());
+
+      for(auto& peer : peers_)
+      {
+        if(peer.second != nullptr)
+        {
+          for (auto& senderFilter : peer.second->videoSenders)
+          {
+            connectSimulcastLayers(senderFilter);
+          }
+        }
+      }
+    }
+    else
+    {
+      for (auto& filter : simulcastGraph_)
+      {
+        filter->updateSettings();
+      }
+    }
   }
 
   // screen share and conversions
@@ -295,22 +361,30 @@ void FilterGraph::initCameraSelfView()
     // is changed later.
     // Note: mirroring is slow with Qt
 
-    std::shared_ptr<Filter> resizeFilter = std::shared_ptr<Filter>(new HalfRGBFilter("", stats_, hwResources_));
+    // The needed conversions are negotiated from the source. A view drawing
+    // YUV scales the frame itself and the self view conversion scales the
+    // camera, so only screen sharing to an RGB view needs the RGB resize.
     if (!cameraGraph_.empty())
     {
-      addToGraph(std::shared_ptr<Filter>(new LibYUVConverter("", stats_, hwResources_,
-                                                             cameraGraph_.at(0)->outputType())), cameraGraph_, 0);
-      addToGraph(resizeFilter, cameraGraph_, cameraGraph_.size() - 1);
-      addToGraph(selfviewFilter_, cameraGraph_, cameraGraph_.size() - 1);
+      addToGraph(selfviewFilter_, cameraGraph_, 0);
     }
 
-    if (!screenShareGraph_.empty())
+    // the screen share graph is kept when the camera is changed, so it is
+    // only connected the first time
+    if (!screenShareGraph_.empty() &&
+        std::find(screenShareGraph_.begin(), screenShareGraph_.end(), selfviewFilter_) ==
+        screenShareGraph_.end())
     {
-      addToGraph(std::shared_ptr<Filter>(new LibYUVConverter("", stats_, hwResources_,
-                                                             screenShareGraph_.at(0)->outputType())),
-                 screenShareGraph_, 0);
-      addToGraph(resizeFilter, screenShareGraph_, screenShareGraph_.size() - 1);
-      addToGraph(selfviewFilter_, screenShareGraph_, screenShareGraph_.size() - 1);
+      if (selfviewFilter_->inputType() == DT_RGB32VIDEO || selfviewFilter_->convertsYUV())
+      {
+        addToGraph(std::shared_ptr<Filter>(new HalfRGBFilter("", stats_, hwResources_)),
+                   screenShareGraph_, 0);
+        addToGraph(selfviewFilter_, screenShareGraph_, screenShareGraph_.size() - 1);
+      }
+      else
+      {
+        addToGraph(selfviewFilter_, screenShareGraph_, 0);
+      }
     }
 
     selfviewFilter_->setHorizontalMirroring(true);
@@ -321,6 +395,7 @@ void FilterGraph::initCameraSelfView()
   }
 
   selectVideoSource();
+  printGraph();
 }
 
 
@@ -334,25 +409,158 @@ void FilterGraph::initVideoSend()
     initCameraSelfView();
   }
 
-  // we connect mroi to libyuv conversion filter which makes sure the format is correct
+  // we connect mroi to camera and it reuses the self view conversion if
+  // there is one
   std::shared_ptr<Filter> mRoi =
       std::shared_ptr<Filter>(new ROIManualFilter("", stats_, hwResources_, roiInterface_));
-  addToGraph(mRoi, cameraGraph_, 1);
+  addToGraph(mRoi, cameraGraph_, 0);
 #ifdef KVAZZUP_HAVE_ONNX_RUNTIME
   auto roi = std::shared_ptr<Filter>(new RoiFilter("", stats_, hwResources_, true, roiInterface_));
   addToGraph(roi, cameraGraph_, cameraGraph_.size() - 1);
 #endif
 
-  std::shared_ptr<Filter> kvazaar =
-      std::shared_ptr<Filter>(new KvazaarFilter("", stats_, hwResources_));
+  std::shared_ptr<KvazaarFilter> kvazaar =
+      std::shared_ptr<KvazaarFilter>(new KvazaarFilter("", stats_, hwResources_));
 
   addToGraph(kvazaar, cameraGraph_, cameraGraph_.size() - 1);
   addToGraph(kvazaar, screenShareGraph_, 0);
 
+  // The filters producing the encoder input write their frames directly to
+  // Kvazaar input pictures so the encoder does not have to copy them. Frames
+  // of other sizes still use the frame pool.
+  std::shared_ptr<Filter::BufferSource> pictures = kvazaar->pictureSource();
+  for (GraphSegment* segment : {&cameraGraph_, &screenShareGraph_})
+  {
+    for (auto& filter : *segment)
+    {
+      if (filter != kvazaar && filter->outputType() == DT_YUV420VIDEO)
+      {
+        filter->setBufferSource(pictures);
+      }
+    }
+  }
+
+  initSimulcast(kvazaar);
+
   videoSendIniated_ = true;
 }
 
 
+void FilterGraph::initSimulcast(std::shared_ptr<Filter> fullEncoder)
+{
+  if (!simulcastGraph_.empty())
+  {
+    // the first scaler may still be fed by the camera or screen share
+    for (GraphSegment* segment : {&cameraGraph_, &screenShareGraph_})
+    {
+      for (auto& filter : *segment)
+      {
+        std::vector<std::shared_ptr<Filter>> outs = filter->getOutConnections();
+        if (std::find(outs.begin(), outs.end(), simulcastGraph_.front()) != outs.end())
+        {
+          filter->removeOutConnection(simulcastGraph_.front());
+        }
+      }
+    }
+  }
+
+  destroyFilters(simulcastGraph_);
+
+  unsigned int layers = simulcastLayers();
+  hwResources_->setSimulcastLayers(layers);
+
+  if (layers <= 1)
+  {
+    return;
+  }
+
+  Logger::getLogger()->printNormal(this, "Iniating simulcast", "Layers", QString::number(layers));
+
+  // the smaller layers get the same frames as the full resolution encoder
+  std::vector<std::shared_ptr<Filter>> sources;
+  for (GraphSegment* segment : {&cameraGraph_, &screenShareGraph_})
+  {
+    for (auto& filter : *segment)
+    {
+      std::vector<std::shared_ptr<Filter>> outs = filter->getOutConnections();
+      if (std::find(outs.begin(), outs.end(), fullEncoder) != outs.end())
+      {
+        sources.push_back(filter);
+      }
+    }
+  }
+
+  QSize full(settingValue(SettingsKey::videoResolutionWidth),
+             settingValue(SettingsKey::videoResolutionHeight));
+  simulcastResolution_ = full;
+
+  // Each layer is scaled from the one before it, so the full frame is only
+  // read once and the scaled frames are shared with the next layer.
+  for (unsigned int layer = 1; layer < layers; ++layer)
+  {
+    QString layerID = "Layer " + QString::number(layer);
+
+    std::shared_ptr<ScaleFilter> scaler =
+        std::shared_ptr<ScaleFilter>(new ScaleFilter(layerID, stats_, hwResources_));
+    scaler->setResolution(simulcastLayerSize(full, layer));
+
+    if (layer == 1)
+    {
+      addToGraph(scaler, simulcastGraph_);
+      for (auto& source : sources)
+      {
+        connectFilters(source, scaler);
+      }
+    }
+    else
+    {
+      // the scaler of the previous layer is before its encoder
+      addToGraph(scaler, simulcastGraph_, simulcastGraph_.size() - 2);
+    }
+
+    std::shared_ptr<KvazaarFilter> encoder =
+        std::shared_ptr<KvazaarFilter>(new KvazaarFilter(layerID, stats_, hwResources_, layer));
+    addToGraph(encoder, simulcastGraph_, simulcastGraph_.size() - 1);
+
+    scaler->setBufferSource(encoder->pictureSource());
+  }
+}
+
+
+void FilterGraph::connectVideoSender(std::shared_ptr<Filter> sender)
+{
+  cameraGraph_.back()->addOutConnection(sender);
+  connectSimulcastLayers(sender);
+}
+
+
+void FilterGraph::connectSimulcastLayers(std::shared_ptr<Filter> sender)
+{
+  // the sender picks the layer it sends
+  for (auto& filter : simulcastGraph_)
+  {
+    if (filter->outputType() == DT_HEVCVIDEO)
+    {
+      filter->addOutConnection(sender);
+    }
+  }
+}
+
+
+void FilterGraph::disconnectVideoSender(std::shared_ptr<Filter> sender)
+{
+  cameraGraph_.back()->removeOutConnection(sender);
+
+  for (auto& filter : simulcastGraph_)
+  {
+    if (filter->outputType() == DT_HEVCVIDEO)
+    {
+      filter->removeOutConnection(sender);
+    }
+  }
+}
+
+
 void FilterGraph::initializeAudioInput(bool opus)
 {
   audioCapture_ = std::shared_ptr<AudioCaptureFilter>(new AudioCaptureFilter("", format_, stats_, hwResources_));
@@ -369,7 +577,7 @@ void FilterGraph::initializeAudioInput(bool opus)
 
   if (aec_ == nullptr)
   {
-    aec_ = std::make_shared<SpeexAEC>(format_);
+    aec_ = std::make_shared<SpeexAEC>(format_, hwResources_->getFramePool());
     aec_->init();
   }
 
@@ -396,7 +604,7 @@ void FilterGraph::initializeAudioOutput(bool opus)
 
   if (aec_ == nullptr)
   {
-    aec_ = std::make_shared<SpeexAEC>(format_);
+    aec_ = std::make_shared<SpeexAEC>(format_, hwResources_->getFramePool());
     aec_->init();
   }
 
@@ -424,62 +632,172 @@ bool FilterGraph::addToGraph(std::shared_ptr<Filter> filter,
                              GraphSegment &graph,
                              size_t connectIndex)
 {
-  // // check if we need some sort of conversion and connect to index
   if(graph.size() > 0 && connectIndex <= graph.size() - 1)
   {
-    if(graph.at(connectIndex)->outputType() != filter->inputType())
+    if (graph.at(connectIndex)->outputType() == DT_NONE)
     {
-      Logger::getLogger()->printDebug(DEBUG_NORMAL, this, 
-                                      "Filter output and input do not match. Finding conversion",
-                                      {"Connection"}, {graph.at(connectIndex)->getName() + "->" + filter->getName()});
+      Logger::getLogger()->printProgramError(this, "The previous filter has no output!");
+      return false;
+    }
 
-      if (graph.at(connectIndex)->outputType() == DT_NONE)
-      {
-        Logger::getLogger()->printProgramError(this, "The previous filter has no output!");
-        return false;
-      }
+    if (!negotiateFormat(filter, graph, connectIndex))
+    {
+      return false;
+    }
+
+    // Stateless filters are run by the thread of the previous filter. This
+    // fails if the filter already has an input, since it cannot be run by two
+    // threads.
+    if (settingEnabled(SettingsKey::videoFilterFusion) && filter->isFusable())
+    {
+      filter->setFusion(true);
+    }
 
-      // TODO: Check the out connections of connected filter for an already existing conversion.
+    connectFilters(graph.at(connectIndex), filter);
+  }
+
+  graph.push_back(filter);
+  if(filter->init())
+  {
+    filter->start();
+  }
+  else
+  {
+    Logger::getLogger()->printError(this, "Failed to init filter");
+    return false;
+  }
+  return true;
+}
+
+
+bool FilterGraph::negotiateFormat(std::shared_ptr<Filter> filter, GraphSegment& graph,
+                                  size_t& connectIndex)
+{
+  // how each format can be obtained with the lowest cost
+  struct FormatNode
+  {
+    uint32_t cost;
+    bool existing;
+    size_t providerIndex; // if existing, the filter outputting this format
+    DataType previous;    // if converted, the format converted from
+  };
+
+  std::map<DataType, FormatNode> nodes;
+
+  // The output of the previous filter and of the conversions already after it
+  // are free. Searched breadth first so the closest provider is used.
+  std::vector<size_t> providers = {connectIndex};
+  for (unsigned int i = 0; i < providers.size(); ++i)
+  {
+    std::shared_ptr<Filter> provider = graph.at(providers.at(i));
+    nodes.insert({provider->outputType(), {0, true, providers.at(i), DT_NONE}});
 
-      if(filter->inputType() == DT_YUV420VIDEO)
+    for (auto& out : provider->getOutConnections())
+    {
+      auto existing = std::find(graph.begin(), graph.end(), out);
+      if (out->isFormatConversion() && existing != graph.end())
       {
-        Logger::getLogger()->printNormal(this, "Adding libyuv conversion filter to YUV420");
-        addToGraph(std::shared_ptr<Filter>(new LibYUVConverter("", stats_, hwResources_,
-                                                               graph.at(connectIndex)->outputType())),
-                                           graph, connectIndex);
+        providers.push_back(existing - graph.begin());
       }
-      else if(graph.at(connectIndex)->outputType() == DT_YUV420VIDEO &&
-              filter->inputType() == DT_RGB32VIDEO)
+    }
+  }
+
+  // The graph is tiny so we just relax the costs until nothing changes.
+  // All costs are positive so this ends.
+  std::vector<FormatConversion> conversions = availableConversions();
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (auto& conversion : conversions)
+    {
+      auto from = nodes.find(conversion.from);
+      if (from == nodes.end())
       {
-        Logger::getLogger()->printNormal(this, "Adding YUV420 to RGB32 conversion");
-        addToGraph(std::shared_ptr<Filter>(new YUVtoRGB32("", stats_, hwResources_)),
-                   graph, connectIndex);
+        continue;
       }
-      else
+
+      uint32_t cost = from->second.cost + conversion.cost + CONVERSION_HOP_COST;
+      auto to = nodes.find(conversion.to);
+      if (to == nodes.end() || cost < to->second.cost)
       {
-        Logger::getLogger()->printProgramError(this, "Could not find conversion for filter.");
-        return false;
+        nodes[conversion.to] = {cost, false, 0, conversion.from};
+        changed = true;
       }
-      // the conversion filter has been added to the end
-      connectIndex = (unsigned int)graph.size() - 1;
     }
-    connectFilters(graph.at(connectIndex), filter);
   }
 
-  graph.push_back(filter);
-  if(filter->init())
+  DataType chosen = DT_NONE;
+  uint32_t lowestCost = UINT32_MAX;
+  for (auto& format : filter->inputFormats())
   {
-    filter->start();
+    auto node = nodes.find(format.type);
+    if (node != nodes.end() && node->second.cost + format.cost < lowestCost)
+    {
+      chosen = format.type;
+      lowestCost = node->second.cost + format.cost;
+    }
   }
-  else
+
+  if (chosen == DT_NONE)
   {
-    Logger::getLogger()->printError(this, "Failed to init filter");
+    Logger::getLogger()->printProgramError(this, "Could not find conversion for filter.",
+                                           "Filter", filter->getName());
     return false;
   }
+
+  // walk back to the filter providing the format
+  std::vector<DataType> path;
+  DataType format = chosen;
+  while (!nodes.at(format).existing)
+  {
+    path.insert(path.begin(), format);
+    format = nodes.at(format).previous;
+  }
+  connectIndex = nodes.at(format).providerIndex;
+
+  if (!path.empty() || connectIndex != providers.front())
+  {
+    Logger::getLogger()->printDebug(DEBUG_NORMAL, this, "Negotiated input format",
+                                    {"Connection", "Format", "New conversions", "Cost"},
+                                    {graph.at(connectIndex)->getName() + " -> " + filter->getName(),
+                                     datatypeToString(chosen), QString::number(path.size()),
+                                     QString::number(lowestCost)});
+  }
+
+  for (DataType target : path)
+  {
+    if (!addToGraph(createConversion(graph.at(connectIndex)->outputType(), target),
+                    graph, connectIndex))
+    {
+      return false;
+    }
+
+    // the conversion filter has been added to the end
+    connectIndex = graph.size() - 1;
+  }
+
+  if (filter->inputType() != chosen)
+  {
+    return filter->selectInputFormat(chosen);
+  }
+
   return true;
 }
 
 
+std::shared_ptr<Filter> FilterGraph::createConversion(DataType from, DataType to)
+{
+  if (to == DT_YUV420VIDEO)
+  {
+    return std::shared_ptr<Filter>(new LibYUVConverter("", stats_, hwResources_, from));
+  }
+
+  Q_ASSERT(from == DT_YUV420VIDEO && to == DT_RGB32VIDEO);
+  return std::shared_ptr<Filter>(new YUVtoRGB32("", stats_, hwResources_));
+}
+
+
 bool FilterGraph::connectFilters(std::shared_ptr<Filter> previous, std::shared_ptr<Filter> filter)
 {
   Q_ASSERT(filter != nullptr && previous != nullptr);
@@ -498,6 +816,57 @@ bool FilterGraph::connectFilters(std::shared_ptr<Filter> previous, std::shared_p
 }
 
 
+void FilterGraph::printGraph()
+{
+  if (!settingEnabled(SettingsKey::videoPrintFilterGraph))
+  {
+    return;
+  }
+
+  std::vector<GraphSegment*> segments = {&cameraGraph_, &screenShareGraph_, &simulcastGraph_,
+                                         &audioInputGraph_, &audioOutputGraph_};
+
+  for (auto& peer : peers_)
+  {
+    for (auto& receiver : peer.second->videoReceivers)
+    {
+      segments.push_back(receiver.get());
+    }
+    for (auto& receiver : peer.second->audioReceivers)
+    {
+      segments.push_back(receiver.get());
+    }
+  }
+
+  // same filter may be part of several segments
+  std::vector<Filter*> printed;
+  QString dot = "digraph FilterGraph {\r\n";
+
+  for (GraphSegment* segment : segments)
+  {
+    for (auto& filter : *segment)
+    {
+      if (std::find(printed.begin(), printed.end(), filter.get()) == printed.end())
+      {
+        printed.push_back(filter.get());
+
+        if (filter->isFused())
+        {
+          dot += "   \"" + filter->getName() + "\" [style=filled];\r\n";
+        }
+        dot += filter->printOutputs();
+      }
+    }
+  }
+
+  dot += "}";
+
+  Logger::getLogger()->printNormal(this, "Filter graph topology. "
+                                         "Fused filters are run by the thread of their input.",
+                                   "Graph", dot);
+}
+
+
 void FilterGraph::checkParticipant(uint32_t sessionID)
 {
   Q_ASSERT(stats_);
@@ -547,8 +916,9 @@ void FilterGraph::sendVideoto(uint32_t sessionID, std::shared_ptr<Filter> videoF
     peers_[sessionID]->sendingStreams.push_back(id);
     peers_[sessionID]->videoSenders.push_back(videoFramedSource);
 
-    cameraGraph_.back()->addOutConnection(videoFramedSource);
+    connectVideoSender(videoFramedSource);
     videoFramedSource->start();
+    printGraph();
   }
   else
   {
@@ -558,7 +928,8 @@ void FilterGraph::sendVideoto(uint32_t sessionID, std::shared_ptr<Filter> videoF
 
 
 void FilterGraph::receiveVideoFrom(uint32_t sessionID, std::shared_ptr<Filter> videoSink,
-                                   VideoInterface *view, const MediaID &id)
+                                   VideoInterface *view, const MediaID &id,
+                                   std::function<void()> keyframeRequest)
 {
   Q_ASSERT(sessionID);
   Q_ASSERT(videoSink);
@@ -573,13 +944,27 @@ void FilterGraph::receiveVideoFrom(uint32_t sessionID, std::shared_ptr<Filter> v
     peers_[sessionID]->videoReceivers.push_back(graph);
 
     addToGraph(videoSink, *graph);
-    addToGraph(std::shared_ptr<Filter>(new OpenHEVCFilter(sessionID, stats_, hwResources_)), *graph, 0);
+
+    std::shared_ptr<OpenHEVCFilter> decoder =
+        std::shared_ptr<OpenHEVCFilter>(new OpenHEVCFilter(sessionID, stats_, hwResources_));
+    decoder->setKeyframeRequest(keyframeRequest);
+    addToGraph(decoder, *graph, 0);
+
+    // The decoded frame is scaled down to the size of the view while still in
+    // YUV so the RGB conversion and drawing do not handle pixels that are not
+    // shown. The view outlives the graph, same as with the display filter.
+    std::shared_ptr<ScaleFilter> scaler =
+        std::shared_ptr<ScaleFilter>(new ScaleFilter(QString::number(sessionID),
+                                                     stats_, hwResources_));
+    scaler->setTargetSize([view](){ return view->drawSize(); });
+    addToGraph(scaler, *graph, 1);
 
     std::shared_ptr<DisplayFilter> displayFilter =
         std::shared_ptr<DisplayFilter>(new DisplayFilter(QString::number(sessionID),
                                                          stats_, hwResources_, {view}, sessionID));
 
-    addToGraph(displayFilter, *graph, 1);
+    addToGraph(displayFilter, *graph, 2);
+    printGraph();
   }
   else
   {
@@ -698,6 +1083,7 @@ void FilterGraph::uninit()
   removeAllParticipants();
 
   destroyFilters(cameraGraph_);
+  destroyFilters(simulcastGraph_);
   videoSendIniated_ = false;
 
   destroyFilters(screenShareGraph_);
@@ -840,6 +1226,11 @@ void FilterGraph::running(bool state)
     changeState(f, state);
   }
 
+  for(std::shared_ptr<Filter>& f : simulcastGraph_)
+  {
+    changeState(f, state);
+  }
+
   for(std::shared_ptr<Filter>& f : audioInputGraph_)
   {
     changeState(f, state);
@@ -907,6 +1298,13 @@ void FilterGraph::destroyFilters(std::vector<std::shared_ptr<Filter> > &filters)
     changeState(f, false);
   }
 
+  // Filters outside this graph, such as the self view, may be connected
+  // again and can only be fused if they no longer count these as inputs.
+  for( std::shared_ptr<Filter>& f : filters )
+  {
+    f->removeOutConnections();
+  }
+
   filters.clear();
 }
 
@@ -923,7 +1321,7 @@ void FilterGraph::destroyPeer(Peer* peer)
   }
   for (auto& videoSender : peer->videoSenders)
   {
-    cameraGraph_.back()->removeOutConnection(videoSender);
+    disconnectVideoSender(videoSender);
     changeState(videoSender, false);
     videoSender = nullptr;
   }
@@ -966,6 +1364,7 @@ void FilterGraph::removeParticipant(uint32_t sessionID)
     if(!peerPresent)
     {
       destroyFilters(cameraGraph_);
+      destroyFilters(simulcastGraph_);
       destroyFilters(screenShareGraph_);
       destroyFilters(audioInputGraph_);
       destroyFilters(audioOutputGraph_);
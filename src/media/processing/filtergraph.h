@@ -4,7 +4,9 @@
 #include <QWidget>
 #include <QtMultimedia/QAudioFormat>
 #include <QObject>
+#include <QSize>
 
+#include <functional>
 #include <vector>
 #include <memory>
 
@@ -38,9 +40,11 @@ public:
   void sendVideoto(uint32_t sessionID, std::shared_ptr<Filter> videoFramedSource,
                    const MediaID &id);
 
+  // The decoder calls keyframeRequest when it needs an intra frame from the peer.
   void receiveVideoFrom(uint32_t sessionID, std::shared_ptr<Filter> videoSink,
                         VideoInterface *view,
-                        const MediaID &id);
+                        const MediaID &id,
+                        std::function<void()> keyframeRequest = nullptr);
   void sendAudioTo(uint32_t sessionID, std::shared_ptr<Filter> audioFramedSource,
                    const MediaID &id);
   void receiveAudioFrom(uint32_t sessionID, std::shared_ptr<Filter> audioSink,
@@ -66,14 +70,26 @@ private:
   void screenShare(bool shareState);
 
   // Adds fitler to graph and connects it to connectIndex unless this is
-  // the first filter in graph. Adds format conversion if needed.
+  // the first filter in graph. Adds the cheapest format conversions if needed.
   bool addToGraph(std::shared_ptr<Filter> filter,
                   GraphSegment& graph,
                   size_t connectIndex = 0);
 
+  // Finds the cheapest formats from the filter at connectIndex to the input of
+  // filter. Existing conversions after the connectIndex filter are reused.
+  // Adds the missing conversions to graph and sets connectIndex to the filter
+  // the filter should be connected to.
+  bool negotiateFormat(std::shared_ptr<Filter> filter, GraphSegment& graph,
+                       size_t& connectIndex);
+
+  std::shared_ptr<Filter> createConversion(DataType from, DataType to);
+
   // connects the two filters and checks for any problems
   bool connectFilters(std::shared_ptr<Filter> previous, std::shared_ptr<Filter> filter);
 
+  // prints all filters and connections in Graphviz dot format if enabled in settings
+  void printGraph();
+
   // makes sure the participant exists and adds if necessary
   void checkParticipant(uint32_t sessionID);
 
@@ -83,6 +99,14 @@ private:
   // iniates encoder and attaches it
   void initVideoSend();
 
+  // adds the encoders of the smaller simulcast layers if enabled
+  void initSimulcast(std::shared_ptr<Filter> fullEncoder);
+
+  // connects the sender to the encoders of all simulcast layers
+  void connectVideoSender(std::shared_ptr<Filter> sender);
+  void disconnectVideoSender(std::shared_ptr<Filter> sender);
+  void connectSimulcastLayers(std::shared_ptr<Filter> sender);
+
   // iniates encoder and attaches it
   void initializeAudioInput(bool opus);
   void initializeAudioOutput(bool opus);
@@ -126,6 +150,13 @@ private:
   GraphSegment cameraGraph_;
   GraphSegment screenShareGraph_;
 
+  // Scalers and encoders of the smaller simulcast layers. The encoder of the
+  // full resolution is the last filter of the camera graph.
+  GraphSegment simulcastGraph_;
+
+  // the full resolution the layers were scaled from
+  QSize simulcastResolution_;
+
   std::shared_ptr<DisplayFilter> selfviewFilter_;
   VideoInterface* roiInterface_; // this is the roi surface from settings
 
@@ -0,0 +1,173 @@
+#include "filterscheduler.h"
+
+#include "filter.h"
+
+
+// the scheduler and worker index of the current thread, if it is a worker
+thread_local FilterScheduler* currentScheduler = nullptr;
+thread_local unsigned int currentWorker = 0;
+
+
+FilterScheduler::FilterScheduler(unsigned int workerCount):
+  workers_(),
+  priorityMutex_(),
+  priorityTasks_(),
+  sleepMutex_(),
+  workAvailable_(),
+  sleepingWorkers_(0),
+  pendingTasks_(0),
+  nextWorker_(0),
+  running_(true)
+{
+  if (workerCount == 0)
+  {
+    workerCount = 1;
+  }
+
+  // all workers must exist before any of them starts stealing
+  for (unsigned int i = 0; i < workerCount; ++i)
+  {
+    workers_.push_back(std::unique_ptr<Worker>(new Worker));
+  }
+
+  for (unsigned int i = 0; i < workerCount; ++i)
+  {
+    workers_.at(i)->thread = std::thread(&FilterScheduler::workerLoop, this, i);
+  }
+}
+
+
+FilterScheduler::~FilterScheduler()
+{
+  running_ = false;
+
+  sleepMutex_.lock();
+  workAvailable_.wakeAll();
+  sleepMutex_.unlock();
+
+  for (auto& worker : workers_)
+  {
+    if (worker->thread.joinable())
+    {
+      worker->thread.join();
+    }
+  }
+}
+
+
+void FilterScheduler::schedule(Filter* filter, bool priority)
+{
+  ++pendingTasks_;
+
+  if (priority)
+  {
+    priorityMutex_.lock();
+    priorityTasks_.push_back(filter);
+    priorityMutex_.unlock();
+  }
+  else
+  {
+    // Filters woken by a worker are likely to process the output of that
+    // worker, so keeping them on the same worker keeps the data in cache.
+    unsigned int index = 0;
+    if (currentScheduler == this)
+    {
+      index = currentWorker;
+    }
+    else
+    {
+      index = nextWorker_++ % workers_.size();
+    }
+
+    Worker* worker = workers_.at(index).get();
+    worker->taskMutex.lock();
+    worker->tasks.push_back(filter);
+    worker->taskMutex.unlock();
+  }
+
+  // waking is only needed if someone is sleeping. The sleeping worker checks
+  // pendingTasks_ before going to sleep so this cannot be missed.
+  if (sleepingWorkers_.load() > 0)
+  {
+    sleepMutex_.lock();
+    workAvailable_.wakeOne();
+    sleepMutex_.unlock();
+  }
+}
+
+
+void FilterScheduler::workerLoop(unsigned int index)
+{
+  currentScheduler = this;
+  currentWorker = index;
+
+  while (running_)
+  {
+    Filter* filter = takeTask(index);
+
+    if (filter != nullptr)
+    {
+      filter->runScheduled();
+    }
+    else
+    {
+      sleepMutex_.lock();
+      ++sleepingWorkers_;
+      while (running_ && pendingTasks_.load() == 0)
+      {
+        workAvailable_.wait(&sleepMutex_);
+      }
+      --sleepingWorkers_;
+      sleepMutex_.unlock();
+    }
+  }
+}
+
+
+Filter* FilterScheduler::takeTask(unsigned int index)
+{
+  Filter* filter = nullptr;
+
+  // audio first
+  priorityMutex_.lock();
+  if (!priorityTasks_.empty())
+  {
+    filter = priorityTasks_.front();
+    priorityTasks_.pop_front();
+  }
+  priorityMutex_.unlock();
+
+  // then our own queue. Tasks are taken in order so that a busy pipeline
+  // cannot starve the older tasks
+  if (filter == nullptr)
+  {
+    Worker* own = workers_.at(index).get();
+    own->taskMutex.lock();
+    if (!own->tasks.empty())
+    {
+      filter = own->tasks.front();
+      own->tasks.pop_front();
+    }
+    own->taskMutex.unlock();
+  }
+
+  // and finally steal from other workers
+  for (unsigned int i = 1; filter == nullptr && i < workers_.size(); ++i)
+  {
+    Worker* victim = workers_.at((index + i) % workers_.size()).get();
+    victim->taskMutex.lock();
+    if (!victim->tasks.empty())
+    {
+      filter = victim->tasks.front();
+      victim->tasks.pop_front();
+    }
+    victim->taskMutex.unlock();
+  }
+
+  if (filter != nullptr)
+  {
+    --pendingTasks_;
+  }
+
+  return filter;
+}
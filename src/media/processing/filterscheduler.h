@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class Filter;
+
+/* An alternative to running each filter on its own thread. The scheduler has
+ * a fixed number of worker threads which run the process function of filters
+ * that have received input. Each worker has its own task queue and idle
+ * workers steal tasks from the others. Audio filters are put into a priority
+ * lane which is always served before the worker queues, since audio is much
+ * more sensitive to delay than video.
+ *
+ * A filter is never processed by two workers at the same time, see
+ * Filter::scheduleProcessing. */
+
+class FilterScheduler
+{
+public:
+  FilterScheduler(unsigned int workerCount);
+  ~FilterScheduler();
+
+  // Adds filter to be processed by one of the workers.
+  void schedule(Filter* filter, bool priority);
+
+  unsigned int workerCount() const
+  {
+    return (unsigned int)workers_.size();
+  }
+
+private:
+
+  struct Worker
+  {
+    QMutex taskMutex;
+    std::deque<Filter*> tasks;
+    std::thread thread;
+  };
+
+  void workerLoop(unsigned int index);
+
+  // returns nullptr if no work was found
+  Filter* takeTask(unsigned int index);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  QMutex priorityMutex_;
+  std::deque<Filter*> priorityTasks_;
+
+  // workers sleep when there are no tasks
+  QMutex sleepMutex_;
+  QWaitCondition workAvailable_;
+  std::atomic<int> sleepingWorkers_;
+  std::atomic<int> pendingTasks_;
+
+  std::atomic<unsigned int> nextWorker_;
+  std::atomic<bool> running_;
+};
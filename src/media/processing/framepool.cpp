@@ -0,0 +1,109 @@
+#include "framepool.h"
+
+// how many unused buffers we keep for each size class. Enough for the
+// buffers of a filter graph, but not so many that we hoard memory after
+// a resolution change.
+const unsigned int MAX_FREE_BUFFERS = 8;
+
+// sizes below this are rounded to multiples of the minimum class
+const uint32_t SMALL_BUFFER_LIMIT = 4096;
+const uint32_t SMALL_SIZE_CLASS = 256;
+
+
+FramePool::FramePool():
+  poolMutex_(),
+  freeBuffers_()
+{}
+
+
+FramePool::~FramePool()
+{
+  clear();
+}
+
+
+std::shared_ptr<uchar[]> FramePool::allocate(DataType type, uint32_t size)
+{
+  PoolKey key = {type, sizeClass(size)};
+  uchar* buffer = nullptr;
+
+  poolMutex_.lock();
+  auto it = freeBuffers_.find(key);
+  if (it != freeBuffers_.end() && !it->second.empty())
+  {
+    buffer = it->second.back();
+    it->second.pop_back();
+  }
+  poolMutex_.unlock();
+
+  if (buffer == nullptr)
+  {
+    buffer = new uchar[key.second];
+  }
+
+  // the buffer is deleted normally if the pool no longer exists
+  std::weak_ptr<FramePool> pool = weak_from_this();
+  return std::shared_ptr<uchar[]>(buffer, [pool, key](uchar* released)
+  {
+    if (std::shared_ptr<FramePool> owner = pool.lock())
+    {
+      owner->release(key, released);
+    }
+    else
+    {
+      delete[] released;
+    }
+  });
+}
+
+
+void FramePool::clear()
+{
+  poolMutex_.lock();
+  for (auto& sizeClass : freeBuffers_)
+  {
+    for (uchar* buffer : sizeClass.second)
+    {
+      delete[] buffer;
+    }
+  }
+  freeBuffers_.clear();
+  poolMutex_.unlock();
+}
+
+
+uint32_t FramePool::sizeClass(uint32_t size)
+{
+  if (size <= SMALL_BUFFER_LIMIT)
+  {
+    return ((size + SMALL_SIZE_CLASS - 1)/SMALL_SIZE_CLASS)*SMALL_SIZE_CLASS;
+  }
+
+  // each power of two is divided into eight classes, so at most 12.5% is wasted
+  uint32_t power = SMALL_BUFFER_LIMIT;
+  while (power <= size/2)
+  {
+    power *= 2;
+  }
+
+  uint32_t step = power/8;
+  return ((size + step - 1)/step)*step;
+}
+
+
+void FramePool::release(PoolKey key, uchar* buffer)
+{
+  poolMutex_.lock();
+  std::vector<uchar*>& buffers = freeBuffers_[key];
+  if (buffers.size() < MAX_FREE_BUFFERS)
+  {
+    buffers.push_back(buffer);
+    buffer = nullptr;
+  }
+  poolMutex_.unlock();
+
+  if (buffer != nullptr)
+  {
+    delete[] buffer;
+  }
+}
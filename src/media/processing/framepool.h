@@ -0,0 +1,41 @@
+#pragma once
+
+#include "filter.h"
+
+#include <QMutex>
+
+#include <map>
+#include <vector>
+#include <memory>
+
+/* A pool of payload buffers for Data. Allocating and freeing multi-megabyte
+ * frame buffers for every frame causes page faults and allocator lock
+ * contention, so instead the buffers are recycled. The buffers are grouped by
+ * the data type and size class, where the size class is determined by the
+ * resolution of the frame. A buffer returns to the pool automatically once
+ * the last Data using it has been destroyed. */
+
+class FramePool : public std::enable_shared_from_this<FramePool>
+{
+public:
+  FramePool();
+  ~FramePool();
+
+  // Returns a buffer with room for at least size bytes
+  std::shared_ptr<uchar[]> allocate(DataType type, uint32_t size);
+
+  // frees all buffers currently waiting in the pool
+  void clear();
+
+  // the size of the buffer actually allocated for size bytes
+  static uint32_t sizeClass(uint32_t size);
+
+private:
+
+  typedef std::pair<DataType, uint32_t> PoolKey;
+
+  void release(PoolKey key, uchar* buffer);
+
+  QMutex poolMutex_;
+  std::map<PoolKey, std::vector<uchar*>> freeBuffers_;
+};
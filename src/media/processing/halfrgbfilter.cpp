@@ -2,6 +2,8 @@
 
 #include "yuvconversions.h"
 
+#include "media/resourceallocator.h"
+
 
 
 HalfRGBFilter::HalfRGBFilter(QString id, StatisticsInterface *stats,
@@ -26,18 +28,30 @@ void HalfRGBFilter::process()
   {
     if (input->vInfo->height >= 720)
     {
-      uint32_t finalDataSize = input->data_size/4;
-      std::unique_ptr<uchar[]> rgb_data(new uchar[finalDataSize]);
+      packVideo(input.get());
 
-      half_rgb(input->data.get(), rgb_data.get(),
-               input->vInfo->width, input->vInfo->height);
+      uint32_t finalDataSize = input->data_size/4;
+      std::shared_ptr<uchar[]> rgb_data = getDataBuffer(DT_RGB32VIDEO, finalDataSize);
+
+      if (getHWManager()->isAVX2Enabled())
+      {
+        half_rgb_avx2(input->data.get(), rgb_data.get(),
+                      input->vInfo->width, input->vInfo->height);
+      }
+      else
+      {
+        half_rgb(input->data.get(), rgb_data.get(),
+                 input->vInfo->width, input->vInfo->height);
+      }
 
       input->data = std::move(rgb_data);
       input->data_size = finalDataSize;
+      input->vInfo->planeCount = 0;
       input->vInfo->width  = input->vInfo->width/2;
       input->vInfo->height = input->vInfo->height/2;
     }
 
     sendOutput(std::move(input));
+    input = getInput();
   }
 }
@@ -10,6 +10,11 @@ public:
 
   virtual void updateSettings();
 
+  virtual bool isFusable() const
+  {
+    return true;
+  }
+
 protected:
 
   void process();
@@ -0,0 +1,77 @@
+#include "inputqueue.h"
+
+#include "filter.h"
+
+
+InputQueue::InputQueue(uint32_t capacity):
+  capacity_(1),
+  mask_(0),
+  slots_(nullptr),
+  head_(0),
+  tail_(0)
+{
+  while (capacity_ < capacity)
+  {
+    capacity_ *= 2;
+  }
+  mask_ = capacity_ - 1;
+
+  slots_ = std::unique_ptr<std::atomic<Data*>[]>(new std::atomic<Data*>[capacity_]);
+  for (uint32_t i = 0; i < capacity_; ++i)
+  {
+    slots_[i].store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+
+InputQueue::~InputQueue()
+{
+  while (pop() != nullptr)
+  {}
+}
+
+
+bool InputQueue::push(std::unique_ptr<Data> data)
+{
+  uint64_t tail = tail_.load(std::memory_order_relaxed);
+
+  // acquire makes sure the consumer has finished reading the slot we reuse
+  if (tail - head_.load(std::memory_order_acquire) >= capacity_)
+  {
+    return false;
+  }
+
+  slots_[tail & mask_].store(data.release(), std::memory_order_relaxed);
+  tail_.store(tail + 1, std::memory_order_release);
+
+  return true;
+}
+
+
+std::unique_ptr<Data> InputQueue::pop()
+{
+  uint64_t head = head_.load(std::memory_order_acquire);
+
+  while (head != tail_.load(std::memory_order_acquire))
+  {
+    // the slot may have been reused if someone else popped it first, but in
+    // that case head has moved and the swap below fails
+    Data* data = slots_[head & mask_].load(std::memory_order_relaxed);
+
+    if (head_.compare_exchange_weak(head, head + 1, std::memory_order_acq_rel))
+    {
+      return std::unique_ptr<Data>(data);
+    }
+  }
+
+  return nullptr;
+}
+
+
+uint32_t InputQueue::size() const
+{
+  // head must be read first so that it can never be ahead of tail
+  uint64_t head = head_.load(std::memory_order_acquire);
+  uint64_t tail = tail_.load(std::memory_order_acquire);
+  return (uint32_t)(tail - head);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+struct Data;
+
+// A bounded lock-free ring buffer for the input of a filter. Only one thread
+// may push at a time, but popping is done with compare-and-swap so that any
+// thread can pop. This lets the producer discard the oldest input when the
+// filter is falling behind while the filter thread is reading the queue.
+
+class InputQueue
+{
+public:
+  // capacity is rounded up to the next power of two
+  InputQueue(uint32_t capacity);
+  ~InputQueue();
+
+  // Adds data to the end of queue. Returns false and deletes the data if the
+  // queue is full. Only one thread may push at a time.
+  bool push(std::unique_ptr<Data> data);
+
+  // Removes the oldest data in queue. Returns nullptr if the queue is empty.
+  std::unique_ptr<Data> pop();
+
+  // the result may already be outdated if other threads are using the queue
+  uint32_t size() const;
+
+  uint32_t capacity() const
+  {
+    return capacity_;
+  }
+
+private:
+
+  uint32_t capacity_;
+  uint64_t mask_;
+
+  std::unique_ptr<std::atomic<Data*>[]> slots_;
+
+  // kept on separate cache lines so producer and consumer don't contend
+  alignas(64) std::atomic<uint64_t> head_;
+  alignas(64) std::atomic<uint64_t> tail_;
+};
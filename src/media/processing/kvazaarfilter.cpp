@@ -2,10 +2,15 @@
 
 #include "statisticsinterface.h"
 
+#include "media/resourceallocator.h"
+
 #include "settingskeys.h"
+#include "common.h"
+#include "global.h"
 #include "logger.h"
 
 #include <kvazaar.h>
+#include <libyuv.h>
 
 #include <QtDebug>
 #include <QTime>
@@ -13,18 +18,55 @@
 
 enum RETURN_STATUS {C_SUCCESS = 0, C_FAILURE = -1};
 
+// Changing the bitrate replaces the encoder at its next intra frame, so small
+// changes are ignored and the rate control is given time to settle between
+// changes.
+const float BITRATE_CHANGE_THRESHOLD = 0.15f;
+const std::chrono::milliseconds MIN_BITRATE_CHANGE_INTERVAL = std::chrono::milliseconds(2000);
+
 KvazaarFilter::KvazaarFilter(QString id, StatisticsInterface *stats,
-                             std::shared_ptr<ResourceAllocator> hwResources):
+                             std::shared_ptr<ResourceAllocator> hwResources,
+                             unsigned int layer):
   Filter(id, "Kvazaar", stats, hwResources, DT_YUV420VIDEO, DT_HEVCVIDEO),
   api_(nullptr),
   config_(nullptr),
   enc_(nullptr),
   pts_(0),
+  framesEncoded_(0),
+  layer_(layer),
+  temporalLayering_(true),
+  keyframeRequests_(0),
+  configuredBitrate_(0),
+  lastBitrateChange_(),
+  builderMutex_(),
+  builderCondition_(),
+  builderJobs_(),
+  builder_(),
+  stopBuilder_(false),
+  encoderBuilds_(0),
+  pendingMutex_(),
+  pendingConfig_(nullptr),
+  pendingEncoder_(nullptr),
+  pendingBitrate_(0),
+  pendingBitrateOnly_(false),
+  standbyConfig_(nullptr),
+  standbyEncoder_(nullptr),
+  standbyEnabled_(false),
+  picturePool_(nullptr),
   encodingFrames_(),
   inputPics_(),
   nextInputPic_(-1)
 {
-  maxBufferSize_ = 3;
+  // encoding is the slowest part, so only a few frames are buffered to keep latency low
+  setBackpressurePolicy(std::make_shared<DropOldestPolicy>(100));
+}
+
+
+KvazaarFilter::~KvazaarFilter()
+{
+  stopBuilder();
+  discardPendingEncoder();
+  discardStandbyEncoder();
 }
 
 
@@ -88,205 +130,558 @@ kvz_picture* KvazaarFilter::getNextPic()
 }
 
 
-void KvazaarFilter::updateSettings()
+std::shared_ptr<Filter::BufferSource> KvazaarFilter::pictureSource()
 {
-  Logger::getLogger()->printNormal(this, "Updating kvazaar settings");
-
-  stop();
-
-  while(isRunning())
+  // the filters may outlive the encoder
+  std::weak_ptr<KvazaarPicturePool> pool = picturePool_;
+  return std::make_shared<BufferSource>([pool](DataType type, uint32_t size)
   {
-    sleep(1);
-  }
+    if (std::shared_ptr<KvazaarPicturePool> pictures = pool.lock())
+    {
+      return pictures->allocate(type, size);
+    }
+    return std::shared_ptr<uchar[]>(nullptr);
+  });
+}
+
 
-  close();
+void KvazaarFilter::updateSettings()
+{
+  Logger::getLogger()->printNormal(this, "Updating kvazaar settings");
 
-  settingsMutex_.lock();
-  if(init())
+  if (!api_)
   {
-    Logger::getLogger()->printNormal(this, "Resolution change successful");
+    settingsMutex_.lock();
+    init();
+    settingsMutex_.unlock();
   }
   else
   {
-    Logger::getLogger()->printNormal(this, "Failed to change resolution");
-  }
-  encodingFrames_.clear();
-  settingsMutex_.unlock();
+    // a disabled standby encoder is closed by the builder
+    standbyEnabled_ = settingEnabled(SettingsKey::videoStandbyEncoder);
+    if (!standbyEnabled_)
+    {
+      buildStandbyEncoder();
+    }
 
-  start();
+    // the current encoder keeps encoding until the new one is ready
+    buildEncoder();
+  }
 
   Filter::updateSettings();
 }
 
 
-bool KvazaarFilter::init()
+kvz_encoder* KvazaarFilter::openEncoder(kvz_config*& config, int& configuredBitrate)
 {
-  Logger::getLogger()->printNormal(this, "Iniating Kvazaar");
+  config = createConfig(configuredBitrate);
+  if (!config)
+  {
+    return nullptr;
+  }
 
-  // input picture should not exist at this point
-  if(inputPics_.empty() && !api_)
+  kvz_encoder* encoder = api_->encoder_open(config);
+  if (!encoder)
   {
-    QSettings settings(settingsFile, settingsFileFormat);
-    
-    if (settings.value(SettingsKey::videoResolutionWidth).toInt() == 0 ||
-        settings.value(SettingsKey::videoResolutionHeight).toInt() == 0 ||
-        settings.value(SettingsKey::videoFramerateNumerator).toInt() == 0 ||
-        settings.value(SettingsKey::videoFramerateDenominator).toInt() == 0)
-    {
-      Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this, "Invalid values in settings",
-                                      {"Width", "Height", "Framerate Numerator", "Framerate Denominator"},
-                                        {settings.value(SettingsKey::videoResolutionWidth).toString(),
-                                       settings.value(SettingsKey::videoResolutionHeight).toString(),
-                                       settings.value(SettingsKey::videoFramerateNumerator).toString(),
-                                       settings.value(SettingsKey::videoFramerateDenominator).toString()});
-      return false;
-    }
+    api_->config_destroy(config);
+    config = nullptr;
+  }
 
-    api_ = kvz_api_get(8);
-    if(!api_)
-    {
-      Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this, "Failed to retrieve Kvazaar API.");
-      return false;
-    }
-    config_ = api_->config_alloc();
-    enc_ = nullptr;
+  return encoder;
+}
 
-    if(!config_)
-    {
-      Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this, "Failed to allocate Kvazaar config.");
-      return false;
-    }
 
-    api_->config_init(config_);
+void KvazaarFilter::startBuilder()
+{
+  builderMutex_.lock();
+  if (!builder_.joinable())
+  {
+    stopBuilder_ = false;
+    builder_ = std::thread(&KvazaarFilter::runBuilder, this);
+  }
+  builderMutex_.unlock();
+}
+
 
-    QString preset = settings.value(SettingsKey::videoPreset).toString().toUtf8();
-    
-    QString resolutionStr = settings.value(SettingsKey::videoResolutionWidth).toString() + "x" +
-        settings.value(SettingsKey::videoResolutionHeight).toString();
+void KvazaarFilter::stopBuilder()
+{
+  builderMutex_.lock();
+  stopBuilder_ = true;
+  builderCondition_.wakeAll();
+  builderMutex_.unlock();
 
-    QString framerate = QString::number(settings.value(SettingsKey::videoFramerateNumerator).toInt()) + "/" +
-                        QString::number(settings.value(SettingsKey::videoFramerateDenominator).toInt());
+  if (builder_.joinable())
+  {
+    builder_.join();
+  }
+}
 
-    // Input
 
-    api_->config_parse(config_, "preset",    preset.toLocal8Bit());
-    api_->config_parse(config_, "input-res", resolutionStr.toLocal8Bit());
-    api_->config_parse(config_, "input-fps", framerate.toLocal8Bit());
+void KvazaarFilter::queueBuilderJob(BuilderJob job)
+{
+  builderMutex_.lock();
 
-    QString threads = "0";
+  if (!builder_.joinable() || stopBuilder_)
+  {
+    builderMutex_.unlock();
+    closeEncoder(job.retiredEncoder, job.retiredConfig);
+    return;
+  }
 
-    // parallelization
-    if (settings.value(SettingsKey::videoKvzThreads) == "auto")
-    {
-      threads = QString::number(QThread::idealThreadCount());
-    }
-    else if (settings.value(SettingsKey::videoKvzThreads) == "Main")
-    {
-      threads = QString::number(0);
-    }
-    else
+  // only the latest settings matter
+  if (!job.standby)
+  {
+    for (auto queued = builderJobs_.begin(); queued != builderJobs_.end();)
     {
-      threads = settings.value(SettingsKey::videoKvzThreads).toString();
+      if (!queued->standby)
+      {
+        job.bitrateOnly = job.bitrateOnly && queued->bitrateOnly;
+        queued = builderJobs_.erase(queued);
+        --encoderBuilds_;
+      }
+      else
+      {
+        ++queued;
+      }
     }
+    ++encoderBuilds_;
+  }
 
-    api_->config_parse(config_, "threads", threads.toLocal8Bit());
-    api_->config_parse(config_, "owf", settings.value(SettingsKey::videoOWF).toString().toLocal8Bit());
-    api_->config_parse(config_, "wpp", settings.value(SettingsKey::videoWPP).toString().toLocal8Bit());
+  builderJobs_.push_back(job);
+  builderCondition_.wakeAll();
+  builderMutex_.unlock();
+}
 
-    bool tiles = settings.value(SettingsKey::videoTiles).toBool();
 
-    if (tiles)
+void KvazaarFilter::runBuilder()
+{
+  builderMutex_.lock();
+  while (!stopBuilder_ || !builderJobs_.empty())
+  {
+    if (builderJobs_.empty())
     {
-      std::string dimensions = settings.value(SettingsKey::videoTileDimensions).toString().toStdString();
-      api_->config_parse(config_, "tiles", dimensions.c_str());
+      builderCondition_.wait(&builderMutex_);
+      continue;
     }
 
-    // this does not work with uvgRTP at the moment. Avoid using slices.
-    if(settings.value(SettingsKey::videoSlices).toInt() == 1)
+    BuilderJob job = builderJobs_.front();
+    builderJobs_.pop_front();
+    bool stopping = stopBuilder_;
+    builderMutex_.unlock();
+
+    closeEncoder(job.retiredEncoder, job.retiredConfig);
+
+    if (job.standby)
     {
-      if(config_->wpp)
+      // the previous standby encoder may have old settings
+      discardStandbyEncoder();
+
+      if (!stopping && standbyEnabled_)
       {
-        api_->config_parse(config_, "slices", "wpp");
+        int configuredBitrate = 0;
+        kvz_config* config = nullptr;
+        kvz_encoder* encoder = openEncoder(config, configuredBitrate);
+
+        if (encoder)
+        {
+          pendingMutex_.lock();
+          standbyConfig_ = config;
+          standbyEncoder_ = encoder;
+          pendingMutex_.unlock();
+        }
+        else
+        {
+          Logger::getLogger()->printWarning(this, "Failed to open standby Kvazaar encoder, "
+                                                  "intra frames are only sent periodically");
+        }
       }
-      else if (tiles)
+    }
+    else
+    {
+      discardPendingEncoder();
+
+      if (!stopping)
       {
-        api_->config_parse(config_, "slices", "tiles");
+        int configuredBitrate = 0;
+        kvz_config* config = nullptr;
+        kvz_encoder* encoder = openEncoder(config, configuredBitrate);
+
+        if (encoder)
+        {
+          pendingMutex_.lock();
+          pendingConfig_ = config;
+          pendingEncoder_ = encoder;
+          pendingBitrate_ = configuredBitrate;
+          pendingBitrateOnly_ = job.bitrateOnly;
+          pendingMutex_.unlock();
+
+          Logger::getLogger()->printNormal(this, "New Kvazaar encoder is ready");
+        }
+        else
+        {
+          Logger::getLogger()->printError(this, "Failed to open new Kvazaar encoder, "
+                                                "keeping the current one");
+        }
       }
+
+      --encoderBuilds_;
     }
 
-    // Video structure
+    builderMutex_.lock();
+  }
+  builderMutex_.unlock();
+}
 
-    api_->config_parse(config_, "qp",         settings.value(SettingsKey::videoQP).toString().toLocal8Bit());
-    api_->config_parse(config_, "period",     settings.value(SettingsKey::videoIntra).toString().toLocal8Bit());
-    api_->config_parse(config_, "vps-period", settings.value(SettingsKey::videoVPS).toString().toLocal8Bit());
 
-    config_->target_bitrate = settings.value(SettingsKey::videoBitrate).toInt();
+void KvazaarFilter::buildEncoder(bool bitrateOnly)
+{
+  queueBuilderJob({false, bitrateOnly, nullptr, nullptr});
+}
 
-    if (config_->target_bitrate != 0)
-    {
-      api_->config_parse(config_, "rc-algorithm",    settings.value(SettingsKey::videoRCAlgorithm).toString().toLocal8Bit());
-    }
 
-    api_->config_parse(config_, "intra-bits", "");
+void KvazaarFilter::buildStandbyEncoder(kvz_encoder* retiredEncoder,
+                                        kvz_config* retiredConfig)
+{
+  queueBuilderJob({true, false, retiredEncoder, retiredConfig});
+}
 
-    // TODO: Move to settings
-    api_->config_parse(config_, "gop", "lp-g4d3t1");
 
-    if (settings.value(SettingsKey::videoScalingList).toInt() == 0)
-    {
-      api_->config_parse(config_, "scaling-list", "off");
-    }
-    else
-    {
-      api_->config_parse(config_, "scaling-list", "default");
-    }
+void KvazaarFilter::discardPendingEncoder()
+{
+  pendingMutex_.lock();
+  kvz_encoder* encoder = pendingEncoder_;
+  kvz_config* config = pendingConfig_;
+  pendingEncoder_ = nullptr;
+  pendingConfig_ = nullptr;
+  pendingMutex_.unlock();
+
+  // closing is not done under the lock the filter thread uses
+  closeEncoder(encoder, config);
+}
 
-    config_->lossless = settings.value(SettingsKey::videoLossless).toInt();
 
-    QString constraint = settings.value(SettingsKey::videoMVConstraint).toString();
+void KvazaarFilter::discardStandbyEncoder()
+{
+  pendingMutex_.lock();
+  kvz_encoder* encoder = standbyEncoder_;
+  kvz_config* config = standbyConfig_;
+  standbyEncoder_ = nullptr;
+  standbyConfig_ = nullptr;
+  pendingMutex_.unlock();
+
+  closeEncoder(encoder, config);
+}
 
-    if (constraint == "frame" || constraint == "frametile" || constraint == "frametilemargin")
-    {
-      api_->config_parse(config_, "mv-constraint", "");
-    }
-    else
-    {
-      api_->config_parse(config_, "mv-constraint", "none");
-    }
 
-    if (constraint == "frame")
-    {
-      config_->mv_constraint = KVZ_MV_CONSTRAIN_FRAME;
-    }
-    else if (constraint == "tile")
-    {
-      config_->mv_constraint = KVZ_MV_CONSTRAIN_TILE;
-    }
-    else if (constraint == "frametile")
-    {
-      config_->mv_constraint = KVZ_MV_CONSTRAIN_FRAME_AND_TILE;
-    }
-    else if (constraint == "frametilemargin")
+void KvazaarFilter::closeEncoder(kvz_encoder* encoder, kvz_config* config)
+{
+  if (api_ && encoder)
+  {
+    api_->encoder_close(encoder);
+  }
+  if (api_ && config)
+  {
+    api_->config_destroy(config);
+  }
+}
+
+
+bool KvazaarFilter::switchEncoder(const Data& input)
+{
+  pendingMutex_.lock();
+
+  // the new encoder is only taken into use once the input matches it, so
+  // the old one keeps encoding until for example the camera has changed
+  // its resolution
+  if (!pendingEncoder_ ||
+      pendingConfig_->width != input.vInfo->width ||
+      pendingConfig_->height != input.vInfo->height ||
+      pendingConfig_->framerate_num != input.vInfo->framerateNumerator ||
+      pendingConfig_->framerate_denom != input.vInfo->framerateDenominator)
+  {
+    pendingMutex_.unlock();
+    return false;
+  }
+
+  // A new encoder starts with an IDR frame, which would be sent just when
+  // the network is congested. A new bitrate therefore waits for the intra
+  // frame the current encoder would encode anyway.
+  if (pendingBitrateOnly_ && enc_ && config_->intra_period > 0 &&
+      framesEncoded_ % config_->intra_period != 0)
+  {
+    pendingMutex_.unlock();
+    return false;
+  }
+
+  kvz_config* config = pendingConfig_;
+  kvz_encoder* encoder = pendingEncoder_;
+  int configuredBitrate = pendingBitrate_;
+
+  pendingConfig_ = nullptr;
+  pendingEncoder_ = nullptr;
+  pendingMutex_.unlock();
+
+  // The old encoder finishes its frames first so that the new one starts
+  // cleanly with parameter sets and an IDR frame.
+  if (enc_)
+  {
+    flushEncoder();
+  }
+
+  kvz_encoder* previousEncoder = enc_;
+  kvz_config* previousConfig = config_;
+  takeEncoder(config, encoder, configuredBitrate);
+
+  // the new encoder starts with an intra frame
+  keyframeRequests_ = getHWManager()->getKeyframeRequests(layer_);
+
+  lastBitrateChange_ = std::chrono::steady_clock::now();
+
+  // the standby encoder has the previous settings
+  buildStandbyEncoder(previousEncoder, previousConfig);
+
+  Logger::getLogger()->printNormal(this, "Switched to new Kvazaar encoder",
+                                   {"Resolution", "Bitrate"},
+                                   {QString::number(config_->width) + "x" +
+                                    QString::number(config_->height),
+                                    QString::number(config_->target_bitrate)});
+  return true;
+}
+
+
+void KvazaarFilter::takeEncoder(kvz_config* config, kvz_encoder* encoder, int configuredBitrate)
+{
+  bool sizeChanged = inputPics_.empty() || !config_ ||
+      config->width != config_->width || config->height != config_->height;
+
+  config_ = config;
+  enc_ = encoder;
+  configuredBitrate_ = configuredBitrate;
+  framesEncoded_ = 0;
+
+  if (sizeChanged)
+  {
+    createInputVector(config_->owf + 1);
+    picturePool_->setResolution(config_->width, config_->height);
+  }
+}
+
+
+kvz_config* KvazaarFilter::createConfig(int& configuredBitrate)
+{
+  QSettings settings(settingsFile, settingsFileFormat);
+  
+  if (settings.value(SettingsKey::videoResolutionWidth).toInt() == 0 ||
+      settings.value(SettingsKey::videoResolutionHeight).toInt() == 0 ||
+      settings.value(SettingsKey::videoFramerateNumerator).toInt() == 0 ||
+      settings.value(SettingsKey::videoFramerateDenominator).toInt() == 0)
+  {
+    Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this, "Invalid values in settings",
+                                    {"Width", "Height", "Framerate Numerator", "Framerate Denominator"},
+                                      {settings.value(SettingsKey::videoResolutionWidth).toString(),
+                                     settings.value(SettingsKey::videoResolutionHeight).toString(),
+                                     settings.value(SettingsKey::videoFramerateNumerator).toString(),
+                                     settings.value(SettingsKey::videoFramerateDenominator).toString()});
+    return nullptr;
+  }
+
+  kvz_config* config = api_->config_alloc();
+
+  if(!config)
+  {
+    Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this, "Failed to allocate Kvazaar config.");
+    return nullptr;
+  }
+
+  api_->config_init(config);
+
+  QString preset = settings.value(SettingsKey::videoPreset).toString().toUtf8();
+  
+  QSize resolution = simulcastLayerSize(QSize(settings.value(SettingsKey::videoResolutionWidth).toInt(),
+                                               settings.value(SettingsKey::videoResolutionHeight).toInt()),
+                                         layer_);
+
+  QString resolutionStr = QString::number(resolution.width()) + "x" +
+      QString::number(resolution.height());
+
+  QString framerate = QString::number(settings.value(SettingsKey::videoFramerateNumerator).toInt()) + "/" +
+                      QString::number(settings.value(SettingsKey::videoFramerateDenominator).toInt());
+
+  // Input
+
+  api_->config_parse(config, "preset",    preset.toLocal8Bit());
+  api_->config_parse(config, "input-res", resolutionStr.toLocal8Bit());
+  api_->config_parse(config, "input-fps", framerate.toLocal8Bit());
+
+  QString threads = "0";
+
+  // parallelization
+  if (settings.value(SettingsKey::videoKvzThreads) == "auto")
+  {
+    threads = QString::number(QThread::idealThreadCount());
+  }
+  else if (settings.value(SettingsKey::videoKvzThreads) == "Main")
+  {
+    threads = QString::number(0);
+  }
+  else
+  {
+    threads = settings.value(SettingsKey::videoKvzThreads).toString();
+  }
+
+  api_->config_parse(config, "threads", threads.toLocal8Bit());
+  api_->config_parse(config, "owf", settings.value(SettingsKey::videoOWF).toString().toLocal8Bit());
+  api_->config_parse(config, "wpp", settings.value(SettingsKey::videoWPP).toString().toLocal8Bit());
+
+  bool tiles = settings.value(SettingsKey::videoTiles).toBool();
+
+  if (tiles)
+  {
+    std::string dimensions = settings.value(SettingsKey::videoTileDimensions).toString().toStdString();
+    api_->config_parse(config, "tiles", dimensions.c_str());
+  }
+
+  // Low latency mode. Each WPP row or tile is its own slice NAL unit, but
+  // Kvazaar only returns whole frames and the sender pushes the frame in one
+  // piece, so the slices leave together. The receiver can still decode the
+  // slices that have arrived while the rest of the frame is on its way.
+  // Most of the saving comes from not overlapping frames, since every
+  // overlapped frame delays the output by one frame interval. That costs
+  // encoding speed on many threads, which is why it is only done here.
+  if(settings.value(SettingsKey::videoSlices).toInt() == 1 && (config->wpp || tiles))
+  {
+    api_->config_parse(config, "slices", config->wpp ? "wpp" : "tiles");
+
+    if (config->owf != 0)
     {
-      config_->mv_constraint = KVZ_MV_CONSTRAIN_FRAME_AND_TILE_MARGIN;
+      Logger::getLogger()->printNormal(this, "Low latency mode does not overlap frames",
+                                       "OWF", QString::number(config->owf));
+      api_->config_parse(config, "owf", "0");
     }
-    else
+  }
+
+  // Video structure
+
+  api_->config_parse(config, "qp",         settings.value(SettingsKey::videoQP).toString().toLocal8Bit());
+  api_->config_parse(config, "period",     settings.value(SettingsKey::videoIntra).toString().toLocal8Bit());
+  api_->config_parse(config, "vps-period", settings.value(SettingsKey::videoVPS).toString().toLocal8Bit());
+
+  configuredBitrate = settings.value(SettingsKey::videoBitrate).toInt();
+
+  if (configuredBitrate != 0 && layer_ != 0)
+  {
+    configuredBitrate = getHWManager()->getLayerBitrate(layer_);
+  }
+
+  config->target_bitrate = configuredBitrate;
+
+  if (configuredBitrate != 0 && layer_ == 0)
+  {
+    // the peers may already have reported congestion
+    int adaptiveBitrate = getHWManager()->getBitrate(DT_HEVCVIDEO);
+    if (adaptiveBitrate > 0 && adaptiveBitrate < configuredBitrate)
     {
-      config_->mv_constraint = KVZ_MV_CONSTRAIN_NONE;
+      config->target_bitrate = adaptiveBitrate;
     }
+  }
+
+  if (config->target_bitrate != 0)
+  {
+    api_->config_parse(config, "rc-algorithm",    settings.value(SettingsKey::videoRCAlgorithm).toString().toLocal8Bit());
+  }
+
+  api_->config_parse(config, "intra-bits", "");
+
+  // TODO: Move to settings
+  // Only every TEMPORAL_LAYERS:th frame is used as a reference, so that the
+  // senders can leave out the others when a peer has problems.
+  api_->config_parse(config, "gop",
+                     ("lp-g4d3t" + QString::number(TEMPORAL_LAYERS)).toLocal8Bit());
+
+  if (settings.value(SettingsKey::videoScalingList).toInt() == 0)
+  {
+    api_->config_parse(config, "scaling-list", "off");
+  }
+  else
+  {
+    api_->config_parse(config, "scaling-list", "default");
+  }
 
-    config_->set_qp_in_cu = settings.value(SettingsKey::videoQPInCU).toInt();
+  config->lossless = settings.value(SettingsKey::videoLossless).toInt();
 
-    int vaq = settings.value(SettingsKey::videoVAQ).toInt();
-    if (vaq > 0 && vaq <= 20)
+  QString constraint = settings.value(SettingsKey::videoMVConstraint).toString();
+
+  if (constraint == "frame" || constraint == "frametile" || constraint == "frametilemargin")
+  {
+    api_->config_parse(config, "mv-constraint", "");
+  }
+  else
+  {
+    api_->config_parse(config, "mv-constraint", "none");
+  }
+
+  if (constraint == "frame")
+  {
+    config->mv_constraint = KVZ_MV_CONSTRAIN_FRAME;
+  }
+  else if (constraint == "tile")
+  {
+    config->mv_constraint = KVZ_MV_CONSTRAIN_TILE;
+  }
+  else if (constraint == "frametile")
+  {
+    config->mv_constraint = KVZ_MV_CONSTRAIN_FRAME_AND_TILE;
+  }
+  else if (constraint == "frametilemargin")
+  {
+    config->mv_constraint = KVZ_MV_CONSTRAIN_FRAME_AND_TILE_MARGIN;
+  }
+  else
+  {
+    config->mv_constraint = KVZ_MV_CONSTRAIN_NONE;
+  }
+
+  config->set_qp_in_cu = settings.value(SettingsKey::videoQPInCU).toInt();
+
+  int vaq = settings.value(SettingsKey::videoVAQ).toInt();
+  if (vaq > 0 && vaq <= 20)
+  {
+    api_->config_parse(config, "vaq", settings.value(SettingsKey::videoVAQ).toString().toLocal8Bit());
+  }
+
+  // compression-tab
+  customParameters(settings, config);
+
+  config->hash = KVZ_HASH_NONE;
+
+  return config;
+}
+
+
+bool KvazaarFilter::init()
+{
+  Logger::getLogger()->printNormal(this, "Iniating Kvazaar");
+
+  // input picture should not exist at this point
+  if(inputPics_.empty() && !api_)
+  {
+    api_ = kvz_api_get(8);
+    if(!api_)
     {
-      api_->config_parse(config_, "vaq", settings.value(SettingsKey::videoVAQ).toString().toLocal8Bit());
+      Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this, "Failed to retrieve Kvazaar API.");
+      return false;
     }
 
-    // compression-tab
-    customParameters(settings);
+    enc_ = nullptr;
+    framesEncoded_ = 0;
+    temporalLayering_ = true;
+    keyframeRequests_ = getHWManager()->getKeyframeRequests(layer_);
+    config_ = createConfig(configuredBitrate_);
 
-    config_->hash = KVZ_HASH_NONE;
+    if (!config_)
+    {
+      return false;
+    }
 
     enc_ = api_->encoder_open(config_);
 
@@ -296,6 +691,8 @@ bool KvazaarFilter::init()
       return false;
     }
 
+    lastBitrateChange_ = std::chrono::steady_clock::now();
+
     createInputVector(config_->owf + 1);
 
     if(inputPics_.empty())
@@ -304,6 +701,16 @@ bool KvazaarFilter::init()
       return false;
     }
 
+    if (!picturePool_)
+    {
+      picturePool_ = std::make_shared<KvazaarPicturePool>(api_);
+    }
+    picturePool_->setResolution(config_->width, config_->height);
+
+    standbyEnabled_ = settingEnabled(SettingsKey::videoStandbyEncoder);
+    startBuilder();
+    buildStandbyEncoder();
+
     Logger::getLogger()->printNormal(this, "Kvazaar iniation succeeded");
   }
 
@@ -312,6 +719,10 @@ bool KvazaarFilter::init()
 
 void KvazaarFilter::close()
 {
+  stopBuilder();
+  discardPendingEncoder();
+  discardStandbyEncoder();
+
   if(api_)
   {
     api_->encoder_close(enc_);
@@ -323,6 +734,12 @@ void KvazaarFilter::close()
     api_ = nullptr;
   }
 
+  if (picturePool_)
+  {
+    // pictures still in use are freed when the frames are released
+    picturePool_->setResolution(0, 0);
+  }
+
   pts_ = 0;
 
   Logger::getLogger()->printNormal(this, "Closed Kvazaar");
@@ -334,13 +751,20 @@ void KvazaarFilter::process()
 
   while(input)
   {
+    settingsMutex_.lock();
+    if (!switchEncoder(*input) && !followKeyframeRequests())
+    {
+      adaptBitrate();
+    }
+
     if(inputPics_.empty())
     {
+      settingsMutex_.unlock();
       Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this,  
                                       "Input pictures were not allocated correctly");
       break;
     }
-    settingsMutex_.lock();
+
     feedInput(std::move(input));
     settingsMutex_.unlock();
 
@@ -348,7 +772,149 @@ void KvazaarFilter::process()
   }
 }
 
-void KvazaarFilter::customParameters(QSettings& settings)
+void KvazaarFilter::adaptBitrate()
+{
+  // the encoder being built will use the latest bitrate. The smaller
+  // simulcast layers are for the peers the full layer is too much for.
+  if (configuredBitrate_ == 0 || layer_ != 0 || !enc_ || encoderBuilds_ > 0)
+  {
+    return;
+  }
+
+  // the previous change is waiting for an intra frame
+  pendingMutex_.lock();
+  bool pending = pendingEncoder_ != nullptr;
+  pendingMutex_.unlock();
+
+  if (pending)
+  {
+    return;
+  }
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (now - lastBitrateChange_ < MIN_BITRATE_CHANGE_INTERVAL)
+  {
+    return;
+  }
+
+  int target = getHWManager()->getBitrate(DT_HEVCVIDEO);
+  if (target <= 0 || target > configuredBitrate_)
+  {
+    target = configuredBitrate_;
+  }
+
+  int current = config_->target_bitrate;
+  if (abs(target - current) < current*BITRATE_CHANGE_THRESHOLD)
+  {
+    return;
+  }
+
+  Logger::getLogger()->printNormal(this, "Changing video bitrate",
+                                   {"Previous", "New"},
+                                   {QString::number(current), QString::number(target)});
+
+  lastBitrateChange_ = now;
+
+  // Kvazaar reads the target bitrate only when the encoder is opened
+  buildEncoder(true);
+}
+
+
+bool KvazaarFilter::followKeyframeRequests()
+{
+  uint32_t requests = getHWManager()->getKeyframeRequests(layer_);
+  if (requests == keyframeRequests_ || !enc_)
+  {
+    return false;
+  }
+
+  pendingMutex_.lock();
+
+  // The new encoder starts with an intra frame as well. A new bitrate no
+  // longer has to wait for the intra period.
+  if (pendingEncoder_)
+  {
+    pendingBitrateOnly_ = false;
+    pendingMutex_.unlock();
+    keyframeRequests_ = requests;
+    return true;
+  }
+
+  // the request is served once the new encoder is ready
+  if (encoderBuilds_ > 0)
+  {
+    pendingMutex_.unlock();
+    return false;
+  }
+
+  kvz_config* config = standbyConfig_;
+  kvz_encoder* encoder = standbyEncoder_;
+  standbyConfig_ = nullptr;
+  standbyEncoder_ = nullptr;
+  pendingMutex_.unlock();
+
+  // the request is served once the standby encoder is ready
+  if (!encoder)
+  {
+    // without one, a new encoder is opened for the request
+    if (!standbyEnabled_)
+    {
+      buildEncoder();
+    }
+    return false;
+  }
+
+  if (config->width != config_->width || config->height != config_->height ||
+      config->framerate_num != config_->framerate_num ||
+      config->framerate_denom != config_->framerate_denom)
+  {
+    buildStandbyEncoder(encoder, config);
+    return false;
+  }
+
+  keyframeRequests_ = requests;
+
+  // the frames inside the current encoder are sent before the intra frame
+  flushEncoder();
+
+  kvz_encoder* retiredEncoder = enc_;
+  kvz_config* retiredConfig = config_;
+  takeEncoder(config, encoder, configuredBitrate_);
+  buildStandbyEncoder(retiredEncoder, retiredConfig);
+
+  Logger::getLogger()->printNormal(this, "Switched to standby encoder for an intra frame");
+  return true;
+}
+
+
+void KvazaarFilter::flushEncoder()
+{
+  kvz_picture *recon_pic = nullptr;
+  kvz_frame_info frame_info;
+  kvz_data_chunk *data_out = nullptr;
+  uint32_t len_out = 0;
+
+  while (!encodingFrames_.empty())
+  {
+    api_->encoder_encode(enc_, nullptr,
+                         &data_out, &len_out,
+                         &recon_pic, nullptr,
+                         &frame_info );
+
+    if (data_out == nullptr)
+    {
+      break;
+    }
+
+    parseEncodedFrame(data_out, len_out, recon_pic, frame_info);
+  }
+
+  // frames kvazaar did not return are lost
+  encodingFrames_.clear();
+}
+
+
+void KvazaarFilter::customParameters(QSettings& settings, kvz_config* config)
 {
   int size = settings.beginReadArray(SettingsKey::videoCustomParameters);
 
@@ -360,7 +926,7 @@ void KvazaarFilter::customParameters(QSettings& settings)
     settings.setArrayIndex(i);
     QString name = settings.value("Name").toString();
     QString value = settings.value("Value").toString();
-    if (api_->config_parse(config_, name.toStdString().c_str(),
+    if (api_->config_parse(config, name.toStdString().c_str(),
                            value.toStdString().c_str()) != 1)
     {
       Logger::getLogger()->printWarning(this, "Invalid custom parameter for kvazaar",
@@ -378,13 +944,20 @@ void KvazaarFilter::feedInput(std::unique_ptr<Data> input)
   kvz_data_chunk *data_out = nullptr;
   uint32_t len_out = 0;
 
+  if (!enc_)
+  {
+    Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this, "No encoder for input");
+    return;
+  }
+
   if (config_->width != input->vInfo->width
       || config_->height != input->vInfo->height
       || config_->framerate_num != input->vInfo->framerateNumerator
       || config_->framerate_denom != input->vInfo->framerateDenominator)
   {
-    // This should not happen.
-    Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this,
+    // Can happen briefly after a settings change while the new encoder is
+    // not ready or the camera has not yet changed its resolution.
+    Logger::getLogger()->printDebug(DEBUG_WARNING, this,
                                     "Input resolution or framerate differs from settings",
                                     {"Settings", "Input"},
                                     {QString::number(config_->width) + "x" +
@@ -398,39 +971,70 @@ void KvazaarFilter::feedInput(std::unique_ptr<Data> input)
     return;
   }
 
-  if (nextInputPic_ == -1 || nextInputPic_ >= inputPics_.size())
+  // the frame may have been written directly to an input picture
+  kvz_picture* inputPic = nullptr;
+  if (picturePool_ && isPackedVideo(input.get()))
   {
-    Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this, "Input vec initilized incorrectly");
-    return;
+    inputPic = picturePool_->findPicture(input->data.get());
+
+    if (inputPic != nullptr &&
+        (inputPic->width != config_->width || inputPic->height != config_->height))
+    {
+      inputPic = nullptr;
+    }
   }
 
-  kvz_picture* inputPic = getNextPic();
+  if (inputPic == nullptr)
+  {
+    if (nextInputPic_ == -1 || nextInputPic_ >= inputPics_.size())
+    {
+      Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this, "Input vec initilized incorrectly");
+      return;
+    }
+
+    inputPic = getNextPic();
+
+    // Copy input to kvazaar picture. The planes are read with their own
+    // strides so padded frames do not have to be packed first.
+    kvz_pixel* destinations[3] = {inputPic->y, inputPic->u, inputPic->v};
+    for (unsigned int plane = 0; plane < 3; ++plane)
+    {
+      uint32_t rowBytes = 0;
+      uint32_t rows = 0;
+      videoPlaneSize(DT_YUV420VIDEO, input->vInfo->width, input->vInfo->height,
+                     plane, rowBytes, rows);
+
+      uint32_t stride = 0;
+      uint8_t* source = videoPlane(input.get(), plane, stride);
+      int destinationStride = plane == 0 ? inputPic->stride : inputPic->stride/2;
 
-  // copy input to kvazaar picture
-  memcpy(inputPic->y,
-         input->data.get(),
-         input->vInfo->width*input->vInfo->height);
-  memcpy(inputPic->u,
-         &(input->data.get()[input->vInfo->width*input->vInfo->height]),
-         input->vInfo->width*input->vInfo->height/4);
-  memcpy(inputPic->v,
-         &(input->data.get()[input->vInfo->width*input->vInfo->height + input->vInfo->width*input->vInfo->height/4]),
-         input->vInfo->width*input->vInfo->height/4);
+      libyuv::CopyPlane(source, stride, destinations[plane], destinationStride, rowBytes, rows);
+    }
+  }
 
   inputPic->pts = pts_;
   ++pts_;
+  ++framesEncoded_;
 
-  if (config_->target_bitrate == 0)
+  // the map is made for the full resolution
+  if (config_->target_bitrate == 0 && layer_ == 0)
   {
     // can also be empty by default
     inputPic->roi.width = input->vInfo->roiWidth;
     inputPic->roi.height = input->vInfo->roiHeight;
 
-    // needs to be deleted later
-    inputPic->roi.roi_array = input->vInfo->roiArray.release();
+    // the input keeps the shared map alive until the frame has been encoded
+    inputPic->roi.roi_array = input->vInfo->roiArray.get();
+  }
+  else
+  {
+    // the picture may have had a map last time it was used
+    inputPic->roi.width = 0;
+    inputPic->roi.height = 0;
+    inputPic->roi.roi_array = nullptr;
   }
 
-  encodingFrames_.push_front({std::move(input), inputPic->roi.roi_array});
+  encodingFrames_.push_front(std::move(input));
 
   api_->encoder_encode(enc_, inputPic,
                        &data_out, &len_out,
@@ -439,7 +1043,7 @@ void KvazaarFilter::feedInput(std::unique_ptr<Data> input)
 
   while(data_out != nullptr)
   {
-    parseEncodedFrame(data_out, len_out, recon_pic);
+    parseEncodedFrame(data_out, len_out, recon_pic, frame_info);
 
     // see if there is more output ready
     api_->encoder_encode(enc_, nullptr,
@@ -451,45 +1055,139 @@ void KvazaarFilter::feedInput(std::unique_ptr<Data> input)
 
 
 void KvazaarFilter::parseEncodedFrame(kvz_data_chunk *data_out,
-                                      uint32_t len_out, kvz_picture *recon_pic)
+                                      uint32_t len_out, kvz_picture *recon_pic,
+                                      const kvz_frame_info& info)
 {
-  FrameInfo info = std::move(encodingFrames_.back());
+  std::unique_ptr<Data> input = std::move(encodingFrames_.back());
   encodingFrames_.pop_back();
 
-  if (info.roi_array)
-  {
-    delete info.roi_array;
-    info.roi_array = nullptr;
-  }
-
-  std::unique_ptr<uchar[]> hevc_frame(new uchar[len_out]);
+  std::shared_ptr<uchar[]> hevc_frame = getDataBuffer(DT_HEVCVIDEO, len_out);
   uint8_t* writer = hevc_frame.get();
   uint32_t dataWritten = 0;
 
+  std::shared_ptr<std::vector<NalUnit>> nalUnits = std::make_shared<std::vector<NalUnit>>();
+  uint32_t searched = 0;
+
+  // Kvazaar writes the bitstream to small fixed size chunks which NAL units
+  // cross, and uvgRTP needs each NAL unit in one piece, so they are gathered
+  // to one buffer. Each chunk is searched for NAL units right after it has
+  // been copied, so the frame is only read once.
   for (kvz_data_chunk *chunk = data_out; chunk != nullptr; chunk = chunk->next)
   {
     memcpy(writer, chunk->data, chunk->len);
     writer += chunk->len;
     dataWritten += chunk->len;
+    findNalUnits(hevc_frame.get(), dataWritten, searched, *nalUnits);
   }
   api_->chunk_free(data_out);
   api_->picture_free(recon_pic);
 
-  uint32_t delay = QDateTime::currentMSecsSinceEpoch() - info.data->presentationTime;
+  if (!nalUnits->empty())
+  {
+    nalUnits->back().size = dataWritten - nalUnits->back().offset;
+    input->vInfo->nalUnits = nalUnits;
+  }
+  else
+  {
+    Logger::getLogger()->printDebug(DEBUG_PROGRAM_WARNING, this, "No NAL units in encoded frame");
+  }
+  input->vInfo->temporalLayer = temporalLayer(info);
+
+  uint32_t delay = QDateTime::currentMSecsSinceEpoch() - input->presentationTime;
   getStats()->sendDelay("video", delay);
   getStats()->addEncodedPacket("video", len_out);
 
+  // kvazaar no longer needs the map
+  input->vInfo->roiArray = nullptr;
+
   // send last packet reusing input structure
-  sendEncodedFrame(std::move(info.data), std::move(hevc_frame), dataWritten);
+
+  sendEncodedFrame(std::move(input), std::move(hevc_frame), dataWritten);
+}
+
+
+uint8_t KvazaarFilter::temporalLayer(const kvz_frame_info& info)
+{
+  // Kvazaar does not mark sub-layers in the bitstream, so the layer comes from
+  // the picture order. A frame referencing a higher layer would mean that the
+  // senders break the decoding when they leave frames out.
+  for (unsigned int list = 0; list < 2 && temporalLayering_; ++list)
+  {
+    for (int i = 0; i < info.ref_list_len[list]; ++i)
+    {
+      if (info.ref_list[list][i] % TEMPORAL_LAYERS != 0)
+      {
+        Logger::getLogger()->printWarning(this, "Encoder references a frame of a higher "
+                                                "temporal layer, no longer marking layers",
+                                          {"POC", "Reference"},
+                                          {QString::number(info.poc),
+                                           QString::number(info.ref_list[list][i])});
+        temporalLayering_ = false;
+        break;
+      }
+    }
+  }
+
+  if (!temporalLayering_ || info.poc % TEMPORAL_LAYERS == 0)
+  {
+    return 0;
+  }
+
+  return 1;
+}
+
+
+void KvazaarFilter::findNalUnits(const uint8_t* frame, uint32_t size, uint32_t& searched,
+                                 std::vector<NalUnit>& nalUnits) const
+{
+  // Kvazaar starts every NAL unit with a start code and emulation prevention
+  // guarantees that the sequence does not appear inside them. The zero byte
+  // before a four byte start code belongs to the start code.
+  const uint8_t* end = frame + size;
+  const uint8_t* position = frame + searched;
+  while (end - position >= 3)
+  {
+    const uint8_t* one = (const uint8_t*)memchr(position + 2, 1, end - position - 2);
+    if (one == nullptr)
+    {
+      // the start code may continue in the next part of the frame
+      position = end - 2;
+      break;
+    }
+
+    if (one[-1] != 0 || one[-2] != 0)
+    {
+      position = one - 1;
+      continue;
+    }
+
+    const uint8_t* startCode = one - 2;
+    if (startCode > frame && startCode[-1] == 0)
+    {
+      --startCode;
+    }
+
+    if (!nalUnits.empty())
+    {
+      NalUnit& previous = nalUnits.back();
+      previous.size = (uint32_t)(startCode - frame) - previous.offset;
+    }
+
+    nalUnits.push_back({(uint32_t)(one + 1 - frame), 0});
+    position = one + 1;
+  }
+
+  searched = (uint32_t)(position - frame);
 }
 
 
 void KvazaarFilter::sendEncodedFrame(std::unique_ptr<Data> input,
-                                     std::unique_ptr<uchar[]> hevc_frame,
+                                     std::shared_ptr<uchar[]> hevc_frame,
                                      uint32_t dataWritten)
 {
   input->type = DT_HEVCVIDEO;
   input->data_size = dataWritten;
   input->data = std::move(hevc_frame);
+  input->vInfo->spatialLayer = layer_;
   sendOutput(std::move(input));
 }
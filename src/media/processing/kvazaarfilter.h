@@ -1,43 +1,132 @@
 #pragma once
 #include "filter.h"
+#include "kvazaarpicturepool.h"
 
 #include <QSize>
 #include <QSettings>
 
+#include <QWaitCondition>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <thread>
+
 struct kvz_api;
 struct kvz_config;
 struct kvz_encoder;
 struct kvz_picture;
 struct kvz_data_chunk;
+struct kvz_frame_info;
 
 class KvazaarFilter : public Filter
 {
 public:
+  // Layers above zero encode a simulcast layer at a fraction of the
+  // resolution in settings and do not follow the network bitrate.
   KvazaarFilter(QString id, StatisticsInterface* stats,
-                std::shared_ptr<ResourceAllocator> hwResources);
+                std::shared_ptr<ResourceAllocator> hwResources,
+                unsigned int layer = 0);
+  ~KvazaarFilter();
 
+  // Opens an encoder with the new settings in the background. Encoding
+  // continues with the current encoder until the new one is ready.
   virtual void updateSettings();
 
   virtual bool init();
 
   void close();
 
+  // Input pictures of the encoder for the filters before it to write their
+  // output to. Frames in these pictures are encoded without copying.
+  std::shared_ptr<BufferSource> pictureSource();
+
 protected:
   virtual void process();
 
 private:
 
-  void customParameters(QSettings& settings);
+  // a kvazaar configuration from the current settings, nullptr if invalid
+  kvz_config* createConfig(int& configuredBitrate);
+
+  void customParameters(QSettings& settings, kvz_config* config);
+
+  // opens an encoder with the current settings, nullptr if it failed
+  kvz_encoder* openEncoder(kvz_config*& config, int& configuredBitrate);
+
+  // Opening and closing an encoder waits for its threads, so it is done by
+  // the builder thread. The filter thread only queues the work.
+  struct BuilderJob
+  {
+    bool standby;
+    bool bitrateOnly;
+
+    // closed before anything is opened
+    kvz_encoder* retiredEncoder;
+    kvz_config* retiredConfig;
+  };
+
+  void startBuilder();
+
+  // finishes the job being done and closes the retired encoders of the rest
+  void stopBuilder();
+
+  void queueBuilderJob(BuilderJob job);
+  void runBuilder();
+
+  // Queues opening a new encoder. An encoder that only changes the bitrate
+  // replaces the current one at its next intra frame.
+  void buildEncoder(bool bitrateOnly = false);
+  void discardPendingEncoder();
+
+  // Queues closing the retired encoder and opening a spare encoder for intra
+  // frames, if the standby encoder is enabled.
+  void buildStandbyEncoder(kvz_encoder* retiredEncoder = nullptr,
+                           kvz_config* retiredConfig = nullptr);
+  void discardStandbyEncoder();
+
+  void closeEncoder(kvz_encoder* encoder, kvz_config* config);
+
+  // replaces the encoder with the one that was built if the input fits it
+  // and the current encoder is at an intra frame when only the bitrate changes
+  bool switchEncoder(const Data& input);
+
+  // starts using the encoder, the caller takes care of the previous one
+  void takeEncoder(kvz_config* config, kvz_encoder* encoder, int configuredBitrate);
 
   // copy the frame data to kvazaar input in suitable format.
   void feedInput(std::unique_ptr<Data> input);
 
+  // Follows the bitrate the resource allocator has computed from RTCP
+  // reports. The configured bitrate is used as the upper limit.
+  void adaptBitrate();
+
+  // Switches to the standby encoder, or opens a new one if it is disabled,
+  // if a peer receiving this layer has asked for an intra frame since the
+  // last time. Returns whether there was a
+  // request that has been served.
+  bool followKeyframeRequests();
+
+  // encodes the frames still inside kvazaar and sends them forward
+  void flushEncoder();
+
   // parse the encoded frame and send it forward.
   void parseEncodedFrame(kvz_data_chunk *data_out, uint32_t len_out,
-                         kvz_picture *recon_pic);
+                         kvz_picture *recon_pic, const kvz_frame_info& info);
+
+  // the temporal layer of the frame, always zero if the references do not
+  // follow the GOP structure we expect
+  uint8_t temporalLayer(const kvz_frame_info& info);
+
+  // Adds the NAL units starting after searched in the first size bytes of an
+  // Annex B frame and ends the previous one at each start code. Called again
+  // with a larger size as more of the frame is written. The size of the
+  // last NAL unit is left for the caller to set.
+  void findNalUnits(const uint8_t* frame, uint32_t size, uint32_t& searched,
+                    std::vector<NalUnit>& nalUnits) const;
 
   void sendEncodedFrame(std::unique_ptr<Data> input,
-                        std::unique_ptr<uchar[]> hevc_frame,
+                        std::shared_ptr<uchar[]> hevc_frame,
                         uint32_t dataWritten);
 
   void createInputVector(int size);
@@ -53,17 +142,52 @@ private:
 
   int64_t pts_;
 
-  // filter has only one thread, so no need to lock the usage of input pics
+  // frames given to the current encoder
+  uint32_t framesEncoded_;
+
+  unsigned int layer_;
+
+  bool temporalLayering_;
+
+  uint32_t keyframeRequests_;
+
+  // bitrate from settings, zero if rate control is not used
+  int configuredBitrate_;
+  std::chrono::steady_clock::time_point lastBitrateChange_;
+
+  QMutex builderMutex_;
+  QWaitCondition builderCondition_;
+  std::deque<BuilderJob> builderJobs_;
+  std::thread builder_;
+  bool stopBuilder_;
+
+  // encoders with new settings queued or being opened
+  std::atomic<int> encoderBuilds_;
+
+  // encoder waiting to replace the current one
+  QMutex pendingMutex_;
+  kvz_config* pendingConfig_;
+  kvz_encoder* pendingEncoder_;
+  int pendingBitrate_;
+  bool pendingBitrateOnly_;
+
+  // Kvazaar cannot be told to encode an intra frame, but a new encoder starts
+  // with one. This encoder has the same settings and is kept open so that it
+  // can replace the current one as soon as a peer asks for an intra frame.
+  kvz_config* standbyConfig_;
+  kvz_encoder* standbyEncoder_;
+  std::atomic<bool> standbyEnabled_;
+
+  // pictures the previous filters have written the frames to
+  std::shared_ptr<KvazaarPicturePool> picturePool_;
+
+  // Used for frames which are not in pool pictures. Filter has only one
+  // thread, so no need to lock the usage of input pics
   std::vector<kvz_picture*> inputPics_;
   int nextInputPic_;
 
   QMutex settingsMutex_;
-  struct FrameInfo
-  {
-    std::unique_ptr<Data> data;
-    int8_t * roi_array;
-  };
-
-  // temporarily store frame data during encoding
-  std::deque<FrameInfo> encodingFrames_;
+  // Temporarily store frame data during encoding. This also keeps the RoI
+  // map and the pool picture alive while kvazaar uses them.
+  std::deque<std::unique_ptr<Data>> encodingFrames_;
 };
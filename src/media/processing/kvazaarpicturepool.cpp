@@ -0,0 +1,171 @@
+#include "kvazaarpicturepool.h"
+
+#include "logger.h"
+
+#include <kvazaar.h>
+
+#include <algorithm>
+
+// Kvazaar holds on to a few pictures while encoding, so a few more than in
+// the frame pool are kept
+const unsigned int MAX_FREE_PICTURES = 12;
+
+
+KvazaarPicturePool::KvazaarPicturePool(const kvz_api* api):
+  api_(api),
+  poolMutex_(),
+  width_(0),
+  height_(0),
+  freePictures_(),
+  usedPictures_()
+{}
+
+
+KvazaarPicturePool::~KvazaarPicturePool()
+{
+  clear();
+}
+
+
+void KvazaarPicturePool::setResolution(int32_t width, int32_t height)
+{
+  poolMutex_.lock();
+  bool changed = width != width_ || height != height_;
+  width_ = width;
+  height_ = height;
+  poolMutex_.unlock();
+
+  // pictures in use are freed when they are released
+  if (changed)
+  {
+    clear();
+  }
+}
+
+
+std::shared_ptr<uchar[]> KvazaarPicturePool::allocate(DataType type, uint32_t size)
+{
+  poolMutex_.lock();
+  int32_t width = width_;
+  int32_t height = height_;
+
+  // Kvazaar uses 4:2:0 pictures with even dimensions
+  if (type != DT_YUV420VIDEO || width == 0 || height == 0 ||
+      width%2 != 0 || height%2 != 0 ||
+      size != (uint32_t)(width*height + width*height/2))
+  {
+    poolMutex_.unlock();
+    return nullptr;
+  }
+
+  // a free picture may still be referenced by Kvazaar
+  kvz_picture* picture = nullptr;
+  for (auto it = freePictures_.begin(); it != freePictures_.end(); ++it)
+  {
+    if ((*it)->refcount == 1)
+    {
+      picture = *it;
+      freePictures_.erase(it);
+      break;
+    }
+  }
+  poolMutex_.unlock();
+
+  if (picture == nullptr)
+  {
+    picture = api_->picture_alloc(width, height);
+
+    if (picture == nullptr)
+    {
+      return nullptr;
+    }
+
+    // the planes must be laid out like a packed frame
+    if (picture->stride != width ||
+        picture->u != picture->y + width*height ||
+        picture->v != picture->u + width*height/4)
+    {
+      Logger::getLogger()->printDebug(DEBUG_PROGRAM_WARNING, "KvazaarPicturePool",
+                                      "Kvazaar picture is not a packed frame");
+      api_->picture_free(picture);
+      return nullptr;
+    }
+  }
+
+  poolMutex_.lock();
+  usedPictures_.push_back(picture);
+  poolMutex_.unlock();
+
+  // the picture is freed normally if the pool no longer exists
+  std::weak_ptr<KvazaarPicturePool> pool = weak_from_this();
+  const kvz_api* api = api_;
+  return std::shared_ptr<uchar[]>(picture->y, [pool, api, picture](uchar*)
+  {
+    if (std::shared_ptr<KvazaarPicturePool> owner = pool.lock())
+    {
+      owner->release(picture);
+    }
+    else
+    {
+      api->picture_free(picture);
+    }
+  });
+}
+
+
+kvz_picture* KvazaarPicturePool::findPicture(const uchar* payload)
+{
+  kvz_picture* found = nullptr;
+
+  poolMutex_.lock();
+  for (kvz_picture* picture : usedPictures_)
+  {
+    if (picture->y == payload)
+    {
+      found = picture;
+      break;
+    }
+  }
+  poolMutex_.unlock();
+
+  return found;
+}
+
+
+void KvazaarPicturePool::clear()
+{
+  poolMutex_.lock();
+  for (kvz_picture* picture : freePictures_)
+  {
+    api_->picture_free(picture);
+  }
+  freePictures_.clear();
+  poolMutex_.unlock();
+}
+
+
+void KvazaarPicturePool::release(kvz_picture* picture)
+{
+  // the picture may have had a RoI map from the frame
+  picture->roi.roi_array = nullptr;
+  picture->roi.width = 0;
+  picture->roi.height = 0;
+
+  poolMutex_.lock();
+  usedPictures_.erase(std::remove(usedPictures_.begin(), usedPictures_.end(), picture),
+                      usedPictures_.end());
+
+  if (picture->width == width_ && picture->height == height_ &&
+      freePictures_.size() < MAX_FREE_PICTURES)
+  {
+    freePictures_.push_back(picture);
+    picture = nullptr;
+  }
+  poolMutex_.unlock();
+
+  // Kvazaar frees the picture later if it still uses it
+  if (picture != nullptr)
+  {
+    api_->picture_free(picture);
+  }
+}
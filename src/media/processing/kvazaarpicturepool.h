@@ -0,0 +1,52 @@
+#pragma once
+
+#include "filter.h"
+
+#include <QMutex>
+
+#include <memory>
+#include <vector>
+
+struct kvz_api;
+struct kvz_picture;
+
+/* Input pictures for Kvazaar which the filters before the encoder can use as
+ * their output buffers. The payload buffer of a frame is the memory of a
+ * kvz_picture, so the encoder can give the picture to Kvazaar as it is
+ * instead of copying the frame. A picture is reused only after both the
+ * frame and Kvazaar have released it. */
+
+class KvazaarPicturePool : public std::enable_shared_from_this<KvazaarPicturePool>
+{
+public:
+  KvazaarPicturePool(const kvz_api* api);
+  ~KvazaarPicturePool();
+
+  // the resolution of the encoder, zero disables the pool
+  void setResolution(int32_t width, int32_t height);
+
+  // A packed YUV420 buffer which is the memory of a picture. Returns nullptr
+  // if the type or size is not that of the encoder input so the caller can
+  // get the buffer from somewhere else.
+  std::shared_ptr<uchar[]> allocate(DataType type, uint32_t size);
+
+  // The picture the payload of a frame belongs to or nullptr. The picture
+  // stays valid as long as the payload does.
+  kvz_picture* findPicture(const uchar* payload);
+
+  // frees all pictures currently waiting in the pool
+  void clear();
+
+private:
+
+  void release(kvz_picture* picture);
+
+  const kvz_api* api_;
+
+  QMutex poolMutex_;
+  int32_t width_;
+  int32_t height_;
+
+  std::vector<kvz_picture*> freePictures_;
+  std::vector<kvz_picture*> usedPictures_;
+};
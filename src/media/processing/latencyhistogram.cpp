@@ -0,0 +1,120 @@
+#include "latencyhistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+// values below SUB_BUCKETS each have their own bucket, after that each power
+// of two is divided into SUB_BUCKETS buckets
+const uint32_t SUB_BUCKET_BITS = 4;
+const uint32_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+// enough for all 32-bit values
+const uint32_t BUCKET_COUNT = (32 - SUB_BUCKET_BITS + 1)*SUB_BUCKETS;
+
+
+static uint32_t bucketIndex(uint32_t value)
+{
+  if (value < SUB_BUCKETS)
+  {
+    return value;
+  }
+
+  uint32_t exponent = 31;
+  while ((value >> exponent) == 0)
+  {
+    --exponent;
+  }
+
+  uint32_t subBucket = (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+  return (exponent - SUB_BUCKET_BITS + 1)*SUB_BUCKETS + subBucket;
+}
+
+
+// the largest value that ends up in this bucket
+static uint32_t bucketValue(uint32_t index)
+{
+  if (index < SUB_BUCKETS)
+  {
+    return index;
+  }
+
+  uint32_t exponent = index/SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+  uint32_t subBucket = index%SUB_BUCKETS;
+  uint64_t lowest = (uint64_t)(SUB_BUCKETS + subBucket) << (exponent - SUB_BUCKET_BITS);
+  uint64_t width = (uint64_t)1 << (exponent - SUB_BUCKET_BITS);
+
+  return (uint32_t)(lowest + width - 1);
+}
+
+
+LatencyHistogram::LatencyHistogram():
+  buckets_(BUCKET_COUNT, 0),
+  count_(0),
+  max_(0)
+{}
+
+
+void LatencyHistogram::record(int64_t microseconds)
+{
+  if (microseconds < 0)
+  {
+    microseconds = 0;
+  }
+  else if (microseconds > UINT32_MAX)
+  {
+    microseconds = UINT32_MAX;
+  }
+
+  uint32_t value = (uint32_t)microseconds;
+  ++buckets_[bucketIndex(value)];
+  ++count_;
+
+  if (value > max_)
+  {
+    max_ = value;
+  }
+}
+
+
+LatencyPercentiles LatencyHistogram::percentiles() const
+{
+  return {valueAtPercentile(0.50), valueAtPercentile(0.95),
+          valueAtPercentile(0.99), max_};
+}
+
+
+void LatencyHistogram::reset()
+{
+  std::fill(buckets_.begin(), buckets_.end(), 0);
+  count_ = 0;
+  max_ = 0;
+}
+
+
+uint32_t LatencyHistogram::valueAtPercentile(double percentile) const
+{
+  if (count_ == 0)
+  {
+    return 0;
+  }
+
+  uint64_t target = (uint64_t)std::ceil(count_*percentile);
+  if (target == 0)
+  {
+    target = 1;
+  }
+
+  uint64_t cumulative = 0;
+  for (uint32_t i = 0; i < BUCKET_COUNT; ++i)
+  {
+    cumulative += buckets_.at(i);
+    if (cumulative >= target)
+    {
+      // the bucket may extend past the largest recorded value
+      uint32_t value = bucketValue(i);
+      return value < max_ ? value : max_;
+    }
+  }
+
+  return max_;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "statisticsinterface.h"
+
+#include <cstdint>
+#include <vector>
+
+// A histogram for recording latencies in microseconds with constant relative
+// precision, similar to HdrHistogram. Each power of two is divided into 16
+// buckets so the percentiles are within about 6% of the real value while
+// the histogram stays small enough to be kept for every filter.
+// Not thread safe.
+
+class LatencyHistogram
+{
+public:
+  LatencyHistogram();
+
+  void record(int64_t microseconds);
+
+  // p50, p95, p99 and max of all recorded values
+  LatencyPercentiles percentiles() const;
+
+  uint64_t count() const
+  {
+    return count_;
+  }
+
+  void reset();
+
+private:
+
+  uint32_t valueAtPercentile(double percentile) const;
+
+  std::vector<uint32_t> buckets_;
+  uint64_t count_;
+  uint32_t max_;
+};
@@ -1,5 +1,10 @@
 #include "libyuvconverter.h"
 
+#include "yuvconversions.h"
+#include "rowbandpool.h"
+
+#include "media/resourceallocator.h"
+
 #include "logger.h"
 
 #include <libyuv.h>
@@ -7,10 +12,30 @@
 LibYUVConverter::LibYUVConverter(QString id, StatisticsInterface* stats,
                                  std::shared_ptr<ResourceAllocator> hwResources,
                                  DataType input):
-Filter(id, "libyuv", stats, hwResources, input, DT_YUV420VIDEO)
+Filter(id, "libyuv", stats, hwResources, input, DT_YUV420VIDEO),
+bandPool_(hwResources->getRowBandPool())
 {}
 
 
+std::vector<FormatCost> LibYUVConverter::supportedInputs()
+{
+  // planar and semi-planar formats need little more than a copy, packed
+  // formats have to be unpacked and RGB needs a matrix multiplication
+  return {{DT_YUV422VIDEO, 1},
+          {DT_NV12VIDEO,   1},
+          {DT_NV21VIDEO,   1},
+          {DT_YUYVVIDEO,   2},
+          {DT_UYVYVIDEO,   2},
+          {DT_ARGBVIDEO,   3},
+          {DT_BGRAVIDEO,   3},
+          {DT_ABGRVIDEO,   3},
+          {DT_RGB32VIDEO,  3},
+          {DT_RGB24VIDEO,  3},
+          {DT_BGRXVIDEO,   3},
+          {DT_MJPEGVIDEO,  8}};
+}
+
+
 void LibYUVConverter::updateSettings()
 {
   Filter::updateSettings();
@@ -104,10 +129,10 @@ void LibYUVConverter::process()
     }
 
     size_t y_size = input->vInfo->width*input->vInfo->height;
-    size_t color_size = input->vInfo->width*input->vInfo->height/4;
+    size_t color_size = ((input->vInfo->width + 1)/2)*((input->vInfo->height + 1)/2);
 
     size_t finalDataSize = y_size + 2*color_size;
-    std::unique_ptr<uchar[]> yuv_data(new uchar[finalDataSize]);
+    std::shared_ptr<uchar[]> yuv_data = getDataBuffer(DT_YUV420VIDEO, finalDataSize);
 
     uint8_t* y = yuv_data.get();
     uint8_t* u = yuv_data.get() + y_size;
@@ -117,20 +142,207 @@ void LibYUVConverter::process()
     int u_stride = (input->vInfo->width + 1)/2;
     int v_stride = (input->vInfo->width + 1)/2;
 
-    libyuv::ConvertToI420(input->data.get(), input->data_size,
-                          y, y_stride,
-                          u, u_stride,
-                          v, v_stride,
-                          0, 0,
-                          input->vInfo->width, input->vInfo->height,
-                          input->vInfo->width, input->vInfo->height,
-                          libyuv::kRotate0, fourcc);
+    // Padded frames are read in place if libyuv has a strided conversion for
+    // the format. The pool decides how many threads the frame is worth.
+    bool converted = false;
+    if (isPackedVideo(input.get()))
+    {
+      converted = convertPacked(input.get(), yuv_data.get());
+    }
+
+    if (!converted)
+    {
+      converted = convertPlanes(input.get(), y, y_stride, u, u_stride, v, v_stride);
+    }
+
+    // MJPEG and the rest are converted as a whole
+    if (!converted)
+    {
+      if (!isPackedVideo(input.get()))
+      {
+        packVideo(input.get());
+      }
+
+      libyuv::ConvertToI420(input->data.get(), input->data_size,
+                            y, y_stride,
+                            u, u_stride,
+                            v, v_stride,
+                            0, 0,
+                            input->vInfo->width, input->vInfo->height,
+                            input->vInfo->width, input->vInfo->height,
+                            libyuv::kRotate0, fourcc);
+    }
 
     input->type = DT_YUV420VIDEO;
     input->data = std::move(yuv_data);
     input->data_size = finalDataSize;
+    input->vInfo->planeCount = 0;
     sendOutput(std::move(input));
 
     input = getInput();
   }
 }
+
+
+// Converts height rows of the planes with libyuv. False if there is no
+// strided conversion for the type.
+static bool convertRows(DataType type, uint8_t* const planes[], const uint32_t strides[],
+                        uint8_t* y, int yStride,
+                        uint8_t* u, int uStride,
+                        uint8_t* v, int vStride,
+                        int width, int height)
+{
+  switch (type)
+  {
+    case DT_YUV422VIDEO:
+    {
+      return libyuv::I422ToI420(planes[0], strides[0], planes[1], strides[1],
+                                planes[2], strides[2],
+                                y, yStride, u, uStride, v, vStride, width, height) == 0;
+    }
+    case DT_NV12VIDEO:
+    {
+      return libyuv::NV12ToI420(planes[0], strides[0], planes[1], strides[1],
+                                y, yStride, u, uStride, v, vStride, width, height) == 0;
+    }
+    case DT_NV21VIDEO:
+    {
+      return libyuv::NV21ToI420(planes[0], strides[0], planes[1], strides[1],
+                                y, yStride, u, uStride, v, vStride, width, height) == 0;
+    }
+    case DT_YUYVVIDEO:
+    {
+      return libyuv::YUY2ToI420(planes[0], strides[0],
+                                y, yStride, u, uStride, v, vStride, width, height) == 0;
+    }
+    case DT_UYVYVIDEO:
+    {
+      return libyuv::UYVYToI420(planes[0], strides[0],
+                                y, yStride, u, uStride, v, vStride, width, height) == 0;
+    }
+    case DT_ARGBVIDEO:
+    {
+      return libyuv::ARGBToI420(planes[0], strides[0],
+                                y, yStride, u, uStride, v, vStride, width, height) == 0;
+    }
+    case DT_BGRAVIDEO:
+    {
+      return libyuv::BGRAToI420(planes[0], strides[0],
+                                y, yStride, u, uStride, v, vStride, width, height) == 0;
+    }
+    case DT_ABGRVIDEO:
+    {
+      return libyuv::ABGRToI420(planes[0], strides[0],
+                                y, yStride, u, uStride, v, vStride, width, height) == 0;
+    }
+    case DT_RGB32VIDEO:
+    {
+      return libyuv::RGBAToI420(planes[0], strides[0],
+                                y, yStride, u, uStride, v, vStride, width, height) == 0;
+    }
+    case DT_BGRXVIDEO:
+    {
+      return libyuv::RGB24ToI420(planes[0], strides[0],
+                                 y, yStride, u, uStride, v, vStride, width, height) == 0;
+    }
+    default:
+    {
+      // these are converted from a packed frame as a whole
+      return false;
+    }
+  }
+}
+
+
+bool LibYUVConverter::convertPlanes(Data* input,
+                                    uint8_t* y, int yStride,
+                                    uint8_t* u, int uStride,
+                                    uint8_t* v, int vStride)
+{
+  uint16_t width = input->vInfo->width;
+  uint16_t height = input->vInfo->height;
+
+  uint32_t strides[MAX_VIDEO_PLANES] = {0, 0, 0};
+  uint8_t* planes[MAX_VIDEO_PLANES] = {nullptr, nullptr, nullptr};
+
+  for (unsigned int plane = 0; plane < videoPlaneCount(input->type); ++plane)
+  {
+    planes[plane] = videoPlane(input, plane, strides[plane]);
+  }
+
+  // the chroma of NV12 and NV21 has half the rows, the other formats have
+  // all their planes at full height
+  unsigned int chromaRowDivisor = 1;
+  if (input->type == DT_NV12VIDEO || input->type == DT_NV21VIDEO)
+  {
+    chromaRowDivisor = 2;
+  }
+
+  // the type decides whether the conversion works, so either all bands fail
+  // or none of them
+  std::atomic<bool> converted(true);
+  DataType type = input->type;
+
+  bandPool_->run(width, height, [&](uint16_t firstRow, uint16_t lastRow)
+  {
+    uint8_t* bandPlanes[MAX_VIDEO_PLANES] = {nullptr, nullptr, nullptr};
+    for (unsigned int plane = 0; plane < MAX_VIDEO_PLANES; ++plane)
+    {
+      if (planes[plane])
+      {
+        unsigned int rows = plane == 0 ? firstRow : firstRow/chromaRowDivisor;
+        bandPlanes[plane] = planes[plane] + rows*strides[plane];
+      }
+    }
+
+    if (!convertRows(type, bandPlanes, strides,
+                     y + firstRow*yStride, yStride,
+                     u + firstRow/2*uStride, uStride,
+                     v + firstRow/2*vStride, vStride,
+                     width, lastRow - firstRow))
+    {
+      converted = false;
+    }
+  });
+
+  return converted;
+}
+
+
+bool LibYUVConverter::convertPacked(Data* input, uint8_t* output)
+{
+  uint16_t width = input->vInfo->width;
+  uint16_t height = input->vInfo->height;
+
+  if (!getHWManager()->isAVX2Enabled() || width % 2 != 0 || height % 2 != 0)
+  {
+    return false;
+  }
+
+  uint8_t* in = input->data.get();
+
+  // the most common camera formats have our own kernels
+  switch (input->type)
+  {
+    case DT_YUYVVIDEO:
+    {
+      bandPool_->run(width, height, [=](uint16_t firstRow, uint16_t lastRow)
+      {
+        yuyv_to_yuv420_avx2_rows(in, output, width, height, firstRow, lastRow);
+      });
+      return true;
+    }
+    case DT_NV12VIDEO:
+    {
+      bandPool_->run(width, height, [=](uint16_t firstRow, uint16_t lastRow)
+      {
+        nv12_to_yuv420_avx2_rows(in, output, width, height, firstRow, lastRow);
+      });
+      return true;
+    }
+    default:
+    {
+      return false;
+    }
+  }
+}
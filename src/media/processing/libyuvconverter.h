@@ -2,6 +2,8 @@
 
 #include "filter.h"
 
+class RowBandPool;
+
 class LibYUVConverter : public Filter
 {
 public:
@@ -10,8 +12,36 @@ public:
 
     virtual void updateSettings();
 
+    virtual bool isFusable() const
+    {
+      return true;
+    }
+
+    virtual bool isFormatConversion() const
+    {
+      return true;
+    }
+
+    // the formats that can be converted to YUV420 and their cost
+    static std::vector<FormatCost> supportedInputs();
+
 protected:
 
     void process();
 
+private:
+
+    // Converts the planes of input in place, also padded ones, in bands of
+    // rows. False if libyuv has no strided conversion for the format.
+    bool convertPlanes(Data* input,
+                       uint8_t* y, int yStride,
+                       uint8_t* u, int uStride,
+                       uint8_t* v, int vStride);
+
+    // converts packed input with the AVX2 kernels of yuvconversions in bands
+    // of rows, false if not supported for this format or processor
+    bool convertPacked(Data* input, uint8_t* output);
+
+    std::shared_ptr<RowBandPool> bandPool_;
+
 };
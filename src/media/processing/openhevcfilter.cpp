@@ -21,10 +21,18 @@ OpenHEVCFilter::OpenHEVCFilter(uint32_t sessionID, StatisticsInterface *stats,
   sessionID_(sessionID),
   threads_(-1),
   parallelizationMode_("Slice"),
-  discardedFrames_(0)
+  discardedFrames_(0),
+  decodeErrors_(0),
+  keyframeRequest_(nullptr)
 {}
 
 
+void OpenHEVCFilter::setKeyframeRequest(std::function<void()> request)
+{
+  keyframeRequest_ = request;
+}
+
+
 bool OpenHEVCFilter::init()
 {
   Logger::getLogger()->printNormal(this, "Starting to initiate OpenHEVC");
@@ -64,8 +72,15 @@ bool OpenHEVCFilter::init()
                                   {libOpenHevcVersion(handle_), QString::number(threads_),
                                   parallelizationMode_});
 
-  // This is because we don't know anything about the incoming stream
-  maxBufferSize_ = -1; // no buffer limit
+  // This is because we don't know anything about the incoming stream.
+  // Only the buffer capacity limits input, and then whole GOPs are discarded
+  setBackpressurePolicy(std::make_shared<HEVCGOPPolicy>(0, [this]()
+  {
+    if (keyframeRequest_)
+    {
+      keyframeRequest_();
+    }
+  }));
 
   vpsReceived_ = false;
   spsReceived_ = false;
@@ -133,6 +148,11 @@ void OpenHEVCFilter::process()
 
     bool vcl = nalType <= 31; // 31 is highest vlc nal_type
 
+    // A picture may be split to several slices which arrive as separate NAL
+    // units, but only the first one begins a new picture. The flag is the
+    // first bit of the slice header.
+    bool firstSlice = vcl && input->data_size > 6 && (buff[6] & 0x80);
+
     if((vpsReceived_ && spsReceived_ && ppsReceived_) || !vcl)
     {
       if (discardedFrames_ != 0)
@@ -146,7 +166,7 @@ void OpenHEVCFilter::process()
                                          input->data_size, input->presentationTime);
 
       // only VCL frames result in output from decoder (at least I think so)
-      if (vcl)
+      if (firstSlice)
       {
         decodingFrames_.push_front(std::move(input));
       }
@@ -154,6 +174,13 @@ void OpenHEVCFilter::process()
       if (gotPicture <= -1)
       {
         Logger::getLogger()->printError(this,  "Error while decoding!");
+
+        // one request is enough for the errors that follow from the same loss
+        if (decodeErrors_ == 0 && keyframeRequest_)
+        {
+          keyframeRequest_();
+        }
+        ++decodeErrors_;
       }
       else if (gotPicture == 0)
       {
@@ -168,6 +195,7 @@ void OpenHEVCFilter::process()
       }
       else
       {
+        decodeErrors_ = 0;
         sendDecodedOutput(gotPicture);
       }
     }
@@ -176,6 +204,11 @@ void OpenHEVCFilter::process()
       if (discardedFrames_ == 0)
       {
         Logger::getLogger()->printWarning(this, "Discarding frames until necessary structures have arrived");
+
+        if (keyframeRequest_)
+        {
+          keyframeRequest_();
+        }
       }
 
       ++discardedFrames_;
@@ -194,38 +227,52 @@ void OpenHEVCFilter::sendDecodedOutput(int& gotPicture)
   OpenHevc_Frame openHevcFrame;
   if ((gotPicture = libOpenHevcGetOutput(handle_, gotPicture, &openHevcFrame)) > 0)
   {
+    if (decodingFrames_.empty())
+    {
+      Logger::getLogger()->printDebug(DEBUG_PROGRAM_WARNING, this, "Decoded picture without input frame");
+      return;
+    }
+
     std::unique_ptr<Data> decodedFrame = std::move(decodingFrames_.back());
     decodingFrames_.pop_back();
     libOpenHevcGetPictureInfo(handle_, &openHevcFrame.frameInfo);
 
     decodedFrame->vInfo->width = openHevcFrame.frameInfo.nWidth;
     decodedFrame->vInfo->height = openHevcFrame.frameInfo.nHeight;
-    uint32_t finalDataSize = decodedFrame->vInfo->width*decodedFrame->vInfo->height +
-        decodedFrame->vInfo->width*decodedFrame->vInfo->height/2;
-    std::unique_ptr<uchar[]> yuv_frame(new uchar[finalDataSize]);
-
-    uint8_t* pY = (uint8_t*)yuv_frame.get();
-    uint8_t* pU = (uint8_t*)&(yuv_frame.get()[decodedFrame->vInfo->width*decodedFrame->vInfo->height]);
-    uint8_t* pV = (uint8_t*)&(yuv_frame.get()[decodedFrame->vInfo->width*decodedFrame->vInfo->height +
-        decodedFrame->vInfo->width*decodedFrame->vInfo->height/4]);
-
-    uint32_t s_stride = openHevcFrame.frameInfo.nYPitch;
-    uint32_t qs_stride = openHevcFrame.frameInfo.nUPitch/2;
+    // The planes are copied as whole blocks with the pitch of the decoder
+    // and the pitch is given to the following filters, so no row by row
+    // repacking is needed.
+    uint8_t* sources[3] = {(uint8_t*)openHevcFrame.pvY,
+                           (uint8_t*)openHevcFrame.pvU,
+                           (uint8_t*)openHevcFrame.pvV};
+    uint32_t strides[3] = {(uint32_t)openHevcFrame.frameInfo.nYPitch,
+                           (uint32_t)openHevcFrame.frameInfo.nUPitch,
+                           (uint32_t)openHevcFrame.frameInfo.nUPitch};
+
+    uint32_t blockSizes[3] = {0, 0, 0};
+    uint32_t finalDataSize = 0;
+    for (unsigned int plane = 0; plane < 3; ++plane)
+    {
+      uint32_t rowBytes = 0;
+      uint32_t rows = 0;
+      videoPlaneSize(DT_YUV420VIDEO, decodedFrame->vInfo->width, decodedFrame->vInfo->height,
+                     plane, rowBytes, rows);
 
-    uint32_t d_stride = decodedFrame->vInfo->width/2;
-    uint32_t dd_stride = decodedFrame->vInfo->width;
+      // the padding after last row is not needed
+      blockSizes[plane] = strides[plane]*(rows - 1) + rowBytes;
 
-    for (int i=0; i<decodedFrame->vInfo->height; i++) {
-      memcpy(pY,  (uint8_t *) openHevcFrame.pvY + i*s_stride, dd_stride);
-      pY += dd_stride;
+      decodedFrame->vInfo->planeOffsets[plane] = finalDataSize;
+      decodedFrame->vInfo->planeStrides[plane] = strides[plane];
+      finalDataSize += blockSizes[plane];
+    }
+    decodedFrame->vInfo->planeCount = 3;
 
-      if (! (i%2) ) {
-        memcpy(pU,  (uint8_t *) openHevcFrame.pvU + i*qs_stride, d_stride);
-        pU += d_stride;
+    std::shared_ptr<uchar[]> yuv_frame = getDataBuffer(DT_YUV420VIDEO, finalDataSize);
 
-        memcpy(pV,  (uint8_t *) openHevcFrame.pvV + i*qs_stride, d_stride);
-        pV += d_stride;
-      }
+    for (unsigned int plane = 0; plane < 3; ++plane)
+    {
+      memcpy(yuv_frame.get() + decodedFrame->vInfo->planeOffsets[plane],
+             sources[plane], blockSizes[plane]);
     }
 
     decodedFrame->type = DT_YUV420VIDEO;
@@ -3,6 +3,8 @@
 
 #include "openHevcWrapper.h"
 
+#include <functional>
+
 class OpenHEVCFilter : public Filter
 {
 public:
@@ -14,6 +16,10 @@ public:
 
   virtual void updateSettings();
 
+  // Called when the decoder needs an intra frame to continue. Set before
+  // the filter is started.
+  void setKeyframeRequest(std::function<void()> request);
+
 protected:
   virtual void process();
 
@@ -38,4 +44,9 @@ private:
   QMutex settingsMutex_;
 
   uint32_t discardedFrames_;
+
+  // errors since the last decoded picture
+  uint32_t decodeErrors_;
+
+  std::function<void()> keyframeRequest_;
 };
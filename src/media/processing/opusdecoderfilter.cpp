@@ -67,7 +67,7 @@ void OpusDecoderFilter::process()
 
     if(len > -1)
     {
-      std::unique_ptr<uchar[]> pcm_frame(new uchar[datasize]);
+      std::shared_ptr<uchar[]> pcm_frame = getDataBuffer(DT_RAWAUDIO, datasize);
       memcpy(pcm_frame.get(), pcmOutput_, datasize);
       input->data_size = datasize;
 
@@ -41,6 +41,7 @@ RoiFilter::RoiFilter(QString id, StatisticsInterface *stats, std::shared_ptr<Res
     roiEnabled_(false),
     frameCount_(0),
     roi_({0,0,nullptr}),
+    frameRoi_(nullptr),
     roiSurface_(roiInterface)
 {
 }
@@ -73,6 +74,8 @@ void RoiFilter::process()
         prevInputDiscarded_ = inputDiscarded_;
       }
       if(frameCount_ % skipInput_ == 0) {
+        // detection reads the luma plane as packed
+        packVideo(input.get());
         auto detections = detect(input.get());
 
         auto largest_bbox = find_largest_bbox(detections);
@@ -132,13 +135,16 @@ void RoiFilter::process()
         roi_.data = std::make_unique<int8_t[]>(roi_length);
         memcpy(roi_.data.get(), roi_mat.data.get(), roi_length);
 
+        // frames share the map until there is a new one
+        frameRoi_ = getRoiBuffer(roi_.width*roi_.height);
+        memcpy(frameRoi_.get(), roi_.data.get(), roi_.width*roi_.height);
+
         roiSurface_->inputDetections(detections, {input->vInfo->width, input->vInfo->height}, 0);
       }
       if(roi_.data){
         input->vInfo->roiWidth = roi_.width;
         input->vInfo->roiHeight = roi_.height;
-        input->vInfo->roiArray = std::make_unique<int8_t[]>(roi_.width*roi_.height);
-        memcpy(input->vInfo->roiArray.get(), roi_.data.get(), roi_.width*roi_.height);
+        input->vInfo->roiArray = frameRoi_;
       }
 
       frameCount_++;
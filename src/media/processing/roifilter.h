@@ -114,6 +114,8 @@ private:
   QAtomicInt roiEnabled_;
   int frameCount_;
   Roi roi_;
+  // the latest map given to frames
+  std::shared_ptr<int8_t[]> frameRoi_;
   RoiMapFilter roiFilter_;
 
   QMutex settingsMutex_;
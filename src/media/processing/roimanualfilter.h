@@ -15,6 +15,11 @@ public:
 
   virtual void updateSettings();
 
+  virtual bool isFusable() const
+  {
+    return true;
+  }
+
 protected:
   void process();
 
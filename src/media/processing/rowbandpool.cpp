@@ -0,0 +1,191 @@
+#include "rowbandpool.h"
+
+
+// Smaller bands are not worth waking a thread for. A 1080p frame is split
+// into at most 6 bands and anything below 480p is done by the caller alone.
+const uint32_t MIN_BAND_PIXELS = 320000;
+
+
+RowBandPool::RowBandPool(unsigned int workerCount):
+  workers_(),
+  jobMutex_(),
+  jobAvailable_(),
+  jobs_(),
+  activeJobs_(0),
+  running_(true)
+{
+  for (unsigned int i = 0; i < workerCount; ++i)
+  {
+    workers_.push_back(std::thread(&RowBandPool::workerLoop, this));
+  }
+}
+
+
+RowBandPool::~RowBandPool()
+{
+  jobMutex_.lock();
+  running_ = false;
+  jobAvailable_.wakeAll();
+  jobMutex_.unlock();
+
+  for (auto& worker : workers_)
+  {
+    if (worker.joinable())
+    {
+      worker.join();
+    }
+  }
+}
+
+
+unsigned int RowBandPool::bandCount(uint16_t width, uint16_t height) const
+{
+  unsigned int bands = (uint32_t)width*height/MIN_BAND_PIXELS;
+
+  // the threads are divided between the frames being converted, counting
+  // the one asking
+  unsigned int threads = ((unsigned int)workers_.size() + 1)/(activeJobs_.load() + 1);
+
+  if (bands > threads)
+  {
+    bands = threads;
+  }
+
+  // each band needs at least one pair of rows
+  if (bands > height/2u)
+  {
+    bands = height/2u;
+  }
+
+  if (bands == 0)
+  {
+    bands = 1;
+  }
+
+  return bands;
+}
+
+
+void RowBandPool::run(uint16_t width, uint16_t height,
+                      std::function<void(uint16_t, uint16_t)> work)
+{
+  unsigned int bands = bandCount(width, height);
+
+  if (bands <= 1)
+  {
+    work(0, height);
+    return;
+  }
+
+  ++activeJobs_;
+
+  std::shared_ptr<Job> job = std::make_shared<Job>();
+  job->work = work;
+  job->height = height;
+  job->bands = bands;
+  job->nextBand = 0;
+  job->finishedBands = 0;
+
+  // rounded up to an even number of rows
+  job->bandRows = (height + bands - 1)/bands;
+  job->bandRows += job->bandRows%2;
+
+  jobMutex_.lock();
+  jobs_.push_back(job);
+  for (unsigned int i = 1; i < bands; ++i)
+  {
+    jobAvailable_.wakeOne();
+  }
+  jobMutex_.unlock();
+
+  while (processBand(*job))
+  {}
+
+  // no point in workers looking at this job anymore
+  jobMutex_.lock();
+  for (auto it = jobs_.begin(); it != jobs_.end(); ++it)
+  {
+    if (*it == job)
+    {
+      jobs_.erase(it);
+      break;
+    }
+  }
+  jobMutex_.unlock();
+
+  job->doneMutex.lock();
+  while (job->finishedBands.load() < job->bands)
+  {
+    job->done.wait(&job->doneMutex);
+  }
+  job->doneMutex.unlock();
+
+  --activeJobs_;
+}
+
+
+void RowBandPool::workerLoop()
+{
+  while (true)
+  {
+    jobMutex_.lock();
+    while (running_ && jobs_.empty())
+    {
+      jobAvailable_.wait(&jobMutex_);
+    }
+
+    if (!running_)
+    {
+      jobMutex_.unlock();
+      return;
+    }
+
+    std::shared_ptr<Job> job = jobs_.front();
+    jobMutex_.unlock();
+
+    if (!processBand(*job))
+    {
+      // all bands have been taken, the caller waits for the rest to finish
+      jobMutex_.lock();
+      if (!jobs_.empty() && jobs_.front() == job)
+      {
+        jobs_.pop_front();
+      }
+      jobMutex_.unlock();
+    }
+  }
+}
+
+
+bool RowBandPool::processBand(Job& job)
+{
+  unsigned int band = job.nextBand++;
+
+  if (band >= job.bands)
+  {
+    return false;
+  }
+
+  uint32_t firstRow = band*job.bandRows;
+  uint32_t lastRow = firstRow + job.bandRows;
+
+  if (lastRow > job.height)
+  {
+    lastRow = job.height;
+  }
+
+  // rounding may leave the last bands empty
+  if (firstRow < lastRow)
+  {
+    job.work((uint16_t)firstRow, (uint16_t)lastRow);
+  }
+
+  job.doneMutex.lock();
+  if (++job.finishedBands == job.bands)
+  {
+    job.done.wakeAll();
+  }
+  job.doneMutex.unlock();
+
+  return true;
+}
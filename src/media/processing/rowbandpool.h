@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/* A process-wide thread pool for splitting the rows of one frame between
+ * threads. Every conversion shares the same workers so that several video
+ * streams converting at the same time do not start more threads than there
+ * are cores. The calling thread also processes bands, so a frame is never
+ * waiting for a worker to become available.
+ *
+ * The number of bands is picked from the frame size and the number of frames
+ * being converted at the moment. */
+
+class RowBandPool
+{
+public:
+  RowBandPool(unsigned int workerCount);
+  ~RowBandPool();
+
+  // Runs work for each band of rows [firstRow, lastRow) and returns when all
+  // are done. The bands always start at an even row so chroma rows of 4:2:0
+  // are never split.
+  void run(uint16_t width, uint16_t height,
+           std::function<void(uint16_t firstRow, uint16_t lastRow)> work);
+
+  // how many bands a frame of this size would be split into right now
+  unsigned int bandCount(uint16_t width, uint16_t height) const;
+
+  unsigned int workerCount() const
+  {
+    return (unsigned int)workers_.size();
+  }
+
+private:
+
+  struct Job
+  {
+    std::function<void(uint16_t, uint16_t)> work;
+    uint16_t height = 0;
+    uint16_t bandRows = 0;
+    unsigned int bands = 0;
+
+    std::atomic<unsigned int> nextBand;
+    std::atomic<unsigned int> finishedBands;
+
+    QMutex doneMutex;
+    QWaitCondition done;
+  };
+
+  void workerLoop();
+
+  // processes one band of job, false if all bands have already been taken
+  bool processBand(Job& job);
+
+  std::vector<std::thread> workers_;
+
+  QMutex jobMutex_;
+  QWaitCondition jobAvailable_;
+  std::deque<std::shared_ptr<Job>> jobs_;
+
+  // frames being converted at the moment, used to balance the bands
+  std::atomic<unsigned int> activeJobs_;
+  std::atomic<bool> running_;
+};
@@ -1,86 +1,318 @@
 #include "scalefilter.h"
 
+#include "rowbandpool.h"
+
+#include "media/resourceallocator.h"
+
 #include "common.h"
 #include "logger.h"
 
-#include <QImage>
+#include <libyuv.h>
 
-ScaleFilter::ScaleFilter(QString id, StatisticsInterface *stats,
-                         std::shared_ptr<ResourceAllocator> hwResources):
-  Filter(id, "Scaler", stats, hwResources, DT_RGB32VIDEO, DT_RGB32VIDEO),
-  newSize_(QSize(0,0))
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+// The downscaled size is picked from steps of 1/16 of the input so that
+// small changes in the target do not change the output resolution, which
+// would in turn move the target. Above 12/16 the conversion saved is not
+// worth the scaling.
+const uint32_t TARGET_STEPS = 16;
+const uint32_t MAX_TARGET_STEP = 12;
+
+
+static libyuv::FilterMode libyuvMode(ScaleMode mode)
+{
+  switch (mode)
+  {
+    case SCALE_POINT:
+    {
+      return libyuv::kFilterNone;
+    }
+    case SCALE_BILINEAR:
+    {
+      return libyuv::kFilterBilinear;
+    }
+    default:
+    {
+      return libyuv::kFilterBox;
+    }
+  }
+}
+
+
+// Scratch memory of the calling thread. It only grows, so after the first
+// frames no band allocates anything.
+static uint8_t* scratchBuffer(size_t size)
 {
+  thread_local std::vector<uint8_t> scratch;
+
+  if (scratch.size() < size)
+  {
+    scratch.resize(size);
+  }
 
+  return scratch.data();
 }
 
+
+// Scales output rows [dstFirst, dstLast) of one plane. The interleaved UV
+// plane of NV12 is split for scaling, since filtering would otherwise mix U
+// and V, so its widths are in pairs.
+//
+// The band limits are moved to the nearest point before them where a whole
+// number of output rows maps to a whole number of input rows, so the bands
+// sample the rows the whole plane would. To give the filter the same
+// neighbours at the band edges, a margin of one such step is scaled on both
+// sides and only the rows of the band are copied to the output.
+static void scalePlaneRows(const uint8_t* src, int srcStride, uint32_t srcWidth, uint32_t srcHeight,
+                           uint8_t* dst, int dstStride, uint32_t dstWidth, uint32_t dstHeight,
+                           uint32_t dstFirst, uint32_t dstLast, bool interleavedUV,
+                           libyuv::FilterMode mode)
+{
+  uint32_t unit = dstHeight/std::gcd(srcHeight, dstHeight);
+  uint32_t first = dstFirst - dstFirst%unit;
+  uint32_t last = dstLast == dstHeight ? dstHeight : dstLast - dstLast%unit;
+
+  if (first >= last)
+  {
+    return;
+  }
+
+  uint32_t windowFirst = first >= unit ? first - unit : 0;
+  uint32_t windowLast = std::min(last + unit, dstHeight);
+  uint32_t windowRows = windowLast - windowFirst;
+
+  uint32_t srcFirst = (uint64_t)windowFirst*srcHeight/dstHeight;
+  uint32_t srcRows = (uint64_t)windowLast*srcHeight/dstHeight - srcFirst;
+  src += srcFirst*srcStride;
+
+  uint32_t skip = first - windowFirst;
+  uint32_t rows = last - first;
+
+  if (interleavedUV)
+  {
+    uint8_t* srcU = scratchBuffer(2*(srcWidth*srcRows + dstWidth*windowRows));
+    uint8_t* srcV = srcU + srcWidth*srcRows;
+    uint8_t* dstU = srcV + srcWidth*srcRows;
+    uint8_t* dstV = dstU + dstWidth*windowRows;
+
+    libyuv::SplitUVPlane(src, srcStride, srcU, srcWidth, srcV, srcWidth, srcWidth, srcRows);
+
+    libyuv::ScalePlane(srcU, srcWidth, srcWidth, srcRows, dstU, dstWidth, dstWidth, windowRows, mode);
+    libyuv::ScalePlane(srcV, srcWidth, srcWidth, srcRows, dstV, dstWidth, dstWidth, windowRows, mode);
+
+    libyuv::MergeUVPlane(dstU + skip*dstWidth, dstWidth, dstV + skip*dstWidth, dstWidth,
+                         dst + first*dstStride, dstStride, dstWidth, rows);
+  }
+  else if (windowRows == rows)
+  {
+    // the whole plane is one band
+    libyuv::ScalePlane(src, srcStride, srcWidth, srcRows,
+                       dst + first*dstStride, dstStride, dstWidth, rows, mode);
+  }
+  else
+  {
+    uint8_t* window = scratchBuffer(dstWidth*windowRows);
+
+    libyuv::ScalePlane(src, srcStride, srcWidth, srcRows,
+                       window, dstWidth, dstWidth, windowRows, mode);
+
+    libyuv::CopyPlane(window + skip*dstWidth, dstWidth,
+                      dst + first*dstStride, dstStride, dstWidth, rows);
+  }
+}
+
+
+ScaleFilter::ScaleFilter(QString id, StatisticsInterface *stats,
+                         std::shared_ptr<ResourceAllocator> hwResources,
+                         DataType format):
+  Filter(id, "Scaler", stats, hwResources, format, format),
+  bandPool_(hwResources->getRowBandPool()),
+  settingsMutex_(),
+  newSize_(QSize(0,0)),
+  mode_(SCALE_BOX),
+  targetSize_()
+{
+  if (format != DT_YUV420VIDEO && format != DT_NV12VIDEO)
+  {
+    Logger::getLogger()->printProgramError(this, "Unsupported format for scaler",
+                                           "Format", datatypeToString(format));
+  }
+}
+
+
 void ScaleFilter::setResolution(QSize newResolution)
 {
-  newSize_ = newResolution;
+  settingsMutex_.lock();
+  newSize_ = QSize(newResolution.width() - newResolution.width()%2,
+                   newResolution.height() - newResolution.height()%2);
+  settingsMutex_.unlock();
 }
 
-void ScaleFilter::process()
+
+void ScaleFilter::setMode(ScaleMode mode)
 {
-  if(newSize_ == QSize(0,0))
+  settingsMutex_.lock();
+  mode_ = mode;
+  settingsMutex_.unlock();
+}
+
+
+void ScaleFilter::setTargetSize(std::function<QSize()> targetSize)
+{
+  settingsMutex_.lock();
+  targetSize_ = targetSize;
+  settingsMutex_.unlock();
+}
+
+
+QSize ScaleFilter::outputSize(const Data& input)
+{
+  settingsMutex_.lock();
+  QSize size = newSize_;
+  std::function<QSize()> targetSize = targetSize_;
+  settingsMutex_.unlock();
+
+  if (!targetSize)
   {
-    Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this, "Size not set for scaler.");
-    return;
+    return size;
   }
 
+  QSize target = targetSize();
+  if (target.isEmpty())
+  {
+    return QSize();
+  }
+
+  uint32_t width = input.vInfo->width;
+  uint32_t height = input.vInfo->height;
+
+  // the smallest step that still covers the target in both directions
+  uint32_t widthStep = (target.width()*TARGET_STEPS + width - 1)/width;
+  uint32_t heightStep = (target.height()*TARGET_STEPS + height - 1)/height;
+  uint32_t step = std::max(widthStep, heightStep);
+
+  if (step > MAX_TARGET_STEP)
+  {
+    return QSize();
+  }
+
+  if (step == 0)
+  {
+    step = 1;
+  }
+
+  size = QSize(width*step/TARGET_STEPS, height*step/TARGET_STEPS);
+  return QSize(size.width() - size.width()%2, size.height() - size.height()%2);
+}
+
+
+void ScaleFilter::process()
+{
   std::unique_ptr<Data> input = getInput();
   while(input)
   {
+    settingsMutex_.lock();
+    ScaleMode mode = mode_;
+    settingsMutex_.unlock();
+
     if(input->vInfo->height == 0 || input->vInfo->width == 0 || input->data_size == 0)
     {
-      Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this, 
+      Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this,
                                       "The resolution of input image for scaler is not set.",
                                       {"Width", "Height"}, {QString::number(input->vInfo->width),
                                        QString::number(input->vInfo->height)});
-      return;
     }
-
-    QImage::Format format;
-
-    switch(input->type)
+    else if (input->type != inputType())
     {
-      case DT_RGB32VIDEO:
-      {
-        format = QImage::Format_RGB32;
-        break;
-      }
-      default:
+      Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this,  "Wrong video format for scaler.",
+                                      {"Input type"},{QString::number(input->type)});
+    }
+    else
+    {
+      QSize size = outputSize(*input);
+
+      if (!size.isEmpty() &&
+          (size.width() != input->vInfo->width || size.height() != input->vInfo->height))
       {
-        Logger::getLogger()->printDebug(DEBUG_PROGRAM_ERROR, this,  "Wrong video format for scaler.",
-                                        {"Input type"},{QString::number(input->type)});
-        format = QImage::Format_Invalid;
-        break;
+        input = scaleFrame(std::move(input), size, mode);
       }
     }
 
-    if(format != QImage::Format_Invalid)
-    {
-      input = scaleFrame(std::move(input));
-    }
     sendOutput(std::move(input));
+    input = getInput();
   }
 }
 
-std::unique_ptr<Data> ScaleFilter::scaleFrame(std::unique_ptr<Data> input)
+
+std::unique_ptr<Data> ScaleFilter::scaleFrame(std::unique_ptr<Data> input, QSize size,
+                                              ScaleMode mode)
 {
-  QImage image(
-        input->data.get(),
-        input->vInfo->width,
-        input->vInfo->height,
-        QImage::Format_RGB32);
+  const unsigned int planes = videoPlaneCount(input->type);
+
+  uint32_t srcWidth = input->vInfo->width;
+  uint32_t srcHeight = input->vInfo->height;
+  uint32_t dstWidth = size.width();
+  uint32_t dstHeight = size.height();
+
+  // the input planes are read in place, even if they are padded
+  std::shared_ptr<uchar[]> original = input->data;
+  uint8_t* srcPlanes[MAX_VIDEO_PLANES] = {nullptr, nullptr, nullptr};
+  uint32_t srcStrides[MAX_VIDEO_PLANES] = {0, 0, 0};
+
+  for (unsigned int plane = 0; plane < planes; ++plane)
+  {
+    srcPlanes[plane] = videoPlane(input.get(), plane, srcStrides[plane]);
+  }
 
-  QImage scaled = image.scaled(newSize_);
-  if(newSize_.width() * newSize_.height()
-     > input->vInfo->width * input->vInfo->height)
+  uint32_t dstSize = 0;
+  for (unsigned int plane = 0; plane < planes; ++plane)
   {
-    input->data = std::unique_ptr<uchar[]>(new uchar[scaled.sizeInBytes()]);
+    uint32_t rowBytes = 0;
+    uint32_t rows = 0;
+    videoPlaneSize(input->type, dstWidth, dstHeight, plane, rowBytes, rows);
+    dstSize += rowBytes*rows;
   }
-  memcpy(input->data.get(), scaled.bits(), scaled.sizeInBytes());
-  input->vInfo->width = newSize_.width();
-  input->vInfo->height = newSize_.height();
-  input->data_size = scaled.sizeInBytes();
+
+  input->data = getDataBuffer(input->type, dstSize);
+  input->data_size = dstSize;
+  input->vInfo->width = dstWidth;
+  input->vInfo->height = dstHeight;
+  input->vInfo->planeCount = 0;
+
+  uint8_t* dstPlanes[MAX_VIDEO_PLANES] = {nullptr, nullptr, nullptr};
+  uint32_t dstStrides[MAX_VIDEO_PLANES] = {0, 0, 0};
+
+  for (unsigned int plane = 0; plane < planes; ++plane)
+  {
+    dstPlanes[plane] = videoPlane(input.get(), plane, dstStrides[plane]);
+  }
+
+  bool nv12 = input->type == DT_NV12VIDEO;
+  libyuv::FilterMode filter = libyuvMode(mode);
+
+  bandPool_->run(dstWidth, dstHeight, [&](uint16_t firstRow, uint16_t lastRow)
+  {
+    scalePlaneRows(srcPlanes[0], srcStrides[0], srcWidth, srcHeight,
+                   dstPlanes[0], dstStrides[0], dstWidth, dstHeight,
+                   firstRow, lastRow, false, filter);
+
+    // chroma has half the rows and the bands always start at an even row
+    uint32_t srcChromaWidth = (srcWidth + 1)/2;
+    uint32_t srcChromaHeight = (srcHeight + 1)/2;
+    uint32_t dstChromaWidth = (dstWidth + 1)/2;
+    uint32_t dstChromaHeight = (dstHeight + 1)/2;
+    uint32_t chromaFirst = firstRow/2;
+    uint32_t chromaLast = lastRow == dstHeight ? dstChromaHeight : lastRow/2;
+
+    for (unsigned int plane = 1; plane < planes; ++plane)
+    {
+      scalePlaneRows(srcPlanes[plane], srcStrides[plane], srcChromaWidth, srcChromaHeight,
+                     dstPlanes[plane], dstStrides[plane], dstChromaWidth, dstChromaHeight,
+                     chromaFirst, chromaLast, nv12, filter);
+    }
+  });
+
   return input;
 }
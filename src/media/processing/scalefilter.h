@@ -2,23 +2,54 @@
 
 #include "filter.h"
 
+#include <QMutex>
 #include <QSize>
 
-// A filter that can scale video frame.
+#include <functional>
+
+class RowBandPool;
+
+// A filter that scales YUV420 or NV12 video frames to the set resolution
+// without converting them to RGB. The frame is divided between the threads
+// of the conversion thread pool. Frames pass unchanged until a resolution
+// or a target size has been set.
+
+enum ScaleMode {SCALE_POINT, SCALE_BILINEAR, SCALE_BOX};
 
 class ScaleFilter : public Filter
 {
 public:
   ScaleFilter(QString id, StatisticsInterface *stats,
-              std::shared_ptr<ResourceAllocator> hwResources);
+              std::shared_ptr<ResourceAllocator> hwResources,
+              DataType format = DT_YUV420VIDEO);
 
+  // can be changed while running. The size is rounded down to even numbers
   void setResolution(QSize newResolution);
 
-  void process();
+  // box is the best for downscaling and is used by default
+  void setMode(ScaleMode mode);
+
+  // Follows the size the video is drawn at. The size is asked for each frame
+  // and the frame is downscaled close to it, but never upscaled. Replaces
+  // the set resolution.
+  void setTargetSize(std::function<QSize()> targetSize);
 
-  std::unique_ptr<Data> scaleFrame(std::unique_ptr<Data> input);
+protected:
+
+  void process();
 
 private:
 
+  // the output resolution for this frame, empty if the frame is not scaled
+  QSize outputSize(const Data& input);
+
+  std::unique_ptr<Data> scaleFrame(std::unique_ptr<Data> input, QSize size, ScaleMode mode);
+
+  std::shared_ptr<RowBandPool> bandPool_;
+
+  QMutex settingsMutex_;
   QSize newSize_;
+  ScaleMode mode_;
+
+  std::function<QSize()> targetSize_;
 };
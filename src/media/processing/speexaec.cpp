@@ -3,6 +3,7 @@
 #include <QSettings>
 
 #include "audioframebuffer.h"
+#include "framepool.h"
 
 #include "settingskeys.h"
 #include "common.h"
@@ -10,8 +11,9 @@
 #include "logger.h"
 
 
-SpeexAEC::SpeexAEC(QAudioFormat format):
+SpeexAEC::SpeexAEC(QAudioFormat format, std::shared_ptr<FramePool> pool):
   format_(format),
+  pool_(pool),
   samplesPerFrame_(format.sampleRate()/AUDIO_FRAMES_PER_SECOND),
   echo_state_(nullptr),
   preprocessor_(nullptr),
@@ -136,7 +138,7 @@ void SpeexAEC::cleanup()
 }
 
 
-std::unique_ptr<uchar[]> SpeexAEC::processInputFrame(std::unique_ptr<uchar[]> input,
+std::shared_ptr<uchar[]> SpeexAEC::processInputFrame(std::shared_ptr<uchar[]> input,
                                                      uint32_t dataSize)
 {
   if (enabled_)
@@ -167,7 +169,7 @@ std::unique_ptr<uchar[]> SpeexAEC::processInputFrame(std::unique_ptr<uchar[]> in
 
       if (echoFrame != nullptr)
       {
-        std::unique_ptr<uchar[]> pcmOutput = std::unique_ptr<uchar[]>(new uchar[dataSize]);
+        std::shared_ptr<uchar[]> pcmOutput = pool_->allocate(DT_RAWAUDIO, dataSize);
 
         speexMutex_.lock();
         if (echo_state_)
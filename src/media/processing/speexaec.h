@@ -11,19 +11,20 @@
 #include <deque>
 #include <memory>
 
+class FramePool;
 
 class SpeexAEC : public QObject
 {
   Q_OBJECT
 public:
-  SpeexAEC(QAudioFormat format);
+  SpeexAEC(QAudioFormat format, std::shared_ptr<FramePool> pool);
 
   void updateSettings();
 
   void init();
   void cleanup();
 
-  std::unique_ptr<uchar[]> processInputFrame(std::unique_ptr<uchar[]> input,
+  std::shared_ptr<uchar[]> processInputFrame(std::shared_ptr<uchar[]> input,
                                              uint32_t dataSize);
 
   void processEchoFrame(uint8_t *echo,
@@ -34,6 +35,7 @@ private:
   uint8_t* createEmptyFrame(uint32_t size);
 
   QAudioFormat format_;
+  std::shared_ptr<FramePool> pool_;
   uint32_t samplesPerFrame_;
 
   SpeexEchoState *echo_state_;
@@ -143,7 +143,7 @@ void SpeexDSP::cleanup()
 }
 
 
-std::unique_ptr<uchar[]> SpeexDSP::processInputFrame(std::unique_ptr<uchar[]> input,
+std::shared_ptr<uchar[]> SpeexDSP::processInputFrame(std::shared_ptr<uchar[]> input,
                                                      uint32_t dataSize)
 {
   if (dataSize != samplesPerFrame_*format_.bytesPerFrame())
@@ -27,7 +27,7 @@ public:
             int32_t agcLevel = 0, int agcMaxGain = 0);
   void cleanup();
 
-  std::unique_ptr<uchar[]> processInputFrame(std::unique_ptr<uchar[]> input,
+  std::shared_ptr<uchar[]> processInputFrame(std::shared_ptr<uchar[]> input,
                                              uint32_t dataSize);
 private:
 
@@ -11,7 +11,6 @@
 #include <string.h>
 
 #include <math.h>
-#include <omp.h> // for mt versions
 
 // For additional optimizations checks:
 // https://stackoverflow.com/questions/6121792/how-to-check-if-a-cpu-supports-the-sse3-instruction-set
@@ -69,105 +68,43 @@ bool is_sse41_available()
 // 32 bytes is enough for AVX2
 #define SIMD_ALIGNMENT 32
 
-int yuv420_to_rgb_i_avx2_mt(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height, uint8_t threads)
+// the same integer approximation of BT.601 as the vector versions
+static inline void yuv_to_rgb_pixel(uint8_t luma, uint8_t u, uint8_t v, uint8_t* out)
 {
- const int mini[8] = { 0,0,0,0,0,0,0,0 };
- const int middle[8] = { 128, 128, 128, 128,128, 128, 128, 128 };
- const int maxi[8] = { 255, 255, 255, 255,255, 255, 255, 255 };
+  int32_t cb = u - 128;
+  int32_t cr = v - 128;
 
- const __m256i min_val = _mm256_loadu_si256((__m256i const*)mini);
- const __m256i middle_val = _mm256_loadu_si256((__m256i const*)middle);
- const __m256i max_val = _mm256_loadu_si256((__m256i const*)maxi);
+  int32_t rpixel = cr + (cr >> 2) + (cr >> 3) + (cr >> 5);
+  int32_t gpixel = ((cb >> 2) + (cb >> 4) + (cb >> 5)) + ((cr >> 1) + (cr >> 3) + (cr >> 4) + (cr >> 5));
+  int32_t bpixel = cb + (cb >> 1) + (cb >> 2) + (cb >> 6);
 
- uint8_t *in_y_base = &input[0];;
- uint8_t *in_u_base = &input[width*height];;
- uint8_t *in_v_base = &input[width*height + (width*height >> 2)];
-
- __m128i luma_shufflemask_lo = _mm_set_epi8(-1, -1, -1, 3, -1, -1, -1, 2, -1, -1, -1, 1, -1, -1, -1, 0);
- __m128i luma_shufflemask_hi = _mm_set_epi8(-1, -1, -1, 7, -1, -1, -1, 6, -1, -1, -1, 5, -1, -1, -1, 4);
- __m128i chroma_shufflemask_lo = _mm_set_epi8(-1, -1, -1, 1, -1, -1, -1, 1, -1, -1, -1, 0, -1, -1, -1, 0);
- __m128i chroma_shufflemask_hi = _mm_set_epi8(-1, -1, -1, 3, -1, -1, -1, 3, -1, -1, -1, 2, -1, -1, -1, 2);
-
- // It seems the number of threads needs to be adjusted just before calling omp parrallel
- omp_set_num_threads(threads);
- #pragma omp parallel for
- for (int32_t i = 0; i < width*height; i += 16) {
-   uint8_t *out = output + 4*i;
-
-   int8_t row = i%(width*2) >= width ? 1 : 0;
-
-   uint8_t *in_y = in_y_base + i;
-
-   // Load 16 bytes (16 luma pixels)
-   __m128i y_a = _mm_loadu_si128((__m128i const*) in_y);
-
-   __m128i luma_lo = _mm_shuffle_epi8(y_a, luma_shufflemask_lo);
-   __m128i luma_hi = _mm_shuffle_epi8(y_a, luma_shufflemask_hi);
-   __m256i luma_a = _mm256_set_m128i(luma_hi, luma_lo);
-   __m256i chroma_u, chroma_v;
-
-   __m128i u_a, v_a;
-
-   int32_t temp = row?width/4:0;
-   uint8_t *in_u = in_u_base + ((i - i%width)/4) + (i%width)/2 - temp;
-   u_a = _mm_loadl_epi64((__m128i const*) in_u);
-   uint8_t *in_v = in_v_base + ((i - i%width)/4) + (i%width)/2 - temp;
-   v_a = _mm_loadl_epi64((__m128i const*) in_v);
-
-   __m128i chroma_u_lo = _mm_shuffle_epi8(u_a, chroma_shufflemask_lo);
-   __m128i chroma_u_hi = _mm_shuffle_epi8(u_a, chroma_shufflemask_hi);
-   chroma_u = _mm256_set_m128i(chroma_u_hi, chroma_u_lo);
-
-   __m128i chroma_v_lo = _mm_shuffle_epi8(v_a, chroma_shufflemask_lo);
-   __m128i chroma_v_hi = _mm_shuffle_epi8(v_a, chroma_shufflemask_hi);
-
-   chroma_v = _mm256_set_m128i(chroma_v_hi, chroma_v_lo);
-
-   __m256i r_pix_temp, temp_a, temp_b, g_pix_temp, b_pix_temp;
-
-   for (int ii = 0; ii < 2; ii++) {
-
-     chroma_u = _mm256_sub_epi32(chroma_u, middle_val);
-     chroma_v = _mm256_sub_epi32(chroma_v, middle_val);
-
-     r_pix_temp = _mm256_add_epi32(chroma_v, _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 2), _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 3), _mm256_srai_epi32(chroma_v, 5))));
-     temp_a = _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 2), _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 4), _mm256_srai_epi32(chroma_u, 5)));
-     temp_b = _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 1), _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 3), _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 4), _mm256_srai_epi32(chroma_v, 5))));
-     g_pix_temp = _mm256_add_epi32(temp_a, temp_b);
-     b_pix_temp = _mm256_add_epi32(chroma_u, _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 1), _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 2), _mm256_srai_epi32(chroma_u, 6))));
-
-     __m256i r_pix = _mm256_slli_epi32(_mm256_max_epi32(min_val, _mm256_min_epi32(max_val, _mm256_add_epi32(luma_a, r_pix_temp))), 16);
-     __m256i g_pix = _mm256_slli_epi32(_mm256_max_epi32(min_val, _mm256_min_epi32(max_val, _mm256_sub_epi32(luma_a, g_pix_temp))), 8);
-     __m256i b_pix = _mm256_max_epi32(min_val, _mm256_min_epi32(max_val, _mm256_add_epi32(luma_a, b_pix_temp)));
-
-     __m256i rgb = _mm256_adds_epu8(r_pix, _mm256_adds_epu8(g_pix, b_pix));
-
-     _mm256_storeu_si256((__m256i*)out, rgb);
-     out += 32;
+  out[0] = clamp_8bit(luma + bpixel);
+  out[1] = clamp_8bit(luma - gpixel);
+  out[2] = clamp_8bit(luma + rpixel);
+  out[3] = 0;
+}
 
-     if (ii != 1) {
-       u_a = _mm_srli_si128(u_a, 4);
-       v_a = _mm_srli_si128(v_a, 4);
-       __m128i chroma_u_lo = _mm_shuffle_epi8(u_a, chroma_shufflemask_lo);
-       __m128i chroma_u_hi = _mm_shuffle_epi8(u_a, chroma_shufflemask_hi);
-       chroma_u = _mm256_set_m128i(chroma_u_hi, chroma_u_lo);
 
-       __m128i chroma_v_lo = _mm_shuffle_epi8(v_a, chroma_shufflemask_lo);
-       __m128i chroma_v_hi = _mm_shuffle_epi8(v_a, chroma_shufflemask_hi);
+// Converts pixels [from, to) of one row. Used for the columns that do not
+// fill a whole vector and by the C version.
+static void yuv420_to_rgb_row_c(uint8_t* in_y, uint8_t* in_u, uint8_t* in_v, uint8_t* out,
+                                int from, int to)
+{
+  for (int x = from; x < to; ++x)
+  {
+    yuv_to_rgb_pixel(in_y[x], in_u[x/2], in_v[x/2], out + 4*x);
+  }
+}
 
-       chroma_v = _mm256_set_m128i(chroma_v_hi, chroma_v_lo);
 
-       y_a = _mm_srli_si128(y_a, 8);
-       __m128i luma_lo = _mm_shuffle_epi8(y_a, luma_shufflemask_lo);
-       __m128i luma_hi = _mm_shuffle_epi8(y_a, luma_shufflemask_hi);
-       luma_a = _mm256_set_m128i(luma_hi, luma_lo);
-     }
-   }
- }
- return 1;
+int yuv420_to_rgb_i_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
+{
+  return yuv420_to_rgb_i_avx2_rows(input, output, width, height, 0, height);
 }
 
-int yuv420_to_rgb_i_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
+
+int yuv420_to_rgb_i_avx2_rows(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                              uint16_t first_row, uint16_t last_row)
 {
   const int mini[8] = { 0,0,0,0,0,0,0,0 };
   const int middle[8] = { 128, 128, 128, 128,128, 128, 128, 128 };
@@ -187,118 +124,125 @@ int yuv420_to_rgb_i_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16
   uint8_t *row_b = (uint8_t*)ALIGNED_POINTER(row_b_temp, SIMD_ALIGNMENT);
 
 
-  uint8_t *in_y = &input[0];
-  uint8_t *in_u = &input[width*height];
-  uint8_t *in_v = &input[width*height + (width*height >> 2)];
-  uint8_t *out = output;
+  uint8_t *in_y_base = &input[0];
+  // odd sizes have the last chroma column and row of their own
+  const int32_t chroma_width = (width + 1)/2;
+  uint8_t *in_u_base = &input[width*height];
+  uint8_t *in_v_base = &input[width*height + chroma_width*((height + 1)/2)];
 
-  int8_t row = 0;
-  int32_t pix = 0;
+  // the rest of the row is done without vectors
+  const int32_t vector_width = width - width%16;
 
   __m128i luma_shufflemask_lo = _mm_set_epi8(-1, -1, -1, 3, -1, -1, -1, 2, -1, -1, -1, 1, -1, -1, -1, 0);
   __m128i luma_shufflemask_hi = _mm_set_epi8(-1, -1, -1, 7, -1, -1, -1, 6, -1, -1, -1, 5, -1, -1, -1, 4);
   __m128i chroma_shufflemask_lo = _mm_set_epi8(-1, -1, -1, 1, -1, -1, -1, 1, -1, -1, -1, 0, -1, -1, -1, 0);
   __m128i chroma_shufflemask_hi = _mm_set_epi8(-1, -1, -1, 3, -1, -1, -1, 3, -1, -1, -1, 2, -1, -1, -1, 2);
 
-  for (int32_t i = 0; i < width*height; i += 16) {
-
-    // Load 16 bytes (16 luma pixels)
-    __m128i y_a = _mm_loadu_si128((__m128i const*) in_y);
-    in_y += 16;
+  for (int32_t y = first_row; y < last_row; ++y) {
 
-    __m128i luma_lo = _mm_shuffle_epi8(y_a, luma_shufflemask_lo);
-    __m128i luma_hi = _mm_shuffle_epi8(y_a, luma_shufflemask_hi);
-    __m256i luma_a = _mm256_set_m128i(luma_hi, luma_lo);
-    __m256i chroma_u, chroma_v;
+    // chroma is calculated on even rows and reused on odd rows
+    int8_t row = y%2;
+    uint8_t *in_y = in_y_base + y*width;
+    uint8_t *in_u = in_u_base + (y/2)*chroma_width;
+    uint8_t *in_v = in_v_base + (y/2)*chroma_width;
+    uint8_t *out = output + y*width*4;
 
-    __m128i u_a  = _mm_set_epi8(0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0);
-    __m128i v_a  = _mm_set_epi8(0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0);
+    for (int32_t pix = 0; pix < vector_width; pix += 16) {
 
-    // For every second row
-    if (!row) {
+      // Load 16 bytes (16 luma pixels)
+      __m128i y_a = _mm_loadu_si128((__m128i const*) in_y);
+      in_y += 16;
 
-      u_a = _mm_loadl_epi64((__m128i const*) in_u);
-      in_u += 8;
+      __m128i luma_lo = _mm_shuffle_epi8(y_a, luma_shufflemask_lo);
+      __m128i luma_hi = _mm_shuffle_epi8(y_a, luma_shufflemask_hi);
+      __m256i luma_a = _mm256_set_m128i(luma_hi, luma_lo);
+      __m256i chroma_u, chroma_v;
 
-      v_a = _mm_loadl_epi64((__m128i const*) in_v);
-      in_v += 8;
+      __m128i u_a  = _mm_set_epi8(0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0);
+      __m128i v_a  = _mm_set_epi8(0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0);
 
+      // For every second row
+      if (!row) {
 
-      __m128i chroma_u_lo = _mm_shuffle_epi8(u_a, chroma_shufflemask_lo);
-      __m128i chroma_u_hi = _mm_shuffle_epi8(u_a, chroma_shufflemask_hi);
-      chroma_u = _mm256_set_m128i(chroma_u_hi, chroma_u_lo);
+        u_a = _mm_loadl_epi64((__m128i const*) in_u);
+        in_u += 8;
 
-      __m128i chroma_v_lo = _mm_shuffle_epi8(v_a, chroma_shufflemask_lo);
-      __m128i chroma_v_hi = _mm_shuffle_epi8(v_a, chroma_shufflemask_hi);
+        v_a = _mm_loadl_epi64((__m128i const*) in_v);
+        in_v += 8;
 
-      chroma_v = _mm256_set_m128i(chroma_v_hi, chroma_v_lo);
 
-    }
-    __m256i r_pix_temp, temp_a, temp_b, g_pix_temp, b_pix_temp;
+        __m128i chroma_u_lo = _mm_shuffle_epi8(u_a, chroma_shufflemask_lo);
+        __m128i chroma_u_hi = _mm_shuffle_epi8(u_a, chroma_shufflemask_hi);
+        chroma_u = _mm256_set_m128i(chroma_u_hi, chroma_u_lo);
 
-    for (int ii = 0; ii < 2; ii++) {
+        __m128i chroma_v_lo = _mm_shuffle_epi8(v_a, chroma_shufflemask_lo);
+        __m128i chroma_v_hi = _mm_shuffle_epi8(v_a, chroma_shufflemask_hi);
 
+        chroma_v = _mm256_set_m128i(chroma_v_hi, chroma_v_lo);
 
-      // We use the same chroma for two rows
-      if (row) {
-        r_pix_temp = _mm256_loadu_si256((__m256i const*)&row_r[pix * 4 + ii * 32]);
-        g_pix_temp = _mm256_loadu_si256((__m256i const*)&row_g[pix * 4 + ii * 32]);
-        b_pix_temp = _mm256_loadu_si256((__m256i const*)&row_b[pix * 4 + ii * 32]);
-      }
-      else {
-        chroma_u = _mm256_sub_epi32(chroma_u, middle_val);
-        chroma_v = _mm256_sub_epi32(chroma_v, middle_val);
-
-        r_pix_temp = _mm256_add_epi32(chroma_v, _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 2), _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 3), _mm256_srai_epi32(chroma_v, 5))));
-        temp_a = _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 2), _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 4), _mm256_srai_epi32(chroma_u, 5)));
-        temp_b = _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 1), _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 3), _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 4), _mm256_srai_epi32(chroma_v, 5))));
-        g_pix_temp = _mm256_add_epi32(temp_a, temp_b);
-        b_pix_temp = _mm256_add_epi32(chroma_u, _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 1), _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 2), _mm256_srai_epi32(chroma_u, 6))));
-
-        // Store results to be used for the next row
-        _mm256_storeu_si256((__m256i*)&row_r[pix * 4 + ii * 32], r_pix_temp);
-        _mm256_storeu_si256((__m256i*)&row_g[pix * 4 + ii * 32], g_pix_temp);
-        _mm256_storeu_si256((__m256i*)&row_b[pix * 4 + ii * 32], b_pix_temp);
       }
+      __m256i r_pix_temp, temp_a, temp_b, g_pix_temp, b_pix_temp;
 
+      for (int ii = 0; ii < 2; ii++) {
 
-      __m256i r_pix = _mm256_slli_epi32(_mm256_max_epi32(min_val, _mm256_min_epi32(max_val, _mm256_add_epi32(luma_a, r_pix_temp))), 16);
-      __m256i g_pix = _mm256_slli_epi32(_mm256_max_epi32(min_val, _mm256_min_epi32(max_val, _mm256_sub_epi32(luma_a, g_pix_temp))), 8);
-      __m256i b_pix = _mm256_max_epi32(min_val, _mm256_min_epi32(max_val, _mm256_add_epi32(luma_a, b_pix_temp)));
 
+        // We use the same chroma for two rows
+        if (row) {
+          r_pix_temp = _mm256_loadu_si256((__m256i const*)&row_r[pix * 4 + ii * 32]);
+          g_pix_temp = _mm256_loadu_si256((__m256i const*)&row_g[pix * 4 + ii * 32]);
+          b_pix_temp = _mm256_loadu_si256((__m256i const*)&row_b[pix * 4 + ii * 32]);
+        }
+        else {
+          chroma_u = _mm256_sub_epi32(chroma_u, middle_val);
+          chroma_v = _mm256_sub_epi32(chroma_v, middle_val);
 
-      __m256i rgb = _mm256_adds_epu8(r_pix, _mm256_adds_epu8(g_pix, b_pix));
+          r_pix_temp = _mm256_add_epi32(chroma_v, _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 2), _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 3), _mm256_srai_epi32(chroma_v, 5))));
+          temp_a = _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 2), _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 4), _mm256_srai_epi32(chroma_u, 5)));
+          temp_b = _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 1), _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 3), _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 4), _mm256_srai_epi32(chroma_v, 5))));
+          g_pix_temp = _mm256_add_epi32(temp_a, temp_b);
+          b_pix_temp = _mm256_add_epi32(chroma_u, _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 1), _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 2), _mm256_srai_epi32(chroma_u, 6))));
 
-      _mm256_storeu_si256((__m256i*)out, rgb);
-      out += 32;
+          // Store results to be used for the next row
+          _mm256_storeu_si256((__m256i*)&row_r[pix * 4 + ii * 32], r_pix_temp);
+          _mm256_storeu_si256((__m256i*)&row_g[pix * 4 + ii * 32], g_pix_temp);
+          _mm256_storeu_si256((__m256i*)&row_b[pix * 4 + ii * 32], b_pix_temp);
+        }
 
-      if (ii != 1) {
-        u_a = _mm_srli_si128(u_a, 4);
-        v_a = _mm_srli_si128(v_a, 4);
-        __m128i chroma_u_lo = _mm_shuffle_epi8(u_a, chroma_shufflemask_lo);
-        __m128i chroma_u_hi = _mm_shuffle_epi8(u_a, chroma_shufflemask_hi);
-        chroma_u = _mm256_set_m128i(chroma_u_hi, chroma_u_lo);
 
-        __m128i chroma_v_lo = _mm_shuffle_epi8(v_a, chroma_shufflemask_lo);
-        __m128i chroma_v_hi = _mm_shuffle_epi8(v_a, chroma_shufflemask_hi);
+        __m256i r_pix = _mm256_slli_epi32(_mm256_max_epi32(min_val, _mm256_min_epi32(max_val, _mm256_add_epi32(luma_a, r_pix_temp))), 16);
+        __m256i g_pix = _mm256_slli_epi32(_mm256_max_epi32(min_val, _mm256_min_epi32(max_val, _mm256_sub_epi32(luma_a, g_pix_temp))), 8);
+        __m256i b_pix = _mm256_max_epi32(min_val, _mm256_min_epi32(max_val, _mm256_add_epi32(luma_a, b_pix_temp)));
 
-        chroma_v = _mm256_set_m128i(chroma_v_hi, chroma_v_lo);
 
+        __m256i rgb = _mm256_adds_epu8(r_pix, _mm256_adds_epu8(g_pix, b_pix));
 
-        y_a = _mm_srli_si128(y_a, 8);
-        __m128i luma_lo = _mm_shuffle_epi8(y_a, luma_shufflemask_lo);
-        __m128i luma_hi = _mm_shuffle_epi8(y_a, luma_shufflemask_hi);
-        luma_a = _mm256_set_m128i(luma_hi, luma_lo);
-      }
-    }
+        _mm256_storeu_si256((__m256i*)out, rgb);
+        out += 32;
 
+        if (ii != 1) {
+          u_a = _mm_srli_si128(u_a, 4);
+          v_a = _mm_srli_si128(v_a, 4);
+          __m128i chroma_u_lo = _mm_shuffle_epi8(u_a, chroma_shufflemask_lo);
+          __m128i chroma_u_hi = _mm_shuffle_epi8(u_a, chroma_shufflemask_hi);
+          chroma_u = _mm256_set_m128i(chroma_u_hi, chroma_u_lo);
+
+          __m128i chroma_v_lo = _mm_shuffle_epi8(v_a, chroma_shufflemask_lo);
+          __m128i chroma_v_hi = _mm_shuffle_epi8(v_a, chroma_shufflemask_hi);
+
+          chroma_v = _mm256_set_m128i(chroma_v_hi, chroma_v_lo);
+
+
+          y_a = _mm_srli_si128(y_a, 8);
+          __m128i luma_lo = _mm_shuffle_epi8(y_a, luma_shufflemask_lo);
+          __m128i luma_hi = _mm_shuffle_epi8(y_a, luma_shufflemask_hi);
+          luma_a = _mm256_set_m128i(luma_hi, luma_lo);
+        }
+      }
 
-    // Track rows for chroma
-    pix += 16;
-    if (pix == width) {
-      row = !row;
-      pix = 0;
     }
+
+    yuv420_to_rgb_row_c(in_y_base + y*width, in_u_base + (y/2)*chroma_width, in_v_base + (y/2)*chroma_width,
+                        output + y*width*4, vector_width, width);
   }
 
   free(row_r_temp);
@@ -309,6 +253,13 @@ int yuv420_to_rgb_i_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16
 
 
 int yuv420_to_rgb_i_sse41(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
+{
+  return yuv420_to_rgb_i_sse41_rows(input, output, width, height, 0, height);
+}
+
+
+int yuv420_to_rgb_i_sse41_rows(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                               uint16_t first_row, uint16_t last_row)
 {
   const int mini[4] = { 0,0,0,0 };
   const int middle[4] = { 128, 128, 128, 128 };
@@ -322,95 +273,102 @@ int yuv420_to_rgb_i_sse41(uint8_t* input, uint8_t* output, uint16_t width, uint1
   uint8_t *row_g = (uint8_t *)malloc(width*4);
   uint8_t *row_b = (uint8_t *)malloc(width*4);
 
-  uint8_t *in_y = &input[0];
-  uint8_t *in_u = &input[width*height];
-  uint8_t *in_v = &input[width*height + (width*height >> 2)];
-  uint8_t *out = output;
+  uint8_t *in_y_base = &input[0];
+  // odd sizes have the last chroma column and row of their own
+  const int32_t chroma_width = (width + 1)/2;
+  uint8_t *in_u_base = &input[width*height];
+  uint8_t *in_v_base = &input[width*height + chroma_width*((height + 1)/2)];
 
-  int8_t row = 0;
-  int32_t pix = 0;
+  // the rest of the row is done without vectors
+  const int32_t vector_width = width - width%16;
 
   __m128i luma_shufflemask = _mm_set_epi8(-1, -1, -1, 3, -1, -1, -1, 2, -1, -1, -1, 1, -1, -1, -1, 0);
   __m128i chroma_shufflemask = _mm_set_epi8(-1, -1, -1, 1, -1, -1, -1, 1, -1, -1, -1, 0, -1, -1, -1, 0);
 
-  for (int32_t i = 0; i < width*height; i += 16) {
+  for (int32_t y = first_row; y < last_row; ++y) {
 
-    // Load 16 bytes (16 luma pixels)
-    __m128i y_a = _mm_loadu_si128((__m128i const*) in_y);
-    in_y += 16;
+    // chroma is calculated on even rows and reused on odd rows
+    int8_t row = y%2;
+    uint8_t *in_y = in_y_base + y*width;
+    uint8_t *in_u = in_u_base + (y/2)*chroma_width;
+    uint8_t *in_v = in_v_base + (y/2)*chroma_width;
+    uint8_t *out = output + y*width*4;
 
+    for (int32_t pix = 0; pix < vector_width; pix += 16) {
 
-    __m128i luma_a = _mm_shuffle_epi8(y_a, luma_shufflemask);
-    __m128i u_a, v_a, chroma_u, chroma_v;
+      // Load 16 bytes (16 luma pixels)
+      __m128i y_a = _mm_loadu_si128((__m128i const*) in_y);
+      in_y += 16;
 
-    // For every second row
-    if (!row) {
-      u_a = _mm_loadl_epi64((__m128i const*) in_u);
-      in_u += 8;
 
-      v_a = _mm_loadl_epi64((__m128i const*) in_v);
-      in_v += 8;
+      __m128i luma_a = _mm_shuffle_epi8(y_a, luma_shufflemask);
+      __m128i u_a, v_a, chroma_u, chroma_v;
 
-      chroma_u = _mm_shuffle_epi8(u_a, chroma_shufflemask);
-      chroma_v = _mm_shuffle_epi8(v_a, chroma_shufflemask);
+      // For every second row
+      if (!row) {
+        u_a = _mm_loadl_epi64((__m128i const*) in_u);
+        in_u += 8;
 
-    }
-    __m128i r_pix_temp, temp_a, temp_b, g_pix_temp, b_pix_temp;
-
-    for (int ii = 0; ii < 4; ii++) {
+        v_a = _mm_loadl_epi64((__m128i const*) in_v);
+        in_v += 8;
 
+        chroma_u = _mm_shuffle_epi8(u_a, chroma_shufflemask);
+        chroma_v = _mm_shuffle_epi8(v_a, chroma_shufflemask);
 
-      // We use the same chroma for two rows
-      if (row) {
-        r_pix_temp = _mm_loadu_si128((__m128i const*)&row_r[pix * 4 + ii * 16]);
-        g_pix_temp = _mm_loadu_si128((__m128i const*)&row_g[pix * 4 + ii * 16]);
-        b_pix_temp = _mm_loadu_si128((__m128i const*)&row_b[pix * 4 + ii * 16]);
-      }
-      else {
-        chroma_u = _mm_sub_epi32(chroma_u, middle_val);
-        chroma_v = _mm_sub_epi32(chroma_v, middle_val);
-
-        r_pix_temp = _mm_add_epi32(chroma_v, _mm_add_epi32(_mm_srai_epi32(chroma_v, 2), _mm_add_epi32(_mm_srai_epi32(chroma_v, 3), _mm_srai_epi32(chroma_v, 5))));
-        temp_a = _mm_add_epi32(_mm_srai_epi32(chroma_u, 2), _mm_add_epi32(_mm_srai_epi32(chroma_u, 4), _mm_srai_epi32(chroma_u, 5)));
-        temp_b = _mm_add_epi32(_mm_srai_epi32(chroma_v, 1), _mm_add_epi32(_mm_srai_epi32(chroma_v, 3), _mm_add_epi32(_mm_srai_epi32(chroma_v, 4), _mm_srai_epi32(chroma_v, 5))));
-        g_pix_temp = _mm_add_epi32(temp_a, temp_b);
-        b_pix_temp = _mm_add_epi32(chroma_u, _mm_add_epi32(_mm_srai_epi32(chroma_u, 1), _mm_add_epi32(_mm_srai_epi32(chroma_u, 2), _mm_srai_epi32(chroma_u, 6))));
-
-        // Store results to be used for the next row
-        _mm_storeu_si128((__m128i*)&row_r[pix * 4 + ii * 16], r_pix_temp);
-        _mm_storeu_si128((__m128i*)&row_g[pix * 4 + ii * 16], g_pix_temp);
-        _mm_storeu_si128((__m128i*)&row_b[pix * 4 + ii * 16], b_pix_temp);
       }
+      __m128i r_pix_temp, temp_a, temp_b, g_pix_temp, b_pix_temp;
 
+      for (int ii = 0; ii < 4; ii++) {
 
-      __m128i r_pix = _mm_slli_epi32(_mm_max_epi32(min_val, _mm_min_epi32(max_val, _mm_add_epi32(luma_a, r_pix_temp))), 16);
-      __m128i g_pix = _mm_slli_epi32(_mm_max_epi32(min_val, _mm_min_epi32(max_val, _mm_sub_epi32(luma_a, g_pix_temp))), 8);
-      __m128i b_pix = _mm_max_epi32(min_val, _mm_min_epi32(max_val, _mm_add_epi32(luma_a, b_pix_temp)));
 
+        // We use the same chroma for two rows
+        if (row) {
+          r_pix_temp = _mm_loadu_si128((__m128i const*)&row_r[pix * 4 + ii * 16]);
+          g_pix_temp = _mm_loadu_si128((__m128i const*)&row_g[pix * 4 + ii * 16]);
+          b_pix_temp = _mm_loadu_si128((__m128i const*)&row_b[pix * 4 + ii * 16]);
+        }
+        else {
+          chroma_u = _mm_sub_epi32(chroma_u, middle_val);
+          chroma_v = _mm_sub_epi32(chroma_v, middle_val);
 
-      __m128i rgb = _mm_adds_epu8(r_pix, _mm_adds_epu8(g_pix, b_pix));
+          r_pix_temp = _mm_add_epi32(chroma_v, _mm_add_epi32(_mm_srai_epi32(chroma_v, 2), _mm_add_epi32(_mm_srai_epi32(chroma_v, 3), _mm_srai_epi32(chroma_v, 5))));
+          temp_a = _mm_add_epi32(_mm_srai_epi32(chroma_u, 2), _mm_add_epi32(_mm_srai_epi32(chroma_u, 4), _mm_srai_epi32(chroma_u, 5)));
+          temp_b = _mm_add_epi32(_mm_srai_epi32(chroma_v, 1), _mm_add_epi32(_mm_srai_epi32(chroma_v, 3), _mm_add_epi32(_mm_srai_epi32(chroma_v, 4), _mm_srai_epi32(chroma_v, 5))));
+          g_pix_temp = _mm_add_epi32(temp_a, temp_b);
+          b_pix_temp = _mm_add_epi32(chroma_u, _mm_add_epi32(_mm_srai_epi32(chroma_u, 1), _mm_add_epi32(_mm_srai_epi32(chroma_u, 2), _mm_srai_epi32(chroma_u, 6))));
 
-      _mm_storeu_si128((__m128i*)out, rgb);
-      out += 16;
+          // Store results to be used for the next row
+          _mm_storeu_si128((__m128i*)&row_r[pix * 4 + ii * 16], r_pix_temp);
+          _mm_storeu_si128((__m128i*)&row_g[pix * 4 + ii * 16], g_pix_temp);
+          _mm_storeu_si128((__m128i*)&row_b[pix * 4 + ii * 16], b_pix_temp);
+        }
 
-      if (ii != 3) {
-        u_a = _mm_srli_si128(u_a, 2);
-        v_a = _mm_srli_si128(v_a, 2);
-        chroma_u = _mm_shuffle_epi8(u_a, chroma_shufflemask);
-        chroma_v = _mm_shuffle_epi8(v_a, chroma_shufflemask);
 
-        y_a = _mm_srli_si128(y_a, 4);
-        luma_a = _mm_shuffle_epi8(y_a, luma_shufflemask);
-      }
-    }
+        __m128i r_pix = _mm_slli_epi32(_mm_max_epi32(min_val, _mm_min_epi32(max_val, _mm_add_epi32(luma_a, r_pix_temp))), 16);
+        __m128i g_pix = _mm_slli_epi32(_mm_max_epi32(min_val, _mm_min_epi32(max_val, _mm_sub_epi32(luma_a, g_pix_temp))), 8);
+        __m128i b_pix = _mm_max_epi32(min_val, _mm_min_epi32(max_val, _mm_add_epi32(luma_a, b_pix_temp)));
 
 
-    // Track rows for chroma
-    pix += 16;
-    if (pix == width) {
-      row = !row;
-      pix = 0;
+        __m128i rgb = _mm_adds_epu8(r_pix, _mm_adds_epu8(g_pix, b_pix));
+
+        _mm_storeu_si128((__m128i*)out, rgb);
+        out += 16;
+
+        if (ii != 3) {
+          u_a = _mm_srli_si128(u_a, 2);
+          v_a = _mm_srli_si128(v_a, 2);
+          chroma_u = _mm_shuffle_epi8(u_a, chroma_shufflemask);
+          chroma_v = _mm_shuffle_epi8(v_a, chroma_shufflemask);
+
+          y_a = _mm_srli_si128(y_a, 4);
+          luma_a = _mm_shuffle_epi8(y_a, luma_shufflemask);
+        }
+      }
+
     }
+
+    yuv420_to_rgb_row_c(in_y_base + y*width, in_u_base + (y/2)*chroma_width, in_v_base + (y/2)*chroma_width,
+                        output + y*width*4, vector_width, width);
   }
 
   free(row_r);
@@ -422,207 +380,166 @@ int yuv420_to_rgb_i_sse41(uint8_t* input, uint8_t* output, uint16_t width, uint1
 
 void yuv420_to_rgb_i_c(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
 {
-  // Luma pixels
-  for(int i = 0; i < width*height; ++i)
-  {
-    output[i*4] = input[i];
-    output[i*4+1] = input[i];
-    output[i*4+2] = input[i];
-  }
-
-  uint32_t u_offset = width*height;
-  uint32_t v_offset = width*height + height*width/4;
-
-  for(int y = 0; y < height/2; ++y)
-  {
-    for(int x = 0; x < width/2; ++x)
-    {
-      int32_t cr = input[x + y*width/2 + u_offset] - 128;
-      int32_t cb = input[x + y*width/2 + v_offset] - 128;
-
-      int32_t rpixel = cr + (cr >> 2) + (cr >> 3) + (cr >> 5);
-      int32_t gpixel = - ((cb >> 2) + (cb >> 4) + (cb >> 5)) - ((cr >> 1)+(cr >> 3)+(cr >> 4)+(cr >> 5));
-      int32_t bpixel = cb + (cb >> 1)+(cb >> 2)+(cb >> 6);
-
-      int32_t row      = 8*y*width;
-      int32_t next_row = row + 4*width;
-
-      // add chroma components to rgb pixels
-      // R
-      int32_t pixel_value = 0;
-
-      pixel_value                = output[8*x + row ] + rpixel;
-      output[8*x + row]          = clamp_8bit(pixel_value);
-
-      pixel_value                = output[8*x + 4 + row ] + rpixel;
-      output[8*x + 4 + row]      = clamp_8bit(pixel_value);
-
-      pixel_value                = output[8*x +     next_row] + rpixel;
-      output[8*x + next_row]     = clamp_8bit(pixel_value);
-
-      pixel_value                = output[8*x + 4 + next_row] + rpixel;
-      output[8*x + 4 + next_row] = clamp_8bit(pixel_value);
-
-      // G
-      pixel_value                = output[8*x + row + 1] + gpixel;
-      output[8*x + row + 1]      = clamp_8bit(pixel_value);
-
-      pixel_value                = output[8*x + 4 + row + 1] + gpixel;
-      output[8*x + 4 + row + 1]  = clamp_8bit(pixel_value);
-
-      pixel_value                = output[8*x +  next_row + 1] + gpixel;
-      output[8*x + next_row + 1] = clamp_8bit(pixel_value);
-
-      pixel_value                    = output[8*x + 4 + next_row + 1] + gpixel;
-      output[8*x + 4 + next_row + 1] = clamp_8bit(pixel_value);
-
-      // B
-      pixel_value                = output[8*x + row + 2] + bpixel;
-      output[8*x + row + 2]      = clamp_8bit(pixel_value);
+  yuv420_to_rgb_i_c_rows(input, output, width, height, 0, height);
+}
 
-      pixel_value                = output[8*x + 4 + row + 2] + bpixel;
-      output[8*x + 4 + row + 2]  = clamp_8bit(pixel_value);
 
-      pixel_value                = output[8*x + next_row + 2] + bpixel;
-      output[8*x + next_row + 2] = clamp_8bit(pixel_value);
+void yuv420_to_rgb_i_c_rows(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                            uint16_t first_row, uint16_t last_row)
+{
+  const int32_t chroma_width = (width + 1)/2;
+  uint8_t* in_u = input + width*height;
+  uint8_t* in_v = input + width*height + chroma_width*((height + 1)/2);
 
-      pixel_value                    = output[8*x + 4 + next_row + 2] + bpixel;
-      output[8*x + 4 + next_row + 2] = clamp_8bit(pixel_value);
-    }
+  for (int y = first_row; y < last_row; ++y)
+  {
+    yuv420_to_rgb_row_c(input + y*width, in_u + (y/2)*chroma_width, in_v + (y/2)*chroma_width,
+                        output + y*width*4, 0, width);
   }
 }
 
 
-int rgb_to_yuv420_i_sse41_mt(uint8_t* input, uint8_t* output, int width, int height, int threads)
+// Picks the pixels of one output row with nearest neighbour sampling so that
+// each output pixel has its own luma and chroma value.
+static void sample_scaled_row(uint8_t* input, uint16_t width, uint16_t height,
+                              uint16_t out_height, int out_y, bool flip_vertically,
+                              const int32_t* columns, uint16_t out_width,
+                              uint8_t* row_y, uint8_t* row_u, uint8_t* row_v)
 {
-  const int r_mul_y[4] = { 76, 76, 76, 76 };
-  const int r_mul_u[4] = { -43, -43, -43, -43 };
-  const int r_mul_v[4] = { 127, 127, 127, 127 };
-
-  const int g_mul_y[4] = { 150, 150, 150, 150 };
-  const int g_mul_u[4] = { -84, -84, -84, -84 };
-  const int g_mul_v[4] = { -106, -106, -106, -106 };
-
-  const int b_mul_y[4] = { 29, 29, 29, 29 };
-  const int b_mul_u[4] = { 127, 127, 127, 127 };
-  const int b_mul_v[4] = { -21, -21, -21, -21 };
-
-  const __m128i r_y = _mm_loadu_si128((__m128i const*)r_mul_y);
-  const __m128i r_u = _mm_loadu_si128((__m128i const*)r_mul_u);
-  const __m128i r_v = _mm_loadu_si128((__m128i const*)r_mul_v);
-
-  const __m128i g_y = _mm_loadu_si128((__m128i const*)g_mul_y);
-  const __m128i g_u = _mm_loadu_si128((__m128i const*)g_mul_u);
-  const __m128i g_v = _mm_loadu_si128((__m128i const*)g_mul_v);
-
-  const __m128i b_y = _mm_loadu_si128((__m128i const*)b_mul_y);
-  const __m128i b_u = _mm_loadu_si128((__m128i const*)b_mul_u);
-  const __m128i b_v = _mm_loadu_si128((__m128i const*)b_mul_v);
-
-  const int mini[4] = { 0,0,0,0 };
-  const int maxi[4] = { 255, 255, 255, 255 };
+  // sample from the middle of the area the output pixel covers
+  int in_y = ((2*out_y + 1)*height)/(2*out_height);
+  if (flip_vertically)
+  {
+    in_y = height - 1 - in_y;
+  }
 
-  const int chroma_offset[4] = { 255 * 255, 255 * 255, 255 * 255, 255 * 255 };
+  const int32_t chroma_width = (width + 1)/2;
+  uint8_t* in_luma = input + in_y*width;
+  uint8_t* in_u = input + width*height + (in_y/2)*chroma_width;
+  uint8_t* in_v = input + width*height + chroma_width*((height + 1)/2) + (in_y/2)*chroma_width;
 
-  const __m128i min_val = _mm_loadu_si128((__m128i const*)mini);
-  const __m128i max_val = _mm_loadu_si128((__m128i const*)maxi);
-  const __m128i cr_offset = _mm_loadu_si128((__m128i const*)chroma_offset);
-
-  //*output = (uint8_t *)malloc(width*height + width*height);
-  uint8_t *out_y = &output[width*height-width];
+  for (int x = 0; x < out_width; ++x)
+  {
+    row_y[x] = in_luma[columns[x]];
+    row_u[x] = in_u[columns[x]/2];
+    row_v[x] = in_v[columns[x]/2];
+  }
+}
 
-  __m128i shufflemask = _mm_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 12, 8, 4, 0);
-  __m128i shufflemask_chroma = _mm_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 8, 0);
 
-  __m128i shufflemask_b = _mm_set_epi8(-1, -1, -1, 12, -1, -1, -1, 8, -1, -1, -1, 4, -1, -1, -1, 0);
-  __m128i shufflemask_g = _mm_set_epi8(-1, -1, -1, 13, -1, -1, -1, 9, -1, -1, -1, 5, -1, -1, -1, 1);
-  __m128i shufflemask_r = _mm_set_epi8(-1, -1, -1, 14, -1, -1, -1, 10, -1, -1, -1, 6, -1, -1, -1, 2);
+// the input column of each output column, reversed if mirrored
+static int32_t* scaled_columns(uint16_t width, uint16_t out_width, bool mirror_horizontally)
+{
+  int32_t* columns = (int32_t*)malloc(out_width*sizeof(int32_t));
 
-  // It seems the number of threads needs to be adjusted just before calling omp parrallel
-  omp_set_num_threads(threads);
-  #pragma omp parallel for
-  for (int32_t i = 0; i < width*height << 2; i += 16) {
+  for (int x = 0; x < out_width; ++x)
+  {
+    int in_x = ((2*x + 1)*width)/(2*out_width);
+    columns[x] = mirror_horizontally ? width - 1 - in_x : in_x;
+  }
 
-    uint8_t *in = input + i;
+  return columns;
+}
 
-    // Load 16 bytes (4 pixels)
-    const __m128i a = _mm_loadu_si128((__m128i const*) in);
 
-    __m128i b = _mm_shuffle_epi8(a, shufflemask_b);
-    __m128i g = _mm_shuffle_epi8(a, shufflemask_g);
-    __m128i r = _mm_shuffle_epi8(a, shufflemask_r);
+void yuv420_to_rgb_scaled_c(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                            uint16_t out_width, uint16_t out_height,
+                            bool mirror_horizontally, bool flip_vertically)
+{
+  yuv420_to_rgb_scaled_c_rows(input, output, width, height, out_width, out_height,
+                              mirror_horizontally, flip_vertically, 0, out_height);
+}
 
-    __m128i res_y = _mm_max_epi32(min_val, _mm_min_epi32(
-                                    max_val, _mm_srai_epi32(
-                                      _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(r, r_y), _mm_mullo_epi32(g, g_y)),
-                                                    _mm_mullo_epi32(b, b_y)), 8)));
 
-    __m128i temp_y = _mm_shuffle_epi8(res_y, shufflemask);
+void yuv420_to_rgb_scaled_c_rows(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                                 uint16_t out_width, uint16_t out_height,
+                                 bool mirror_horizontally, bool flip_vertically,
+                                 uint16_t first_row, uint16_t last_row)
+{
+  int32_t* columns = scaled_columns(width, out_width, mirror_horizontally);
+  uint8_t* row_y = (uint8_t*)malloc(out_width*3);
+  uint8_t* row_u = row_y + out_width;
+  uint8_t* row_v = row_u + out_width;
 
-    // this takes advantage of losing the remainder when dividing with width.
-    uint8_t *y_place = out_y + 4*i/16 - (((i/16 - 1)*4)/width)*2*width;
+  for (int y = first_row; y < last_row; ++y)
+  {
+    sample_scaled_row(input, width, height, out_height, y, flip_vertically,
+                      columns, out_width, row_y, row_u, row_v);
 
-    if (i == 0)
+    uint8_t* out = output + y*out_width*4;
+    for (int x = 0; x < out_width; ++x)
     {
-      y_place = out_y;
+      yuv_to_rgb_pixel(row_y[x], row_u[x], row_v[x], out + 4*x);
     }
-
-    memcpy(y_place, &temp_y, 4);
   }
 
-  uint8_t *out_u = &output[width*height + (width*height>>2) - (width>>1)];
-  uint8_t *out_v = &out_u[width*height >> 2];
+  free(row_y);
+  free(columns);
+}
 
-  omp_set_num_threads(threads);
-  #pragma omp parallel for
-  for (int i = 0; i < width*height * 4; i += 2 * width * 4)
-  {
-    for (int j = i; j < i + width * 4; j += 4 * 4)
-    {
-      const __m128i a = _mm_loadu_si128((__m128i const*)&input[j]);
-      const __m128i a2 = _mm_loadu_si128((__m128i const*)&input[j+ width * 4]);
 
-      __m128i b = _mm_shuffle_epi8(a, shufflemask_b);
-      __m128i g = _mm_shuffle_epi8(a, shufflemask_g);
-      __m128i r = _mm_shuffle_epi8(a, shufflemask_r);
+int yuv420_to_rgb_scaled_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                              uint16_t out_width, uint16_t out_height,
+                              bool mirror_horizontally, bool flip_vertically)
+{
+  return yuv420_to_rgb_scaled_avx2_rows(input, output, width, height, out_width, out_height,
+                                        mirror_horizontally, flip_vertically, 0, out_height);
+}
 
-      __m128i b2 = _mm_shuffle_epi8(a2, shufflemask_b);
-      __m128i g2 = _mm_shuffle_epi8(a2, shufflemask_g);
-      __m128i r2 = _mm_shuffle_epi8(a2, shufflemask_r);
 
-      __m128i r_sum = _mm_add_epi32(r, r2);
-      __m128i g_sum = _mm_add_epi32(g, g2);
-      __m128i b_sum = _mm_add_epi32(b, b2);
+int yuv420_to_rgb_scaled_avx2_rows(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                                   uint16_t out_width, uint16_t out_height,
+                                   bool mirror_horizontally, bool flip_vertically,
+                                   uint16_t first_row, uint16_t last_row)
+{
+  const __m256i min_val = _mm256_set1_epi32(0);
+  const __m256i middle_val = _mm256_set1_epi32(128);
+  const __m256i max_val = _mm256_set1_epi32(255);
 
-      __m128i res_u_b = _mm_add_epi32(_mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(r_sum, r_u),
-                                                                  _mm_mullo_epi32(g_sum, g_u)),
-                                                    _mm_mullo_epi32(b_sum, b_u)), cr_offset);
-      __m128i res_u_tmp = _mm_max_epi32(min_val, _mm_min_epi32(max_val, _mm_srai_epi32(res_u_b, 9)));
+  int32_t* columns = scaled_columns(width, out_width, mirror_horizontally);
+  uint8_t* row_y = (uint8_t*)malloc(out_width*3);
+  uint8_t* row_u = row_y + out_width;
+  uint8_t* row_v = row_u + out_width;
 
-      __m128i res_u = _mm_srai_epi32(_mm_add_epi32(_mm_shuffle_epi32(res_u_tmp, 0xb1), res_u_tmp), 1);
-      __m128i temp_u = _mm_shuffle_epi8(res_u, shufflemask_chroma);
+  for (int y = first_row; y < last_row; ++y)
+  {
+    sample_scaled_row(input, width, height, out_height, y, flip_vertically,
+                      columns, out_width, row_y, row_u, row_v);
 
+    uint8_t* out = output + y*out_width*4;
 
-      uint32_t i_laps = i/(2 * width * 4);
-      uint32_t j_laps_per_i = 4*width/16;
-      uint32_t j_laps = (j - i)/16;
+    // the sampled row has all three components for every pixel, so the
+    // conversion is the same as in yuv420_to_rgb_i_avx2 without chroma reuse
+    int x = 0;
+    for (; x + 8 <= out_width; x += 8)
+    {
+      __m256i luma_a = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i const*)(row_y + x)));
+      __m256i chroma_u = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i const*)(row_u + x))), middle_val);
+      __m256i chroma_v = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i const*)(row_v + x))), middle_val);
 
-      int32_t loopPlace = 2*(i_laps*j_laps_per_i + j_laps) - ((i_laps*j_laps_per_i + j_laps)/(width/4))*width;
-      memcpy(out_u + loopPlace, &temp_u, 2);
+      __m256i r_pix_temp = _mm256_add_epi32(chroma_v, _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 2), _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 3), _mm256_srai_epi32(chroma_v, 5))));
+      __m256i temp_a = _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 2), _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 4), _mm256_srai_epi32(chroma_u, 5)));
+      __m256i temp_b = _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 1), _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 3), _mm256_add_epi32(_mm256_srai_epi32(chroma_v, 4), _mm256_srai_epi32(chroma_v, 5))));
+      __m256i g_pix_temp = _mm256_add_epi32(temp_a, temp_b);
+      __m256i b_pix_temp = _mm256_add_epi32(chroma_u, _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 1), _mm256_add_epi32(_mm256_srai_epi32(chroma_u, 2), _mm256_srai_epi32(chroma_u, 6))));
 
-      __m128i res_v_b = _mm_add_epi32(_mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(r_sum, r_v), _mm_mullo_epi32(g_sum, g_v)),
-                                                    _mm_mullo_epi32(b_sum, b_v)), cr_offset);
+      __m256i r_pix = _mm256_slli_epi32(_mm256_max_epi32(min_val, _mm256_min_epi32(max_val, _mm256_add_epi32(luma_a, r_pix_temp))), 16);
+      __m256i g_pix = _mm256_slli_epi32(_mm256_max_epi32(min_val, _mm256_min_epi32(max_val, _mm256_sub_epi32(luma_a, g_pix_temp))), 8);
+      __m256i b_pix = _mm256_max_epi32(min_val, _mm256_min_epi32(max_val, _mm256_add_epi32(luma_a, b_pix_temp)));
 
-      __m128i res_v_tmp = _mm_max_epi32(min_val, _mm_min_epi32(max_val, _mm_srai_epi32(res_v_b, 9)));
+      __m256i rgb = _mm256_or_si256(r_pix, _mm256_or_si256(g_pix, b_pix));
 
-      __m128i res_v = _mm_srai_epi32(_mm_add_epi32(_mm_shuffle_epi32(res_v_tmp, 0xb1), res_v_tmp), 1);
-      __m128i temp_v = _mm_shuffle_epi8(res_v, shufflemask_chroma);
+      _mm256_storeu_si256((__m256i*)(out + 4*x), rgb);
+    }
 
-      memcpy(out_v + loopPlace, &temp_v, 2);
+    for (; x < out_width; ++x)
+    {
+      yuv_to_rgb_pixel(row_y[x], row_u[x], row_v[x], out + 4*x);
     }
   }
 
-  //_mm_empty();
+  free(row_y);
+  free(columns);
   return 1;
 }
 
@@ -797,6 +714,126 @@ void rgb_to_yuv420_i_c(uint8_t* input, uint8_t* output, uint16_t width, uint16_t
 }
 
 
+int rgb_to_yuv420_i_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
+{
+  uint8_t* lumaY   = output;
+  uint8_t* chromaU = output + width*height;
+  uint8_t* chromaV = output + width*height + width*height/4;
+
+  const __m256i byte_mask = _mm256_set1_epi32(0xff);
+
+  // the same weights as in the C version, which weighs the first byte of
+  // luma as red although chroma uses it as blue
+  const __m256i y_b = _mm256_set1_epi32(76);
+  const __m256i y_g = _mm256_set1_epi32(150);
+  const __m256i y_r = _mm256_set1_epi32(29);
+  const __m256i y_round = _mm256_set1_epi32(128);
+
+  const __m256i u_b = _mm256_set1_epi32(127);
+  const __m256i u_g = _mm256_set1_epi32(-84);
+  const __m256i u_r = _mm256_set1_epi32(-43);
+
+  const __m256i v_b = _mm256_set1_epi32(-21);
+  const __m256i v_g = _mm256_set1_epi32(-106);
+  const __m256i v_r = _mm256_set1_epi32(127);
+
+  const __m256i chroma_round = _mm256_set1_epi32(512);
+  const __m256i chroma_offset = _mm256_set1_epi32(128);
+
+  // the lowest byte of each 32-bit value to the beginning of the lane and
+  // the lanes next to each other
+  const __m256i pack_bytes = _mm256_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 12, 8, 4, 0,
+                                             -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 12, 8, 4, 0);
+  const __m256i pack_lanes = _mm256_set_epi32(7, 6, 5, 3, 2, 1, 4, 0);
+  const __m128i pack_chroma = _mm_set_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 5, 4, 1, 0);
+
+  for (int y = 0; y < height; y += 2)
+  {
+    uint8_t* row = input + y*width*4;
+    uint8_t* next_row = row + width*4;
+
+    int x = 0;
+
+    // 8 pixels from both rows at a time
+    for (; x + 8 <= width; x += 8)
+    {
+      __m256i a = _mm256_loadu_si256((__m256i const*)(row + x*4));
+      __m256i a2 = _mm256_loadu_si256((__m256i const*)(next_row + x*4));
+
+      __m256i b  = _mm256_and_si256(a, byte_mask);
+      __m256i g  = _mm256_and_si256(_mm256_srli_epi32(a, 8), byte_mask);
+      __m256i r  = _mm256_and_si256(_mm256_srli_epi32(a, 16), byte_mask);
+
+      __m256i b2 = _mm256_and_si256(a2, byte_mask);
+      __m256i g2 = _mm256_and_si256(_mm256_srli_epi32(a2, 8), byte_mask);
+      __m256i r2 = _mm256_and_si256(_mm256_srli_epi32(a2, 16), byte_mask);
+
+      __m256i res_y = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(b, y_b),
+                                                                          _mm256_mullo_epi32(g, y_g)),
+                                                         _mm256_add_epi32(_mm256_mullo_epi32(r, y_r), y_round)), 8);
+      __m256i res_y2 = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(b2, y_b),
+                                                                           _mm256_mullo_epi32(g2, y_g)),
+                                                          _mm256_add_epi32(_mm256_mullo_epi32(r2, y_r), y_round)), 8);
+
+      res_y = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(res_y, pack_bytes), pack_lanes);
+      res_y2 = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(res_y2, pack_bytes), pack_lanes);
+
+      _mm_storel_epi64((__m128i*)(lumaY + y*width + x), _mm256_castsi256_si128(res_y));
+      _mm_storel_epi64((__m128i*)(lumaY + (y + 1)*width + x), _mm256_castsi256_si128(res_y2));
+
+      // sum of the 2x2 block is in the first two values of each lane
+      __m256i b_sum = _mm256_add_epi32(b, b2);
+      __m256i g_sum = _mm256_add_epi32(g, g2);
+      __m256i r_sum = _mm256_add_epi32(r, r2);
+      b_sum = _mm256_hadd_epi32(b_sum, b_sum);
+      g_sum = _mm256_hadd_epi32(g_sum, g_sum);
+      r_sum = _mm256_hadd_epi32(r_sum, r_sum);
+
+      __m256i res_u = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(b_sum, u_b),
+                                                        _mm256_mullo_epi32(g_sum, u_g)),
+                                       _mm256_add_epi32(_mm256_mullo_epi32(r_sum, u_r), chroma_round));
+      res_u = _mm256_add_epi32(_mm256_srai_epi32(res_u, 10), chroma_offset);
+
+      __m256i res_v = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(b_sum, v_b),
+                                                        _mm256_mullo_epi32(g_sum, v_g)),
+                                       _mm256_add_epi32(_mm256_mullo_epi32(r_sum, v_r), chroma_round));
+      res_v = _mm256_add_epi32(_mm256_srai_epi32(res_v, 10), chroma_offset);
+
+      // only the first two values of each lane are different
+      res_u = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(res_u, pack_bytes), pack_lanes);
+      res_v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(res_v, pack_bytes), pack_lanes);
+
+      uint32_t u_pixels = _mm_cvtsi128_si32(_mm_shuffle_epi8(_mm256_castsi256_si128(res_u), pack_chroma));
+      uint32_t v_pixels = _mm_cvtsi128_si32(_mm_shuffle_epi8(_mm256_castsi256_si128(res_v), pack_chroma));
+
+      memcpy(chromaU + y*width/4 + x/2, &u_pixels, 4);
+      memcpy(chromaV + y*width/4 + x/2, &v_pixels, 4);
+    }
+
+    // the rest of the row two pixels at a time
+    for (; x < width; x += 2)
+    {
+      int32_t upixel = 0;
+      int32_t vpixel = 0;
+
+      for (int i = 0; i < 4; ++i)
+      {
+        uint8_t* pixel = (i < 2 ? row : next_row) + (x + i%2)*4;
+        lumaY[(y + i/2)*width + x + i%2] = (76*pixel[0] + 150*pixel[1] + 29*pixel[2] + 128) >> 8;
+
+        upixel +=  127*pixel[0] - 84*pixel[1]  - 43*pixel[2];
+        vpixel += -21*pixel[0]  - 106*pixel[1] + 127*pixel[2];
+      }
+
+      chromaU[y*width/4 + x/2] = ((upixel + 512) >> 10) + 128;
+      chromaV[y*width/4 + x/2] = ((vpixel + 512) >> 10) + 128;
+    }
+  }
+
+  return 1;
+}
+
+
 void yuyv_to_yuv420_c(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
 {
   uint8_t* lumaY = output;
@@ -834,6 +871,143 @@ void yuyv_to_yuv420_c(uint8_t* input, uint8_t* output, uint16_t width, uint16_t
 }
 
 
+// the average rounded down like in the C version, avg_epu8 rounds up
+static inline __m256i avg_floor_epu8(__m256i a, __m256i b)
+{
+  return _mm256_sub_epi8(_mm256_avg_epu8(a, b),
+                         _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_set1_epi8(1)));
+}
+
+
+int yuyv_to_yuv420_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
+{
+  return yuyv_to_yuv420_avx2_rows(input, output, width, height, 0, height);
+}
+
+
+int yuyv_to_yuv420_avx2_rows(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                             uint16_t first_row, uint16_t last_row)
+{
+  uint8_t* lumaY = output;
+  uint8_t* chromaU = output + width*height;
+  uint8_t* chromaV = output + width*height + width*height/4;
+
+  const __m256i low_bytes = _mm256_set1_epi16(0xff);
+
+  for (int y = first_row; y < last_row; y += 2)
+  {
+    uint8_t* row = input + y*width*2;
+    uint8_t* next_row = row + width*2;
+
+    int x = 0;
+
+    // 32 pixels from both rows at a time
+    for (; x + 32 <= width; x += 32)
+    {
+      __m256i a  = _mm256_loadu_si256((__m256i const*)(row + x*2));
+      __m256i b  = _mm256_loadu_si256((__m256i const*)(row + x*2 + 32));
+      __m256i a2 = _mm256_loadu_si256((__m256i const*)(next_row + x*2));
+      __m256i b2 = _mm256_loadu_si256((__m256i const*)(next_row + x*2 + 32));
+
+      // luma is every other byte. Packing works within lanes so the 64-bit
+      // blocks have to be put back in order
+      __m256i luma = _mm256_packus_epi16(_mm256_and_si256(a, low_bytes), _mm256_and_si256(b, low_bytes));
+      __m256i luma2 = _mm256_packus_epi16(_mm256_and_si256(a2, low_bytes), _mm256_and_si256(b2, low_bytes));
+      _mm256_storeu_si256((__m256i*)(lumaY + y*width + x), _mm256_permute4x64_epi64(luma, 0xd8));
+      _mm256_storeu_si256((__m256i*)(lumaY + (y + 1)*width + x), _mm256_permute4x64_epi64(luma2, 0xd8));
+
+      // average of both rows, chroma ends up as UVUV...
+      __m256i chroma = _mm256_packus_epi16(_mm256_srli_epi16(avg_floor_epu8(a, a2), 8),
+                                           _mm256_srli_epi16(avg_floor_epu8(b, b2), 8));
+      chroma = _mm256_permute4x64_epi64(chroma, 0xd8);
+
+      // and then U to lower half and V to upper half
+      __m256i uv = _mm256_packus_epi16(_mm256_and_si256(chroma, low_bytes), _mm256_srli_epi16(chroma, 8));
+      uv = _mm256_permute4x64_epi64(uv, 0xd8);
+
+      _mm_storeu_si128((__m128i*)(chromaU + y*width/4 + x/2), _mm256_castsi256_si128(uv));
+      _mm_storeu_si128((__m128i*)(chromaV + y*width/4 + x/2), _mm256_extracti128_si256(uv, 1));
+    }
+
+    // the rest of the row
+    for (; x < width; x += 2)
+    {
+      lumaY[y*width + x]           = row[x*2];
+      lumaY[y*width + x + 1]       = row[x*2 + 2];
+      lumaY[(y + 1)*width + x]     = next_row[x*2];
+      lumaY[(y + 1)*width + x + 1] = next_row[x*2 + 2];
+
+      chromaU[y*width/4 + x/2] = (row[x*2 + 1] + next_row[x*2 + 1]) >> 1;
+      chromaV[y*width/4 + x/2] = (row[x*2 + 3] + next_row[x*2 + 3]) >> 1;
+    }
+  }
+
+  return 1;
+}
+
+
+void nv12_to_yuv420_c(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
+{
+  // luma plane is the same in both
+  memcpy(output, input, width*height);
+
+  uint8_t* chroma = input + width*height;
+  uint8_t* chromaU = output + width*height;
+  uint8_t* chromaV = output + width*height + width*height/4;
+
+  // In NV12, U and V are interleaved in one plane
+  for (int i = 0; i < width*height/4; ++i)
+  {
+    chromaU[i] = chroma[i*2];
+    chromaV[i] = chroma[i*2 + 1];
+  }
+}
+
+
+int nv12_to_yuv420_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
+{
+  return nv12_to_yuv420_avx2_rows(input, output, width, height, 0, height);
+}
+
+
+int nv12_to_yuv420_avx2_rows(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                             uint16_t first_row, uint16_t last_row)
+{
+  memcpy(output + first_row*width, input + first_row*width, (last_row - first_row)*width);
+
+  uint8_t* chroma = input + width*height;
+  uint8_t* chromaU = output + width*height;
+  uint8_t* chromaV = output + width*height + width*height/4;
+
+  const __m256i low_bytes = _mm256_set1_epi16(0xff);
+
+  // the chroma rows of the luma rows
+  int chroma_size = (last_row/2)*(width/2);
+  int i = (first_row/2)*(width/2);
+
+  // 32 chroma pixels at a time
+  for (; i + 32 <= chroma_size; i += 32)
+  {
+    __m256i a = _mm256_loadu_si256((__m256i const*)(chroma + i*2));
+    __m256i b = _mm256_loadu_si256((__m256i const*)(chroma + i*2 + 32));
+
+    __m256i u = _mm256_packus_epi16(_mm256_and_si256(a, low_bytes), _mm256_and_si256(b, low_bytes));
+    __m256i v = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+
+    _mm256_storeu_si256((__m256i*)(chromaU + i), _mm256_permute4x64_epi64(u, 0xd8));
+    _mm256_storeu_si256((__m256i*)(chromaV + i), _mm256_permute4x64_epi64(v, 0xd8));
+  }
+
+  for (; i < chroma_size; ++i)
+  {
+    chromaU[i] = chroma[i*2];
+    chromaV[i] = chroma[i*2 + 1];
+  }
+
+  return 1;
+}
+
+
 void yuyv_to_rgb_c(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
 {
   // Luma values
@@ -866,6 +1040,33 @@ void half_rgb(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
   }
 }
 
+void half_rgb_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height)
+{
+  // every other pixel to the low half
+  const __m256i even_pixels = _mm256_set_epi32(7, 5, 3, 1, 6, 4, 2, 0);
+
+  for (int y = 0; y < height; y += 2)
+  {
+    uint32_t* in = (uint32_t*)(input + y*width*4);
+    uint32_t* out = (uint32_t*)(output + (y/2)*(width/2)*4);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+      __m256i pixels = _mm256_loadu_si256((__m256i const*)(in + x));
+      pixels = _mm256_permutevar8x32_epi32(pixels, even_pixels);
+      _mm_storeu_si128((__m128i*)(out + x/2), _mm256_castsi256_si128(pixels));
+    }
+
+    for (; x < width; x += 2)
+    {
+      out[x/2] = in[x];
+    }
+  }
+}
+
+
+
 void flip_rgb(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
               bool horizontally, bool vertically)
 {
@@ -920,6 +1121,44 @@ void flip_rgb(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
   }
 }
 
+void flip_rgb_avx2(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                   bool horizontally, bool vertically)
+{
+  if (!horizontally && !vertically)
+  {
+    return;
+  }
+
+  const __m256i reverse_pixels = _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+  for (int y = 0; y < height; ++y)
+  {
+    int in_y = vertically ? height - 1 - y : y;
+    uint32_t* in = (uint32_t*)(input + in_y*width*4);
+    uint32_t* out = (uint32_t*)(output + y*width*4);
+
+    if (!horizontally)
+    {
+      memcpy(out, in, width*4);
+      continue;
+    }
+
+    // the last 8 pixels of input in reverse order are the first 8 of output
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+      __m256i pixels = _mm256_loadu_si256((__m256i const*)(in + width - x - 8));
+      _mm256_storeu_si256((__m256i*)(out + x), _mm256_permutevar8x32_epi32(pixels, reverse_pixels));
+    }
+
+    for (; x < width; ++x)
+    {
+      out[x] = in[width - 1 - x];
+    }
+  }
+}
+
+
 
 uint8_t clamp_8bit(int32_t input)
 {
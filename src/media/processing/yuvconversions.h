@@ -6,23 +6,68 @@
 bool is_avx2_available();
 bool is_sse41_available();
 
-int  yuv420_to_rgb_i_avx2_mt (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height, uint8_t threads);
+// any width and height, the vector versions finish the rows in C. Odd sizes
+// have (width + 1)/2 x (height + 1)/2 chroma planes.
 int  yuv420_to_rgb_i_avx2    (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height);
 int  yuv420_to_rgb_i_sse41   (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height);
 void yuv420_to_rgb_i_c       (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height);
 
-// TODO: These also flip the input vertically!
-int  rgb_to_yuv420_i_sse41_mt(uint8_t* input, uint8_t* output, int width, int height, int threads);
+// converts only rows [first_row, last_row) of the frame so that the frame can
+// be divided between threads. first_row must be even.
+int  yuv420_to_rgb_i_avx2_rows (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                                uint16_t first_row, uint16_t last_row);
+int  yuv420_to_rgb_i_sse41_rows(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                                uint16_t first_row, uint16_t last_row);
+void yuv420_to_rgb_i_c_rows    (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                                uint16_t first_row, uint16_t last_row);
+
+// Converts to RGB32 of size out_width x out_height in one pass by picking the
+// nearest pixel, while mirroring and flipping if asked. Meant for previews
+// such as the self view where the cost matters more than the quality. The row
+// versions convert only output rows [first_row, last_row).
+int  yuv420_to_rgb_scaled_avx2     (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                                    uint16_t out_width, uint16_t out_height,
+                                    bool mirror_horizontally, bool flip_vertically);
+int  yuv420_to_rgb_scaled_avx2_rows(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                                    uint16_t out_width, uint16_t out_height,
+                                    bool mirror_horizontally, bool flip_vertically,
+                                    uint16_t first_row, uint16_t last_row);
+void yuv420_to_rgb_scaled_c        (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                                    uint16_t out_width, uint16_t out_height,
+                                    bool mirror_horizontally, bool flip_vertically);
+void yuv420_to_rgb_scaled_c_rows   (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                                    uint16_t out_width, uint16_t out_height,
+                                    bool mirror_horizontally, bool flip_vertically,
+                                    uint16_t first_row, uint16_t last_row);
+
+// The RGB32 input of the pipeline is converted by libyuv, these are kept for
+// comparison. The AVX2 version works with any even width and height.
+// TODO: The SSE4.1 versions also flip the input vertically!
+int  rgb_to_yuv420_i_avx2    (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height);
 int  rgb_to_yuv420_i_sse41   (uint8_t* input, uint8_t* output, int width, int height);
 void rgb_to_yuv420_i_c       (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height);
 
+// The AVX2 versions below work with any even width and height. The row
+// versions convert rows [first_row, last_row), first_row must be even.
+int  yuyv_to_yuv420_avx2     (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height);
+int  yuyv_to_yuv420_avx2_rows(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                              uint16_t first_row, uint16_t last_row);
 void yuyv_to_yuv420_c        (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height);
 
+int  nv12_to_yuv420_avx2     (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height);
+int  nv12_to_yuv420_avx2_rows(uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                              uint16_t first_row, uint16_t last_row);
+void nv12_to_yuv420_c        (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height);
+
+// only copies the luma, no vector version until the chroma is done
 void yuyv_to_rgb_c           (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height);
 
 // reduces the size of RGB frame to half height and half width
+void half_rgb_avx2           (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height);
 void half_rgb                (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height);
 
+void flip_rgb_avx2           (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
+                              bool horizontally, bool vertically);
 void flip_rgb                (uint8_t* input, uint8_t* output, uint16_t width, uint16_t height,
                               bool horizontally, bool vertically);
 
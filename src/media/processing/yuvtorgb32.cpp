@@ -1,7 +1,7 @@
 #include "yuvtorgb32.h"
 
 #include "yuvconversions.h"
-#include "settingskeys.h"
+#include "rowbandpool.h"
 
 #include "media/resourceallocator.h"
 
@@ -9,19 +9,19 @@
 
 #include <QSettings>
 
+#include <libyuv.h>
+
 
 YUVtoRGB32::YUVtoRGB32(QString id, StatisticsInterface *stats,
                        std::shared_ptr<ResourceAllocator> hwResources) :
   Filter(id, "YUVtoRGB32", stats, hwResources, DT_YUV420VIDEO, DT_RGB32VIDEO),
-  threadCount_(0)
+  bandPool_(hwResources->getRowBandPool())
 {
   updateSettings();
 }
 
 void YUVtoRGB32::updateSettings()
 {
-  threadCount_ = settingValue(SettingsKey::videoYUVThreads);
-
   Filter::updateSettings();
 }
 
@@ -32,31 +32,61 @@ void YUVtoRGB32::process()
 
   while(input)
   {
-    uint32_t finalDataSize = input->vInfo->width*input->vInfo->height*4;
-    std::unique_ptr<uchar[]> rgb32_frame(new uchar[finalDataSize]);
+    uint16_t width = input->vInfo->width;
+    uint16_t height = input->vInfo->height;
+
+    uint32_t finalDataSize = width*height*4;
+    std::shared_ptr<uchar[]> rgb32_frame = getDataBuffer(DT_RGB32VIDEO, finalDataSize);
 
-    // TODO: Select thread count based on input resolution instead of settings.
-    // Anything above fullhd should be around 2
-    if (getHWManager()->isAVX2Enabled() && threadCount_ != 1 && input->vInfo->width % 16 == 0)
+    uint8_t* in = input->data.get();
+    uint8_t* out = rgb32_frame.get();
+
+    // the pool decides how many threads the frame is worth
+    if (!isPackedVideo(input.get()))
     {
-      yuv420_to_rgb_i_avx2_mt(input->data.get(), rgb32_frame.get(), input->vInfo->width, input->vInfo->height,
-                     threadCount_);
+      // our own conversions expect packed planes, but libyuv reads the
+      // decoder output in place. ARGB of libyuv has the same byte order as RGB32
+      uint32_t yStride = 0;
+      uint32_t uStride = 0;
+      uint32_t vStride = 0;
+      uint8_t* y = videoPlane(input.get(), 0, yStride);
+      uint8_t* u = videoPlane(input.get(), 1, uStride);
+      uint8_t* v = videoPlane(input.get(), 2, vStride);
+
+      bandPool_->run(width, height, [=](uint16_t firstRow, uint16_t lastRow)
+      {
+        libyuv::I420ToARGB(y + firstRow*yStride, yStride,
+                           u + firstRow/2*uStride, uStride,
+                           v + firstRow/2*vStride, vStride,
+                           out + firstRow*width*4, width*4,
+                           width, lastRow - firstRow);
+      });
     }
-    else if (getHWManager()->isAVX2Enabled() && input->vInfo->width % 16 == 0)
+    else if (getHWManager()->isAVX2Enabled())
     {
-      yuv420_to_rgb_i_avx2(input->data.get(), rgb32_frame.get(), input->vInfo->width, input->vInfo->height);
+      bandPool_->run(width, height, [=](uint16_t firstRow, uint16_t lastRow)
+      {
+        yuv420_to_rgb_i_avx2_rows(in, out, width, height, firstRow, lastRow);
+      });
     }
-    else if (getHWManager()->isSSE41Enabled() && input->vInfo->width % 16 == 0)
+    else if (getHWManager()->isSSE41Enabled())
     {
-      yuv420_to_rgb_i_sse41(input->data.get(), rgb32_frame.get(), input->vInfo->width, input->vInfo->height);
+      bandPool_->run(width, height, [=](uint16_t firstRow, uint16_t lastRow)
+      {
+        yuv420_to_rgb_i_sse41_rows(in, out, width, height, firstRow, lastRow);
+      });
     }
     else
     {
-      yuv420_to_rgb_i_c(input->data.get(), rgb32_frame.get(), input->vInfo->width, input->vInfo->height);
+      bandPool_->run(width, height, [=](uint16_t firstRow, uint16_t lastRow)
+      {
+        yuv420_to_rgb_i_c_rows(in, out, width, height, firstRow, lastRow);
+      });
     }
     input->type = DT_RGB32VIDEO;
     input->data = std::move(rgb32_frame);
     input->data_size = finalDataSize;
+    input->vInfo->planeCount = 0;
     sendOutput(std::move(input));
 
     input = getInput();
@@ -1,6 +1,8 @@
 #pragma once
 #include "filter.h"
 
+class RowBandPool;
+
 // converts the YUV420 video frame to and RGB32 frame. May use optimizations.
 
 class YUVtoRGB32 : public Filter
@@ -11,10 +13,23 @@ public:
 
   virtual void updateSettings();
 
+  virtual bool isFusable() const
+  {
+    return true;
+  }
+
+  virtual bool isFormatConversion() const
+  {
+    return true;
+  }
+
+  // cost of converting YUV420 to RGB32
+  static const uint32_t CONVERSION_COST = 3;
+
 protected:
   void process();
 
 private:
-  int threadCount_;
+  std::shared_ptr<RowBandPool> bandPool_;
 };
 
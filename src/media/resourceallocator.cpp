@@ -1,27 +1,58 @@
 #include "resourceallocator.h"
 
 #include "processing/yuvconversions.h"
+#include "processing/framepool.h"
+#include "processing/filterscheduler.h"
+#include "processing/rowbandpool.h"
 
 #include "settingskeys.h"
 #include "logger.h"
 #include "common.h"
 
+#include <QThread>
+
+#include <algorithm>
+
 const int MIN_OPUS_BITRATE_BITS = 16000;    // 16 kbit/s
 const int MAX_OPUS_BITRATE_BITS = 24000;    // 24 kbit/s
 const int MIN_HEVC_BITRATE_BITS = 150000;   // 150 kbit/s
 const int MAX_HEVC_BITRATE_BITS = 10000000; // 10 Mbit/s
 
+// clean reports needed before a dropped temporal layer is sent again
+const unsigned int STABLE_REPORTS_PER_LAYER = 3;
+
+// The intra frame being produced also serves requests arriving during the
+// interval. A peer that keeps asking right after getting one is probably not
+// helped by more of them, so the interval doubles up to the maximum.
+const std::chrono::milliseconds MIN_KEYFRAME_INTERVAL = std::chrono::milliseconds(1500);
+const std::chrono::milliseconds MAX_KEYFRAME_INTERVAL = std::chrono::milliseconds(12000);
+
 
 ResourceAllocator::ResourceAllocator():
   avx2_(is_avx2_available()),
   sse41_(is_sse41_available()),
   manualROI_(false),
+  simulcastLayers_(1),
+  keyframeMutex_(),
+  lastKeyframeRequest_(),
+  keyframeInterval_(),
+  keyframeRequests_(),
   audioStreams_(),
   videoStreams_(),
   bitrateMutex_(),
   videoBitrate_(MAX_HEVC_BITRATE_BITS),
-  audioBitrate_(MAX_OPUS_BITRATE_BITS)
-{}
+  audioBitrate_(MAX_OPUS_BITRATE_BITS),
+  framePool_(std::make_shared<FramePool>()),
+  schedulerMutex_(),
+  filterScheduler_(nullptr),
+  rowBandPool_(nullptr)
+{
+  for (unsigned int layer = 0; layer < MAX_SIMULCAST_LAYERS; ++layer)
+  {
+    keyframeInterval_[layer] = MIN_KEYFRAME_INTERVAL;
+    keyframeRequests_[layer] = 0;
+  }
+}
 
 
 void ResourceAllocator::updateSettings()
@@ -81,9 +112,6 @@ void ResourceAllocator::addRTCPReport(uint32_t sessionID, DataType type,
 
   limitBitrate(info->bitrate, type);
 
-  info->previousJitter = jitter;
-  info->previousLost = lost;
-
   bitrateMutex_.lock();
   if (type == DT_OPUSAUDIO)
   {
@@ -92,8 +120,45 @@ void ResourceAllocator::addRTCPReport(uint32_t sessionID, DataType type,
   else
   {
     updateGlobalBitrate(videoBitrate_, videoStreams_);
+    updateTemporalLayers(sessionID, *info, lost, jitter);
   }
   bitrateMutex_.unlock();
+
+  info->previousJitter = jitter;
+  info->previousLost = lost;
+}
+
+
+void ResourceAllocator::updateTemporalLayers(uint32_t sessionID, StreamInfo& info,
+                                             int32_t lost, uint32_t jitter)
+{
+  // Unlike the bitrate, which reaches the encoder slowly and affects all peers,
+  // the frame rate of one peer can be lowered immediately. Small changes of
+  // jitter are normal, so only a clear rise counts.
+  if (lost > info.previousLost ||
+      (info.previousJitter > 0 && 2*(uint64_t)jitter > 3*(uint64_t)info.previousJitter))
+  {
+    info.stableReports = 0;
+
+    if (info.temporalLayers > 1)
+    {
+      --info.temporalLayers;
+      Logger::getLogger()->printNormal(this, "Lowering frame rate of peer",
+                                       {"SessionID", "Temporal layers"},
+                                       {QString::number(sessionID),
+                                        QString::number(info.temporalLayers)});
+    }
+  }
+  else if (info.temporalLayers < TEMPORAL_LAYERS &&
+           ++info.stableReports >= STABLE_REPORTS_PER_LAYER)
+  {
+    info.stableReports = 0;
+    ++info.temporalLayers;
+    Logger::getLogger()->printNormal(this, "Raising frame rate of peer",
+                                     {"SessionID", "Temporal layers"},
+                                     {QString::number(sessionID),
+                                      QString::number(info.temporalLayers)});
+  }
 }
 
 
@@ -107,6 +172,10 @@ void ResourceAllocator::updateGlobalBitrate(int& bitrate,
 
   bool startValueSet = false;
 
+  // With simulcast the peers with weaker connections are sent a smaller
+  // layer, so the full resolution does not have to be limited by them.
+  bool useBest = &streams == &videoStreams_ && simulcastLayers_ > 1;
+
   for (auto& stream : streams)
   {
     if (!startValueSet && stream.second != nullptr)
@@ -114,7 +183,9 @@ void ResourceAllocator::updateGlobalBitrate(int& bitrate,
       bitrate = stream.second->bitrate;
       startValueSet = true;
     }
-    else if (stream.second != nullptr && stream.second->bitrate < bitrate)
+    else if (stream.second != nullptr &&
+             ((!useBest && stream.second->bitrate < bitrate) ||
+              (useBest && stream.second->bitrate > bitrate)))
     {
       bitrate = stream.second->bitrate;
     }
@@ -141,6 +212,117 @@ int ResourceAllocator::getBitrate(DataType type)
 }
 
 
+int ResourceAllocator::getStreamBitrate(uint32_t sessionID, DataType type)
+{
+  int bitrate = 0;
+
+  bitrateMutex_.lock();
+  if (type == DT_OPUSAUDIO && audioStreams_.find(sessionID) != audioStreams_.end())
+  {
+    bitrate = audioStreams_[sessionID]->bitrate;
+  }
+  else if (type == DT_HEVCVIDEO && videoStreams_.find(sessionID) != videoStreams_.end())
+  {
+    bitrate = videoStreams_[sessionID]->bitrate;
+  }
+  bitrateMutex_.unlock();
+
+  return bitrate;
+}
+
+
+uint8_t ResourceAllocator::getTemporalLayers(uint32_t sessionID)
+{
+  uint8_t layers = TEMPORAL_LAYERS;
+
+  bitrateMutex_.lock();
+  if (videoStreams_.find(sessionID) != videoStreams_.end())
+  {
+    layers = videoStreams_[sessionID]->temporalLayers;
+  }
+  bitrateMutex_.unlock();
+
+  return layers;
+}
+
+
+void ResourceAllocator::requestKeyframe(unsigned int layer)
+{
+  if (layer >= MAX_SIMULCAST_LAYERS)
+  {
+    return;
+  }
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+  keyframeMutex_.lock();
+  std::chrono::steady_clock::duration sinceLast = now - lastKeyframeRequest_[layer];
+  if (sinceLast >= keyframeInterval_[layer])
+  {
+    if (sinceLast < 2*keyframeInterval_[layer])
+    {
+      keyframeInterval_[layer] = std::min(2*keyframeInterval_[layer], MAX_KEYFRAME_INTERVAL);
+    }
+    else
+    {
+      keyframeInterval_[layer] = MIN_KEYFRAME_INTERVAL;
+    }
+
+    lastKeyframeRequest_[layer] = now;
+    ++keyframeRequests_[layer];
+    Logger::getLogger()->printNormal(this, "Requesting an intra frame from the encoder",
+                                     {"Layer", "Next request after"},
+                                     {QString::number(layer),
+                                      QString::number(keyframeInterval_[layer].count()) + " ms"});
+  }
+  keyframeMutex_.unlock();
+}
+
+
+uint32_t ResourceAllocator::getKeyframeRequests(unsigned int layer) const
+{
+  if (layer >= MAX_SIMULCAST_LAYERS)
+  {
+    return 0;
+  }
+
+  return keyframeRequests_[layer];
+}
+
+
+void ResourceAllocator::setSimulcastLayers(unsigned int layers)
+{
+  simulcastLayers_ = layers;
+}
+
+
+unsigned int ResourceAllocator::getSimulcastLayers() const
+{
+  return simulcastLayers_;
+}
+
+
+int ResourceAllocator::getLayerBitrate(unsigned int layer)
+{
+  int bitrate = settingValue(SettingsKey::videoBitrate);
+  if (bitrate <= 0)
+  {
+    bitrate = MAX_HEVC_BITRATE_BITS;
+  }
+
+  if (layer == 0)
+  {
+    // the full resolution follows the network
+    return std::min(bitrate, getBitrate(DT_HEVCVIDEO));
+  }
+
+  // every layer has a quarter of the pixels of the one before it
+  bitrate >>= 2*layer;
+  limitBitrate(bitrate, DT_HEVCVIDEO);
+  return bitrate;
+}
+
+
 std::shared_ptr<StreamInfo> ResourceAllocator::getStreamInfo(uint32_t sessionID, DataType type)
 {
   std::shared_ptr<StreamInfo> pointer = nullptr;
@@ -159,8 +341,15 @@ std::shared_ptr<StreamInfo> ResourceAllocator::getStreamInfo(uint32_t sessionID,
   {
     if (videoStreams_.find(sessionID) == videoStreams_.end())
     {
-      videoStreams_[sessionID] = std::shared_ptr<StreamInfo>(new StreamInfo{0, 0,
-                                                                            MAX_HEVC_BITRATE_BITS});
+      // start from the configured bitrate so that congestion has an effect
+      // on the encoder from the first report
+      int bitrate = settingValue(SettingsKey::videoBitrate);
+      if (bitrate <= 0)
+      {
+        bitrate = MAX_HEVC_BITRATE_BITS;
+      }
+
+      videoStreams_[sessionID] = std::shared_ptr<StreamInfo>(new StreamInfo{0, 0, bitrate});
     }
 
     pointer = videoStreams_[sessionID];
@@ -210,3 +399,54 @@ uint8_t ResourceAllocator::getBackgroundQp() const
 {
   return backgroundQp_;
 }
+
+
+std::shared_ptr<FramePool> ResourceAllocator::getFramePool() const
+{
+  return framePool_;
+}
+
+
+std::shared_ptr<FilterScheduler> ResourceAllocator::getFilterScheduler()
+{
+  if (!settingEnabled(SettingsKey::videoFilterThreadPool))
+  {
+    return nullptr;
+  }
+
+  schedulerMutex_.lock();
+  if (!filterScheduler_)
+  {
+    int workers = QThread::idealThreadCount();
+    Logger::getLogger()->printNormal(this, "Starting filter thread pool",
+                                     "Workers", QString::number(workers));
+    filterScheduler_ = std::make_shared<FilterScheduler>(workers);
+  }
+  std::shared_ptr<FilterScheduler> scheduler = filterScheduler_;
+  schedulerMutex_.unlock();
+
+  return scheduler;
+}
+
+
+std::shared_ptr<RowBandPool> ResourceAllocator::getRowBandPool()
+{
+  schedulerMutex_.lock();
+  if (!rowBandPool_)
+  {
+    // the thread asking for the conversion works on the bands too
+    int workers = QThread::idealThreadCount() - 1;
+    if (workers < 0)
+    {
+      workers = 0;
+    }
+
+    Logger::getLogger()->printNormal(this, "Starting conversion thread pool",
+                                     "Workers", QString::number(workers));
+    rowBandPool_ = std::make_shared<RowBandPool>(workers);
+  }
+  std::shared_ptr<RowBandPool> pool = rowBandPool_;
+  schedulerMutex_.unlock();
+
+  return pool;
+}
@@ -1,18 +1,30 @@
 #pragma once
 
 #include "processing/filter.h"
+#include "global.h"
 
 #include <QObject>
 
+#include <atomic>
+#include <chrono>
+
 /* The purpose of this class is the enable filters to easily query the
  * state of hardware in terms of possible optimizations and performance. */
 
+class FramePool;
+class FilterScheduler;
+class RowBandPool;
+
 struct StreamInfo
 {
   uint32_t previousJitter;
   int32_t  previousLost;
 
   int bitrate;
+
+  // how many of the encoded temporal layers the peer receives
+  uint8_t temporalLayers = TEMPORAL_LAYERS;
+  unsigned int stableReports = 0;
 };
 
 class ResourceAllocator : public QObject
@@ -32,12 +44,43 @@ public:
   void addRTCPReport(uint32_t sessionID, DataType type,
                      int32_t lost, uint32_t jitter);
 
+  // The bitrate for the encoder. With simulcast this follows the best peer,
+  // otherwise the worst one.
   int getBitrate(DataType type);
 
+  // the bitrate estimated for the stream to one peer, zero if not known
+  int getStreamBitrate(uint32_t sessionID, DataType type);
+
+  // number of temporal layers sent to the peer, all of them if not known
+  uint8_t getTemporalLayers(uint32_t sessionID);
+
+  // Asks the encoder of a simulcast layer for an intra frame. Requests from
+  // several peers close together are served by the same frame, and the
+  // requests are spaced further apart while they keep coming.
+  void requestKeyframe(unsigned int layer);
+
+  // grows every time the encoder of the layer should encode an intra frame
+  uint32_t getKeyframeRequests(unsigned int layer) const;
+
+  // number of video resolutions encoded, 1 if simulcast is not used
+  void setSimulcastLayers(unsigned int layers);
+  unsigned int getSimulcastLayers() const;
+
+  // the bitrate a simulcast layer is encoded at
+  int getLayerBitrate(unsigned int layer);
 
   uint8_t getRoiQp() const;
   uint8_t getBackgroundQp() const;
 
+  // pool of frame buffers shared by all filters
+  std::shared_ptr<FramePool> getFramePool() const;
+
+  // thread pool for running filters, nullptr if filters should use their own threads
+  std::shared_ptr<FilterScheduler> getFilterScheduler();
+
+  // threads shared by all conversions that divide frames into bands of rows
+  std::shared_ptr<RowBandPool> getRowBandPool();
+
 private:
 
   void updateGlobalBitrate(int& bitrate,
@@ -45,6 +88,9 @@ private:
 
   std::shared_ptr<StreamInfo> getStreamInfo(uint32_t sessionID, DataType type);
 
+  void updateTemporalLayers(uint32_t sessionID, StreamInfo& info,
+                            int32_t lost, uint32_t jitter);
+
   void limitBitrate(int &bitrate, DataType type);
 
   bool avx2_ = false;
@@ -53,6 +99,14 @@ private:
   bool manualROI_ = false;
   bool autoROI_ = false;
 
+  std::atomic<unsigned int> simulcastLayers_;
+
+  // per simulcast layer
+  QMutex keyframeMutex_;
+  std::chrono::steady_clock::time_point lastKeyframeRequest_[MAX_SIMULCAST_LAYERS];
+  std::chrono::milliseconds keyframeInterval_[MAX_SIMULCAST_LAYERS];
+  std::atomic<uint32_t> keyframeRequests_[MAX_SIMULCAST_LAYERS];
+
   // key is sessionID
   std::map<uint32_t, std::shared_ptr<StreamInfo>> audioStreams_;
   std::map<uint32_t, std::shared_ptr<StreamInfo>> videoStreams_;
@@ -63,4 +117,11 @@ private:
 
   uint8_t roiQp_;
   uint8_t backgroundQp_;
+
+  std::shared_ptr<FramePool> framePool_;
+
+  QMutex schedulerMutex_;
+  std::shared_ptr<FilterScheduler> filterScheduler_;
+
+  std::shared_ptr<RowBandPool> rowBandPool_;
 };
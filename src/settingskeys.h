@@ -35,13 +35,15 @@ const QString videoDevice = "video/Device";
 const QString videoResolutionWidth = "video/ResolutionWidth";
 const QString videoResolutionHeight = "video/ResolutionHeight";
 const QString videoInputFormat = "video/InputFormat";
-const QString videoYUVThreads = "video/yuvThreads";
-const QString videoRGBThreads = "video/rgbThreads";
 const QString videoOpenHEVCThreads = "video/OPENHEVC_threads";
 const QString videoOHParallelization = "video/OH_parallelization";
 const QString videoFramerateNumerator = "video/FramerateNumerator";
 const QString videoFramerateDenominator = "video/FramerateDenominator";
 const QString videoOpenGL = "video/opengl";
+const QString videoFilterThreadPool = "video/filterThreadPool";
+const QString videoFilterFusion = "video/filterFusion";
+const QString videoPrintFilterGraph = "video/printFilterGraph";
+const QString videoSimulcastLayers = "video/simulcastLayers";
 
 
 // Kvazaar setting keys
@@ -63,6 +65,7 @@ const QString videoMVConstraint = "video/mvConstraint";
 const QString videoQPInCU = "video/qpInCU";
 const QString videoVAQ = "video/vaq";
 const QString videoPreset = "video/Preset";
+const QString videoStandbyEncoder = "video/standbyEncoder";
 const QString videoCustomParameters = "parameters";
 
 
@@ -15,6 +15,15 @@
 
 struct ICEPair;
 
+// latency distribution in microseconds
+struct LatencyPercentiles
+{
+  uint32_t p50;
+  uint32_t p95;
+  uint32_t p99;
+  uint32_t max;
+};
+
 class StatisticsInterface
 {
 public:
@@ -77,6 +86,12 @@ public:
   // Tracking of packets dropped due to buffer overflow
   virtual void packetDropped(uint32_t id) = 0;
 
+  // Latencies of a filter since the previous update. Queue latency is the time
+  // input waits in the buffer and processing latency the time from taking
+  // input to sending output.
+  virtual void updateQueueLatency(uint32_t id, LatencyPercentiles latency) = 0;
+  virtual void updateProcessingLatency(uint32_t id, LatencyPercentiles latency) = 0;
+
 
   // SIP
   // Tracking of sent and received SIP Messages
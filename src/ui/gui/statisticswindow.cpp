@@ -101,7 +101,8 @@ StatisticsInterface(),
                           {"Foundation", "Component", "Type", "Address", "Port"});
 
   fillTableHeaders(ui_->filterTable, filterMutex_,
-                          {"Filter", "Info", "TID", "Buffer Size", "Dropped"});
+                          {"Filter", "Info", "TID", "Buffer Size", "Dropped",
+                           "Queue (ms)", "Processing (ms)"});
   fillTableHeaders(ui_->sip_list, sipMutex_,
                           {"Direction", "Header", "Body"});
 }
@@ -273,7 +274,10 @@ uint32_t StatisticsWindow::addFilter(QString type, QString identifier, uint64_t
   threadID = threadID.rightJustified(5, '0');
 
   int rowIndex = addTableRow(ui_->filterTable, filterMutex_,
-                                  {type, identifier, threadID, "-/-", "0"});
+                                  {type, identifier, threadID, "-/-", "0", "-", "-"},
+                                  {"", "", "", "", "",
+                                   "p50/p95/p99/max time spent in input buffer",
+                                   "p50/p95/p99/max time from input to output"});
 
   filterMutex_.lock();
   uint32_t id = nextFilterID_;
@@ -282,7 +286,8 @@ uint32_t StatisticsWindow::addFilter(QString type, QString identifier, uint64_t
   {
     nextFilterID_ = 10;
   }
-  buffers_[id] = FilterStatus{0,QString::number(TID), 0, 0, rowIndex};
+  buffers_[id] = FilterStatus{0,QString::number(TID), 0, 0, {0, 0, 0, 0}, {0, 0, 0, 0},
+                              rowIndex};
   filterMutex_.unlock();
 
   return id;
@@ -660,6 +665,30 @@ void StatisticsWindow::packetDropped(uint32_t id)
 }
 
 
+void StatisticsWindow::updateQueueLatency(uint32_t id, LatencyPercentiles latency)
+{
+  filterMutex_.lock();
+  if(buffers_.find(id) != buffers_.end())
+  {
+    buffers_[id].queueLatency = latency;
+    dirtyBuffers_ = true;
+  }
+  filterMutex_.unlock();
+}
+
+
+void StatisticsWindow::updateProcessingLatency(uint32_t id, LatencyPercentiles latency)
+{
+  filterMutex_.lock();
+  if(buffers_.find(id) != buffers_.end())
+  {
+    buffers_[id].processingLatency = latency;
+    dirtyBuffers_ = true;
+  }
+  filterMutex_.unlock();
+}
+
+
 void StatisticsWindow::paintEvent(QPaintEvent *event)
 {
   Q_UNUSED(event);
@@ -826,9 +855,15 @@ void StatisticsWindow::paintEvent(QPaintEvent *event)
                                                          "/" + QString::number(it.second.bufferSize)));
           ui_->filterTable->setItem(it.second.tableIndex, 4,
                                     new QTableWidgetItem(QString::number(it.second.dropped)));
+          ui_->filterTable->setItem(it.second.tableIndex, 5,
+                                    new QTableWidgetItem(latencyToString(it.second.queueLatency)));
+          ui_->filterTable->setItem(it.second.tableIndex, 6,
+                                    new QTableWidgetItem(latencyToString(it.second.processingLatency)));
 
-          ui_->filterTable->item(it.second.tableIndex, 3)->setTextAlignment(Qt::AlignHCenter);
-          ui_->filterTable->item(it.second.tableIndex, 4)->setTextAlignment(Qt::AlignHCenter);
+          for (int column = 3; column <= 6; ++column)
+          {
+            ui_->filterTable->item(it.second.tableIndex, column)->setTextAlignment(Qt::AlignHCenter);
+          }
         }
         filterMutex_.unlock();
 
@@ -883,6 +918,15 @@ void StatisticsWindow::delayMsConversion(int& delay, QString& unit)
 }
 
 
+QString StatisticsWindow::latencyToString(const LatencyPercentiles& latency) const
+{
+  return QString::number(latency.p50/1000.0, 'f', 1) + "/" +
+      QString::number(latency.p95/1000.0, 'f', 1) + "/" +
+      QString::number(latency.p99/1000.0, 'f', 1) + "/" +
+      QString::number(latency.max/1000.0, 'f', 1);
+}
+
+
 void StatisticsWindow::fillTableHeaders(QTableWidget* table, QMutex& mutex,
                                         QStringList headers)
 {
@@ -64,6 +64,8 @@ public:
   virtual void updateBufferStatus(uint32_t id, uint16_t buffersize,
                                   uint16_t maxBufferSize);
   virtual void packetDropped(uint32_t id);
+  virtual void updateQueueLatency(uint32_t id, LatencyPercentiles latency);
+  virtual void updateProcessingLatency(uint32_t id, LatencyPercentiles latency);
 
   // sip
   virtual void addSentSIPMessage(const QString& headerType, const QString& header,
@@ -108,6 +110,9 @@ private:
 
   void delayMsConversion(int& delay, QString& unit);
 
+  // p50/p95/p99/max in milliseconds
+  QString latencyToString(const LatencyPercentiles& latency) const;
+
   void fillTableHeaders(QTableWidget* table, QMutex& mutex, QStringList headers);
 
   // returns the index of added row
@@ -171,6 +176,9 @@ private:
     uint32_t bufferSize;
     uint32_t dropped;
 
+    LatencyPercentiles queueLatency;
+    LatencyPercentiles processingLatency;
+
     int tableIndex;
   };
 
@@ -16,6 +16,8 @@ VideoDrawHelper::VideoDrawHelper(uint32_t sessionID, LayoutID layoutID, uint8_t
   sessionID_(sessionID),
   layoutID_(layoutID),
   tmpParent_(nullptr),
+  drawSizeMutex_(),
+  drawSize_(QSize(0,0)),
   firstImageReceived_(false),
   previousSize_(QSize(0,0)),
   borderSize_(borderSize),
@@ -124,7 +126,7 @@ bool VideoDrawHelper::readyToDraw()
 }
 
 
-void VideoDrawHelper::inputImage(QWidget* widget, std::unique_ptr<uchar[]> data, QImage &image,
+void VideoDrawHelper::inputImage(QWidget* widget, std::shared_ptr<uchar[]> data, QImage &image,
                                  int64_t timestamp)
 {
   if (!widget->isVisible() ||
@@ -254,6 +256,15 @@ bool VideoDrawHelper::getRecentImage(QImage& image)
 }
 
 
+QSize VideoDrawHelper::getDrawSize()
+{
+  drawSizeMutex_.lock();
+  QSize size = drawSize_;
+  drawSizeMutex_.unlock();
+  return size;
+}
+
+
 void VideoDrawHelper::updateTargetRect(QWidget* widget)
 {
   if(firstImageReceived_)
@@ -330,6 +341,12 @@ void VideoDrawHelper::updateTargetRect(QWidget* widget)
     imageRect_ = QRect(QPoint(0, 0), imageSize);
     imageRect_.moveCenter(widget->rect().center());
 
+    // the video pipeline uses this to avoid processing pixels that would
+    // only be scaled away when drawing
+    drawSizeMutex_.lock();
+    drawSize_ = imageSize*widget->devicePixelRatioF();
+    drawSizeMutex_.unlock();
+
     if (useImageLeft)
     {
       borderRect_.moveLeft(imageRect_.left() - 1);
@@ -616,10 +633,10 @@ void VideoDrawHelper::exitFullscreen(QWidget* widget)
 }
 
 
-std::unique_ptr<int8_t[]> VideoDrawHelper::getRoiMask(int& width, int& height,
+std::shared_ptr<int8_t[]> VideoDrawHelper::getRoiMask(int& width, int& height,
                                                       int qp, bool scaleToInput)
 {
-  std::unique_ptr<int8_t[]> roiMask = nullptr;
+  std::shared_ptr<int8_t[]> roiMask = nullptr;
 
   if (drawOverlay_)
   {
@@ -630,12 +647,9 @@ std::unique_ptr<int8_t[]> VideoDrawHelper::getRoiMask(int& width, int& height,
       updateROIMask(width, height, qp, scaleToInput);
     }
 
-    // copy the ROI mask in memory because it is faster than always creating a new one
-    if (currentMask_)
-    {
-      roiMask = std::unique_ptr<int8_t[]> (new int8_t[currentSize_]);
-      memcpy(roiMask.get(), currentMask_.get(), currentSize_);
-    }
+    // All frames share the same mask until it changes. A changed mask is
+    // always created anew so the mask of earlier frames stays the same.
+    roiMask = currentMask_;
 
     roiMutex_.unlock();
   }
@@ -673,10 +687,10 @@ void VideoDrawHelper::updateROIMask(int &width, int &height, int qp, bool scaleT
     height = overlay_.height();
   }
 
-  // allocate memory for the mask. This is the mask we hold in memory and use to
-  // make copies for kvazaar to use.
+  // allocate memory for the mask. This is the mask we hold in memory and share
+  // with the frames given to kvazaar.
   currentSize_ = width*height;
-  currentMask_ = std::unique_ptr<int8_t[]> (new int8_t[currentSize_]);
+  currentMask_ = std::shared_ptr<int8_t[]> (new int8_t[currentSize_]);
 
   // if the overlay is different size, we need to offset this difference
   QSizeF multipliers = getSizeMultipliers(width, height);
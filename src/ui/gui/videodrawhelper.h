@@ -46,7 +46,7 @@ public:
   void setDrawMicOff(bool state);
 
   bool readyToDraw();
-  void inputImage(QWidget *widget, std::unique_ptr<uchar[]> data,
+  void inputImage(QWidget *widget, std::shared_ptr<uchar[]> data,
                   QImage &image, int64_t timestamp);
 
 #ifdef KVAZZUP_HAVE_ONNX_RUNTIME
@@ -76,7 +76,10 @@ public:
     return borderRect_;
   }
 
-  std::unique_ptr<int8_t[]> getRoiMask(int& width, int& height, int qp, bool scaleToInput);
+  // the size of the target rect in device pixels, can be called from any thread
+  QSize getDrawSize();
+
+  std::shared_ptr<int8_t[]> getRoiMask(int& width, int& height, int qp, bool scaleToInput);
 
 signals:
 
@@ -106,6 +109,9 @@ private:
 
   QRect imageRect_;
   QRect iconRect_;
+
+  QMutex drawSizeMutex_;
+  QSize drawSize_;
   QRect borderRect_;
 
   bool firstImageReceived_;
@@ -116,7 +122,7 @@ private:
   struct Frame
   {
     QImage image;
-    std::unique_ptr<uchar[]> data;
+    std::shared_ptr<uchar[]> data;
     int64_t timestamp;
   };
 
@@ -127,7 +133,7 @@ private:
 
   QMutex roiMutex_;
   size_t currentSize_;
-  std::unique_ptr<int8_t[]> currentMask_;
+  std::shared_ptr<int8_t[]> currentMask_;
 
   bool drawOverlay_;
   QImage overlay_;
@@ -46,13 +46,13 @@ void VideoGLWidget::resetOverlay()
 }
 
 
-std::unique_ptr<int8_t[]> VideoGLWidget::getRoiMask(int& width, int& height, int qp, bool scaleToInput)
+std::shared_ptr<int8_t[]> VideoGLWidget::getRoiMask(int& width, int& height, int qp, bool scaleToInput)
 {
   return helper_.getRoiMask(width, height, qp, scaleToInput);
 }
 
 
-void VideoGLWidget::inputImage(std::unique_ptr<uchar[]> data, QImage &image, int64_t timestamp)
+void VideoGLWidget::inputImage(std::shared_ptr<uchar[]> data, QImage &image, int64_t timestamp)
 {
   drawMutex_.lock();
   // if the resolution has changed in video
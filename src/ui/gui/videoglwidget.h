@@ -33,9 +33,9 @@ public:
   }
 
   // Takes ownership of the image data
-  void inputImage(std::unique_ptr<uchar[]> data, QImage &image, int64_t timestamp);
+  void inputImage(std::shared_ptr<uchar[]> data, QImage &image, int64_t timestamp);
 
-  virtual std::unique_ptr<int8_t[]> getRoiMask(int& width, int& height, int qp, bool scaleToInput);
+  virtual std::shared_ptr<int8_t[]> getRoiMask(int& width, int& height, int qp, bool scaleToInput);
 
   virtual void drawMicOffIcon(bool status);
 
@@ -48,6 +48,11 @@ public:
     return VIDEO_RGB32;
   }
 
+  virtual QSize drawSize()
+  {
+    return helper_.getDrawSize();
+  }
+
   virtual bool isVisible()
   {
     return QWidget::isVisible();
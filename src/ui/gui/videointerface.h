@@ -28,8 +28,8 @@ public:
   // set stats to use with this video view.
   virtual void setStats(StatisticsInterface* stats) = 0;
 
-  // Takes ownership of the image data
-  virtual void inputImage(std::unique_ptr<uchar[]> data, QImage &image, int64_t timestamp) = 0;
+  // Shares the ownership of the image data. The data must not be modified.
+  virtual void inputImage(std::shared_ptr<uchar[]> data, QImage &image, int64_t timestamp) = 0;
 
 #ifdef KVAZZUP_HAVE_ONNX_RUNTIME
   virtual void inputDetections(std::vector<Detection> detections, QSize original_size, int64_t timestamp) = 0;
@@ -41,11 +41,15 @@ public:
                              bool showGrid, bool pixelBased, QSize videoResolution) = 0;
   virtual void resetOverlay() = 0;
 
-  virtual std::unique_ptr<int8_t[]> getRoiMask(int& width, int& height, int qp, 
+  virtual std::shared_ptr<int8_t[]> getRoiMask(int& width, int& height, int qp, 
                                                bool scaleToInput) = 0;
 
   virtual VideoFormat supportedFormat() = 0;
 
+  // The size in pixels the video is drawn at, empty until the first frame has
+  // been drawn. May be called from any thread.
+  virtual QSize drawSize() = 0;
+
 signals:
   virtual void reattach(LayoutID layoutID) = 0;
   virtual void detach(LayoutID layoutID) = 0;
@@ -49,14 +49,14 @@ void VideoWidget::resetOverlay()
 }
 
 
-std::unique_ptr<int8_t[]> VideoWidget::getRoiMask(int& width, int& height,
+std::shared_ptr<int8_t[]> VideoWidget::getRoiMask(int& width, int& height,
                                                   int qp, bool scaleToInput)
 {
   return helper_.getRoiMask(width, height, qp, scaleToInput);
 }
 
 
-void VideoWidget::inputImage(std::unique_ptr<uchar[]> data, QImage &image,
+void VideoWidget::inputImage(std::shared_ptr<uchar[]> data, QImage &image,
                              int64_t timestamp)
 {
   drawMutex_.lock();
@@ -30,7 +30,7 @@ public:
   }
 
   // Takes ownership of the image data
-  virtual void inputImage(std::unique_ptr<uchar[]> data, QImage &image, int64_t timestamp);
+  virtual void inputImage(std::shared_ptr<uchar[]> data, QImage &image, int64_t timestamp);
 
 #ifdef KVAZZUP_HAVE_ONNX_RUNTIME
   virtual void inputDetections(std::vector<Detection> detections, QSize original_size, int64_t timestamp);
@@ -42,13 +42,18 @@ public:
                              bool showGrid, bool pixelBased, QSize videoResolution);
   virtual void resetOverlay();
 
-  virtual std::unique_ptr<int8_t[]> getRoiMask(int& width, int& height, int qp, bool scaleToInput);
+  virtual std::shared_ptr<int8_t[]> getRoiMask(int& width, int& height, int qp, bool scaleToInput);
 
   virtual VideoFormat supportedFormat()
   {
     return VIDEO_RGB32;
   }
 
+  virtual QSize drawSize()
+  {
+    return helper_.getDrawSize();
+  }
+
   virtual bool isVisible()
   {
     return QWidget::isVisible();
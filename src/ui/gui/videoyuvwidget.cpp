@@ -50,13 +50,13 @@ void VideoYUVWidget::resetOverlay()
 }
 
 
-std::unique_ptr<int8_t[]> VideoYUVWidget::getRoiMask(int& width, int& height, int qp, bool scaleToInput)
+std::shared_ptr<int8_t[]> VideoYUVWidget::getRoiMask(int& width, int& height, int qp, bool scaleToInput)
 {
   return helper_.getRoiMask(width, height, qp, scaleToInput);
 }
 
 
-void VideoYUVWidget::inputImage(std::unique_ptr<uchar[]> data, QImage &image, int64_t timestamp)
+void VideoYUVWidget::inputImage(std::shared_ptr<uchar[]> data, QImage &image, int64_t timestamp)
 {
   Q_ASSERT(data != nullptr);
   drawMutex_.lock();
@@ -34,7 +34,7 @@ public:
   }
 
   // Takes ownership of the image data
-  void inputImage(std::unique_ptr<uchar[]> data, QImage &image, int64_t timestamp);
+  void inputImage(std::shared_ptr<uchar[]> data, QImage &image, int64_t timestamp);
 
   static unsigned int number_;
 
@@ -44,7 +44,7 @@ public:
                              bool showGrid, bool pixelBased, QSize videoResolution);
   virtual void resetOverlay();
 
-  virtual std::unique_ptr<int8_t[]> getRoiMask(int& width, int& height, int qp, bool scaleToInput);
+  virtual std::shared_ptr<int8_t[]> getRoiMask(int& width, int& height, int qp, bool scaleToInput);
 
   virtual VideoFormat supportedFormat()
   {
@@ -52,6 +52,11 @@ public:
     return VIDEO_YUV420;
   }
 
+  virtual QSize drawSize()
+  {
+    return helper_.getDrawSize();
+  }
+
   virtual bool isVisible()
   {
     return QWidget::isVisible();
@@ -75,8 +75,6 @@ bool DefaultSettings::validateVideoSettings()
   const QStringList neededSettings = {SettingsKey::videoResolutionWidth,
                                       SettingsKey::videoResolutionHeight,
                                       SettingsKey::videoInputFormat,
-                                      SettingsKey::videoYUVThreads,
-                                      SettingsKey::videoRGBThreads,
                                       SettingsKey::videoOpenHEVCThreads,
                                       SettingsKey::videoOHParallelization,
                                       SettingsKey::videoFramerateNumerator,
@@ -191,12 +189,11 @@ void DefaultSettings::setDefaultVideoSettings(std::shared_ptr<CameraInfo> cam)
      * but when receiving high resolution, "Frame and Slice" may be needed
      * (TODO: mode selection should be done based on received resolution to minimize latency).
      *
-     * YUV and RGB conversions should be able to handle everything expect 4K with one thread. */
+     * The conversion threads are picked for each frame by the row band pool, so they
+     * have no setting. */
     settings_.setValue(SettingsKey::videoKvzThreads, threads);
     settings_.setValue(SettingsKey::videoOpenHEVCThreads, 1);
     settings_.setValue(SettingsKey::videoOHParallelization, "Slice");
-    settings_.setValue(SettingsKey::videoYUVThreads, 1);
-    settings_.setValue(SettingsKey::videoRGBThreads, 1);
     settings_.setValue(SettingsKey::videoOWF, 0);
   }
   else if (threads <= 8)
@@ -204,8 +201,6 @@ void DefaultSettings::setDefaultVideoSettings(std::shared_ptr<CameraInfo> cam)
     settings_.setValue(SettingsKey::videoKvzThreads, threads - 1);
     settings_.setValue(SettingsKey::videoOpenHEVCThreads, 2);
     settings_.setValue(SettingsKey::videoOHParallelization, "Slice");
-    settings_.setValue(SettingsKey::videoYUVThreads, 1);
-    settings_.setValue(SettingsKey::videoRGBThreads, 1);
     settings_.setValue(SettingsKey::videoOWF, 0);
   }
   else if (threads <= 16)
@@ -213,8 +208,6 @@ void DefaultSettings::setDefaultVideoSettings(std::shared_ptr<CameraInfo> cam)
     settings_.setValue(SettingsKey::videoKvzThreads, threads - 2);
     settings_.setValue(SettingsKey::videoOpenHEVCThreads, 4);
     settings_.setValue(SettingsKey::videoOHParallelization, "Slice");
-    settings_.setValue(SettingsKey::videoYUVThreads, 1);
-    settings_.setValue(SettingsKey::videoRGBThreads, 1);
     settings_.setValue(SettingsKey::videoOWF, 0);
   }
   else if (threads <= 24)
@@ -222,8 +215,6 @@ void DefaultSettings::setDefaultVideoSettings(std::shared_ptr<CameraInfo> cam)
     settings_.setValue(SettingsKey::videoKvzThreads, threads - 2);
     settings_.setValue(SettingsKey::videoOpenHEVCThreads, 6);
     settings_.setValue(SettingsKey::videoOHParallelization, "Slice");
-    settings_.setValue(SettingsKey::videoYUVThreads, 1);
-    settings_.setValue(SettingsKey::videoRGBThreads, 1);
     settings_.setValue(SettingsKey::videoOWF, 1);
   }
   else
@@ -231,8 +222,6 @@ void DefaultSettings::setDefaultVideoSettings(std::shared_ptr<CameraInfo> cam)
     settings_.setValue(SettingsKey::videoKvzThreads, threads - 3);
     settings_.setValue(SettingsKey::videoOpenHEVCThreads, 8);
     settings_.setValue(SettingsKey::videoOHParallelization, "Frame and Slice");
-    settings_.setValue(SettingsKey::videoYUVThreads, 2);
-    settings_.setValue(SettingsKey::videoRGBThreads, 2);
     settings_.setValue(SettingsKey::videoOWF, 2);
   }
 
@@ -263,12 +252,16 @@ void DefaultSettings::setDefaultVideoSettings(std::shared_ptr<CameraInfo> cam)
   settings_.setValue(SettingsKey::videoFramerateDenominator,     denominator);
 
   settings_.setValue(SettingsKey::videoOpenGL, 0); // TODO: When can we enable this?
+  settings_.setValue(SettingsKey::videoFilterThreadPool, 0);
+  settings_.setValue(SettingsKey::videoFilterFusion, 0);
+  settings_.setValue(SettingsKey::videoPrintFilterGraph, 0);
+  settings_.setValue(SettingsKey::videoSimulcastLayers, 1);
   settings_.setValue(SettingsKey::videoQP, 32);
 
   // video calls work better with high intra period
   settings_.setValue(SettingsKey::videoIntra, 64); // TODO: Fix faster intra, so this can be increased
   settings_.setValue(SettingsKey::videoTiles, 0);
-  settings_.setValue(SettingsKey::videoSlices, 0); // TODO: Fix slices and enable tiles
+  settings_.setValue(SettingsKey::videoSlices, 0); // low latency mode, disables OWF
   settings_.setValue(SettingsKey::videoWPP, 1);
   settings_.setValue(SettingsKey::videoVPS, 1);
   settings_.setValue(SettingsKey::videoOBAClipNeighbours, 0);
@@ -277,6 +270,7 @@ void DefaultSettings::setDefaultVideoSettings(std::shared_ptr<CameraInfo> cam)
   settings_.setValue(SettingsKey::videoMVConstraint, "none");
   settings_.setValue(SettingsKey::videoQPInCU, 0);
   settings_.setValue(SettingsKey::videoVAQ, "disabled");
+  settings_.setValue(SettingsKey::videoStandbyEncoder, 1); // faster intra frames, more memory
 
   settings_.setValue(SettingsKey::videoRCAlgorithm, "lambda");
 
@@ -159,10 +159,6 @@ void VideoSettings::saveSettings()
 
   saveTextValue(SettingsKey::videoOpenHEVCThreads,  videoSettingsUI_->openhevc_threads->text(),
                 settings_);
-  saveTextValue(SettingsKey::videoYUVThreads,       videoSettingsUI_->yuv_threads->text(),
-                settings_);
-  saveTextValue(SettingsKey::videoRGBThreads,       videoSettingsUI_->rgb32_threads->text(),
-                settings_);
 
   // structure-tab
   settings_.setValue(SettingsKey::videoQP,          QString::number(videoSettingsUI_->qp->value()));
@@ -204,6 +200,11 @@ void VideoSettings::saveSettings()
 
   // Other-tab
   saveCheckBox(SettingsKey::videoOpenGL,         videoSettingsUI_->opengl, settings_);
+  saveCheckBox(SettingsKey::videoFilterThreadPool, videoSettingsUI_->filter_thread_pool, settings_);
+  saveCheckBox(SettingsKey::videoFilterFusion, videoSettingsUI_->filter_fusion, settings_);
+  saveCheckBox(SettingsKey::videoPrintFilterGraph, videoSettingsUI_->print_filter_graph, settings_);
+  saveTextValue(SettingsKey::videoSimulcastLayers, videoSettingsUI_->simulcast_layers->text(), settings_);
+  saveCheckBox(SettingsKey::videoStandbyEncoder, videoSettingsUI_->standby_encoder, settings_);
 }
 
 
@@ -316,10 +317,6 @@ void VideoSettings::restoreSettings()
 
   videoSettingsUI_->openhevc_threads->setValue(
         settings_.value(SettingsKey::videoOpenHEVCThreads).toInt());
-  videoSettingsUI_->yuv_threads->setValue(
-        settings_.value(SettingsKey::videoYUVThreads).toInt());
-  videoSettingsUI_->rgb32_threads->setValue(
-        settings_.value(SettingsKey::videoRGBThreads).toInt());
 
   updateSliceBoxStatus();
 
@@ -368,6 +365,11 @@ void VideoSettings::restoreSettings()
 
   // other-tab
   restoreCheckBox(SettingsKey::videoOpenGL, videoSettingsUI_->opengl, settings_);
+  restoreCheckBox(SettingsKey::videoFilterThreadPool, videoSettingsUI_->filter_thread_pool, settings_);
+  restoreCheckBox(SettingsKey::videoFilterFusion, videoSettingsUI_->filter_fusion, settings_);
+  restoreCheckBox(SettingsKey::videoPrintFilterGraph, videoSettingsUI_->print_filter_graph, settings_);
+  videoSettingsUI_->simulcast_layers->setValue(settings_.value(SettingsKey::videoSimulcastLayers).toInt());
+  restoreCheckBox(SettingsKey::videoStandbyEncoder, videoSettingsUI_->standby_encoder, settings_);
 
 }
 
@@ -482,8 +484,6 @@ void VideoSettings::initializeThreads()
   }
 
   videoSettingsUI_->openhevc_threads->setMaximum(maxThreads);
-  videoSettingsUI_->yuv_threads->setMaximum(maxThreads);
-  videoSettingsUI_->rgb32_threads->setMaximum(maxThreads);
 }
 
 
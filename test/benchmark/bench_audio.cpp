@@ -0,0 +1,97 @@
+#include "../../src/media/processing/audiomixer.h"
+#include "../../src/media/processing/audioframebuffer.h"
+#include "../../src/global.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <vector>
+
+// The audio format used by the filter graph, mono 16-bit samples at 48 kHz
+const uint32_t SAMPLE_RATE = 48000;
+const uint32_t FRAME_BYTES = SAMPLE_RATE/AUDIO_FRAMES_PER_SECOND*sizeof(int16_t);
+
+
+static std::unique_ptr<Data> audioFrame(std::shared_ptr<uchar[]> payload)
+{
+  std::unique_ptr<Data> frame(new Data);
+  frame->source = DS_REMOTE;
+  frame->type = DT_RAWAUDIO;
+  frame->data = payload;
+  frame->data_size = FRAME_BYTES;
+  frame->aInfo.emplace();
+  frame->aInfo->sampleRate = SAMPLE_RATE;
+  return frame;
+}
+
+
+// One mixed frame per iteration, the argument is the number of participants.
+// AudioMixer::doMixing is private, so it is reached through mixAudio, which
+// mixes when the last participant provides its frame.
+static void BM_AudioMixer_doMixing(benchmark::State& state)
+{
+  uint32_t participants = (uint32_t)state.range(0);
+
+  AudioMixer mixer;
+  for (uint32_t i = 0; i < participants; ++i)
+  {
+    mixer.addInput();
+  }
+
+  std::vector<std::shared_ptr<uchar[]>> payloads;
+  for (uint32_t i = 0; i < participants; ++i)
+  {
+    payloads.push_back(std::shared_ptr<uchar[]>(new uchar[FRAME_BYTES]));
+
+    int16_t* samples = (int16_t*)payloads.back().get();
+    for (uint32_t j = 0; j < FRAME_BYTES/sizeof(int16_t); ++j)
+    {
+      samples[j] = (int16_t)((j*(i + 3)*331)%20000 - 10000);
+    }
+  }
+
+  for (auto _ : state)
+  {
+    std::unique_ptr<Data> mixed = nullptr;
+    for (uint32_t i = 0; i < participants; ++i)
+    {
+      mixed = mixer.mixAudio(audioFrame(payloads.at(i)), audioFrame(nullptr), i + 1);
+    }
+
+    benchmark::DoNotOptimize(mixed.get());
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations()*participants*FRAME_BYTES);
+}
+BENCHMARK(BM_AudioMixer_doMixing)->ArgName("participants")->Arg(2)->Arg(4)->Arg(8);
+
+
+// Input arrives in pieces of the argument size, like from the audio device,
+// and is read out as frames of the encoder size.
+static void BM_AudioFrameBuffer(benchmark::State& state)
+{
+  uint32_t inputSize = (uint32_t)state.range(0);
+
+  AudioFrameBuffer buffer(FRAME_BYTES);
+  std::vector<uint8_t> input(inputSize, 0x55);
+
+  uint64_t frames = 0;
+  for (auto _ : state)
+  {
+    buffer.inputData(input.data(), inputSize);
+
+    uint8_t* frame = buffer.readFrame();
+    while (frame != nullptr)
+    {
+      benchmark::DoNotOptimize(frame);
+      delete[] frame;
+      ++frames;
+      frame = buffer.readFrame();
+    }
+  }
+
+  state.SetBytesProcessed(state.iterations()*inputSize);
+  state.counters["frames"] = benchmark::Counter((double)frames, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_AudioFrameBuffer)->ArgName("input_bytes")->Arg(256)->Arg(FRAME_BYTES)->Arg(4096);
@@ -0,0 +1,432 @@
+#include "benchmarkstats.h"
+
+#include "../../src/media/processing/yuvconversions.h"
+#include "../../src/media/processing/libyuvconverter.h"
+#include "../../src/media/resourceallocator.h"
+
+#include <benchmark/benchmark.h>
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Each conversion is measured with a whole frame of the common camera and
+// stream resolutions. Items are frames and bytes are the bytes read.
+
+static void videoResolutions(benchmark::internal::Benchmark* bench)
+{
+  bench->ArgNames({"width", "height"});
+  bench->Args({640,  360});
+  bench->Args({1280, 720});
+  bench->Args({1920, 1080});
+}
+
+
+static uint32_t yuv420Size(uint32_t width, uint32_t height)
+{
+  return width*height + 2*((width + 1)/2)*((height + 1)/2);
+}
+
+
+static bool requireAVX2(benchmark::State& state)
+{
+  if (!is_avx2_available())
+  {
+    state.SkipWithError("AVX2 is not available");
+    return false;
+  }
+  return true;
+}
+
+
+static bool requireSSE41(benchmark::State& state)
+{
+  if (!is_sse41_available())
+  {
+    state.SkipWithError("SSE4.1 is not available");
+    return false;
+  }
+  return true;
+}
+
+
+static void runConversion(benchmark::State& state,
+                          std::function<void(uint8_t* input, uint8_t* output)> convert,
+                          uint32_t inputSize, uint32_t outputSize)
+{
+  std::vector<uint8_t> input(inputSize);
+  std::vector<uint8_t> output(outputSize);
+
+  // something else than a flat color so that clamping is also exercised
+  for (uint32_t i = 0; i < inputSize; ++i)
+  {
+    input[i] = (uint8_t)(i*7 + i/251);
+  }
+
+  for (auto _ : state)
+  {
+    convert(input.data(), output.data());
+    benchmark::DoNotOptimize(output.data());
+    benchmark::ClobberMemory();
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations()*inputSize);
+}
+
+
+// ===== YUV420 to RGB32 =====
+
+static void BM_yuv420_to_rgb_i_avx2(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  if (requireAVX2(state))
+  {
+    runConversion(state, [=](uint8_t* in, uint8_t* out)
+    { yuv420_to_rgb_i_avx2(in, out, width, height); },
+    yuv420Size(width, height), width*height*4);
+  }
+}
+BENCHMARK(BM_yuv420_to_rgb_i_avx2)->Apply(videoResolutions);
+
+
+static void BM_yuv420_to_rgb_i_sse41(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  if (requireSSE41(state))
+  {
+    runConversion(state, [=](uint8_t* in, uint8_t* out)
+    { yuv420_to_rgb_i_sse41(in, out, width, height); },
+    yuv420Size(width, height), width*height*4);
+  }
+}
+BENCHMARK(BM_yuv420_to_rgb_i_sse41)->Apply(videoResolutions);
+
+
+static void BM_yuv420_to_rgb_i_c(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  runConversion(state, [=](uint8_t* in, uint8_t* out)
+  { yuv420_to_rgb_i_c(in, out, width, height); },
+  yuv420Size(width, height), width*height*4);
+}
+BENCHMARK(BM_yuv420_to_rgb_i_c)->Apply(videoResolutions);
+
+
+// The row versions convert one quarter of the frame, which is what one
+// thread of the row band pool does with four bands.
+
+static void BM_yuv420_to_rgb_i_avx2_rows(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  uint16_t band = (height/4) & ~1;
+  if (requireAVX2(state))
+  {
+    runConversion(state, [=](uint8_t* in, uint8_t* out)
+    { yuv420_to_rgb_i_avx2_rows(in, out, width, height, band, 2*band); },
+    yuv420Size(width, height), width*height*4);
+  }
+}
+BENCHMARK(BM_yuv420_to_rgb_i_avx2_rows)->Apply(videoResolutions);
+
+
+static void BM_yuv420_to_rgb_i_sse41_rows(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  uint16_t band = (height/4) & ~1;
+  if (requireSSE41(state))
+  {
+    runConversion(state, [=](uint8_t* in, uint8_t* out)
+    { yuv420_to_rgb_i_sse41_rows(in, out, width, height, band, 2*band); },
+    yuv420Size(width, height), width*height*4);
+  }
+}
+BENCHMARK(BM_yuv420_to_rgb_i_sse41_rows)->Apply(videoResolutions);
+
+
+static void BM_yuv420_to_rgb_i_c_rows(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  uint16_t band = (height/4) & ~1;
+  runConversion(state, [=](uint8_t* in, uint8_t* out)
+  { yuv420_to_rgb_i_c_rows(in, out, width, height, band, 2*band); },
+  yuv420Size(width, height), width*height*4);
+}
+BENCHMARK(BM_yuv420_to_rgb_i_c_rows)->Apply(videoResolutions);
+
+
+// scaled to a typical self view size and mirrored like the self view
+
+static void BM_yuv420_to_rgb_scaled_avx2(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  if (requireAVX2(state))
+  {
+    runConversion(state, [=](uint8_t* in, uint8_t* out)
+    { yuv420_to_rgb_scaled_avx2(in, out, width, height, width/4, height/4, true, false); },
+    yuv420Size(width, height), (width/4)*(height/4)*4);
+  }
+}
+BENCHMARK(BM_yuv420_to_rgb_scaled_avx2)->Apply(videoResolutions);
+
+
+static void BM_yuv420_to_rgb_scaled_c(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  runConversion(state, [=](uint8_t* in, uint8_t* out)
+  { yuv420_to_rgb_scaled_c(in, out, width, height, width/4, height/4, true, false); },
+  yuv420Size(width, height), (width/4)*(height/4)*4);
+}
+BENCHMARK(BM_yuv420_to_rgb_scaled_c)->Apply(videoResolutions);
+
+
+// ===== to YUV420 =====
+
+static void BM_rgb_to_yuv420_i_avx2(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  if (requireAVX2(state))
+  {
+    runConversion(state, [=](uint8_t* in, uint8_t* out)
+    { rgb_to_yuv420_i_avx2(in, out, width, height); },
+    width*height*4, yuv420Size(width, height));
+  }
+}
+BENCHMARK(BM_rgb_to_yuv420_i_avx2)->Apply(videoResolutions);
+
+
+static void BM_rgb_to_yuv420_i_sse41(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  if (requireSSE41(state))
+  {
+    runConversion(state, [=](uint8_t* in, uint8_t* out)
+    { rgb_to_yuv420_i_sse41(in, out, width, height); },
+    width*height*4, yuv420Size(width, height));
+  }
+}
+BENCHMARK(BM_rgb_to_yuv420_i_sse41)->Apply(videoResolutions);
+
+
+static void BM_rgb_to_yuv420_i_c(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  runConversion(state, [=](uint8_t* in, uint8_t* out)
+  { rgb_to_yuv420_i_c(in, out, width, height); },
+  width*height*4, yuv420Size(width, height));
+}
+BENCHMARK(BM_rgb_to_yuv420_i_c)->Apply(videoResolutions);
+
+
+static void BM_yuyv_to_yuv420_avx2(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  if (requireAVX2(state))
+  {
+    runConversion(state, [=](uint8_t* in, uint8_t* out)
+    { yuyv_to_yuv420_avx2(in, out, width, height); },
+    width*height*2, yuv420Size(width, height));
+  }
+}
+BENCHMARK(BM_yuyv_to_yuv420_avx2)->Apply(videoResolutions);
+
+
+static void BM_yuyv_to_yuv420_c(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  runConversion(state, [=](uint8_t* in, uint8_t* out)
+  { yuyv_to_yuv420_c(in, out, width, height); },
+  width*height*2, yuv420Size(width, height));
+}
+BENCHMARK(BM_yuyv_to_yuv420_c)->Apply(videoResolutions);
+
+
+static void BM_nv12_to_yuv420_avx2(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  if (requireAVX2(state))
+  {
+    runConversion(state, [=](uint8_t* in, uint8_t* out)
+    { nv12_to_yuv420_avx2(in, out, width, height); },
+    yuv420Size(width, height), yuv420Size(width, height));
+  }
+}
+BENCHMARK(BM_nv12_to_yuv420_avx2)->Apply(videoResolutions);
+
+
+static void BM_nv12_to_yuv420_c(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  runConversion(state, [=](uint8_t* in, uint8_t* out)
+  { nv12_to_yuv420_c(in, out, width, height); },
+  yuv420Size(width, height), yuv420Size(width, height));
+}
+BENCHMARK(BM_nv12_to_yuv420_c)->Apply(videoResolutions);
+
+
+static void BM_yuyv_to_rgb_c(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  runConversion(state, [=](uint8_t* in, uint8_t* out)
+  { yuyv_to_rgb_c(in, out, width, height); },
+  width*height*2, width*height*4);
+}
+BENCHMARK(BM_yuyv_to_rgb_c)->Apply(videoResolutions);
+
+
+// ===== RGB32 =====
+
+static void BM_half_rgb_avx2(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  if (requireAVX2(state))
+  {
+    runConversion(state, [=](uint8_t* in, uint8_t* out)
+    { half_rgb_avx2(in, out, width, height); },
+    width*height*4, width*height);
+  }
+}
+BENCHMARK(BM_half_rgb_avx2)->Apply(videoResolutions);
+
+
+static void BM_half_rgb(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  runConversion(state, [=](uint8_t* in, uint8_t* out)
+  { half_rgb(in, out, width, height); },
+  width*height*4, width*height);
+}
+BENCHMARK(BM_half_rgb)->Apply(videoResolutions);
+
+
+static void BM_flip_rgb_avx2(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  if (requireAVX2(state))
+  {
+    runConversion(state, [=](uint8_t* in, uint8_t* out)
+    { flip_rgb_avx2(in, out, width, height, true, true); },
+    width*height*4, width*height*4);
+  }
+}
+BENCHMARK(BM_flip_rgb_avx2)->Apply(videoResolutions);
+
+
+static void BM_flip_rgb(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+  runConversion(state, [=](uint8_t* in, uint8_t* out)
+  { flip_rgb(in, out, width, height, true, true); },
+  width*height*4, width*height*4);
+}
+BENCHMARK(BM_flip_rgb)->Apply(videoResolutions);
+
+
+// ===== LibYUVConverter =====
+
+// Runs the converter on the benchmark thread without starting the filter
+class BenchmarkConverter : public LibYUVConverter
+{
+public:
+  BenchmarkConverter(StatisticsInterface* stats,
+                     std::shared_ptr<ResourceAllocator> hwResources, DataType input):
+    LibYUVConverter("Benchmark", stats, hwResources, input)
+  {
+    addDataOutCallback(this, &BenchmarkConverter::discardOutput);
+  }
+
+  void convert(std::unique_ptr<Data> input)
+  {
+    putInput(std::move(input));
+    process();
+  }
+
+private:
+
+  // the payload goes back to the frame pool
+  void discardOutput(std::unique_ptr<Data> output)
+  {
+    benchmark::DoNotOptimize(output.get());
+  }
+};
+
+
+template <DataType type>
+static void BM_LibYUVConverter(benchmark::State& state)
+{
+  uint16_t width = (uint16_t)state.range(0);
+  uint16_t height = (uint16_t)state.range(1);
+
+  uint32_t frameSize = 0;
+  switch (type)
+  {
+    case DT_NV12VIDEO:
+    {
+      frameSize = yuv420Size(width, height);
+      break;
+    }
+    case DT_YUYVVIDEO:
+    {
+      frameSize = width*height*2;
+      break;
+    }
+    default:
+    {
+      frameSize = width*height*4;
+      break;
+    }
+  }
+
+  BenchmarkStats stats;
+  std::shared_ptr<ResourceAllocator> hwResources = std::make_shared<ResourceAllocator>();
+  BenchmarkConverter converter(&stats, hwResources, type);
+
+  // the payload is only read, so all frames share it
+  std::shared_ptr<uchar[]> payload(new uchar[frameSize]);
+  for (uint32_t i = 0; i < frameSize; ++i)
+  {
+    payload[i] = (uchar)(i*7 + i/251);
+  }
+
+  for (auto _ : state)
+  {
+    std::unique_ptr<Data> frame(new Data);
+    frame->source = DS_LOCAL;
+    frame->type = type;
+    frame->data = payload;
+    frame->data_size = frameSize;
+    frame->vInfo.emplace();
+    frame->vInfo->width = width;
+    frame->vInfo->height = height;
+    frame->vInfo->framerateNumerator = 30;
+    frame->vInfo->framerateDenominator = 1;
+
+    converter.convert(std::move(frame));
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations()*frameSize);
+}
+BENCHMARK_TEMPLATE(BM_LibYUVConverter, DT_NV12VIDEO)->Apply(videoResolutions);
+BENCHMARK_TEMPLATE(BM_LibYUVConverter, DT_YUYVVIDEO)->Apply(videoResolutions);
+BENCHMARK_TEMPLATE(BM_LibYUVConverter, DT_RGB32VIDEO)->Apply(videoResolutions);
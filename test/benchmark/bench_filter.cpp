@@ -0,0 +1,115 @@
+#include "benchmarkstats.h"
+
+#include "../../src/media/processing/filter.h"
+#include "../../src/media/resourceallocator.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+// A filter which is not started, the benchmark takes its input directly
+class QueueFilter : public Filter
+{
+public:
+  QueueFilter(StatisticsInterface* stats, std::shared_ptr<ResourceAllocator> hwResources):
+    Filter("Benchmark", "Queue", stats, hwResources, DT_RAWAUDIO, DT_RAWAUDIO)
+  {
+    // nothing is dropped so that every item is measured
+    setBackpressurePolicy(std::make_shared<DropOldestPolicy>(0));
+  }
+
+  std::unique_ptr<Data> take()
+  {
+    return getInput();
+  }
+
+protected:
+
+  void process()
+  {}
+};
+
+
+static std::unique_ptr<Data> queueItem(std::shared_ptr<uchar[]> payload)
+{
+  std::unique_ptr<Data> item(new Data);
+  item->source = DS_LOCAL;
+  item->type = DT_RAWAUDIO;
+  item->data = payload;
+  item->data_size = 1;
+  item->aInfo.emplace();
+  return item;
+}
+
+
+// Puts the argument number of items to the queue and takes them out on the
+// same thread, which measures the cost of the queue without contention.
+static void BM_Filter_queue(benchmark::State& state)
+{
+  uint32_t batch = (uint32_t)state.range(0);
+
+  BenchmarkStats stats;
+  QueueFilter filter(&stats, std::make_shared<ResourceAllocator>());
+  std::shared_ptr<uchar[]> payload(new uchar[1]);
+
+  for (auto _ : state)
+  {
+    for (uint32_t i = 0; i < batch; ++i)
+    {
+      filter.putInput(queueItem(payload));
+    }
+
+    for (uint32_t i = 0; i < batch; ++i)
+    {
+      benchmark::DoNotOptimize(filter.take());
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations()*batch);
+}
+BENCHMARK(BM_Filter_queue)->ArgName("batch")->Arg(1)->Arg(16)->Arg(128);
+
+
+// One producer and one consumer thread like between two running filters
+static void BM_Filter_queue_threaded(benchmark::State& state)
+{
+  BenchmarkStats stats;
+  QueueFilter filter(&stats, std::make_shared<ResourceAllocator>());
+  std::shared_ptr<uchar[]> payload(new uchar[1]);
+
+  std::atomic<bool> running(true);
+  std::atomic<uint64_t> taken(0);
+
+  std::thread consumer([&]()
+  {
+    while (running.load())
+    {
+      if (filter.take())
+      {
+        ++taken;
+      }
+    }
+  });
+
+  uint64_t put = 0;
+  for (auto _ : state)
+  {
+    // the queue is kept from filling up so that nothing is dropped
+    while (put - taken.load() >= 128)
+    {}
+
+    filter.putInput(queueItem(payload));
+    ++put;
+  }
+
+  while (taken.load() < put)
+  {}
+
+  running = false;
+  consumer.join();
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Filter_queue_threaded)->UseRealTime();
@@ -0,0 +1,145 @@
+#include "../../src/stunmessage.h"
+#include "../../src/stunmessagefactory.h"
+#include "../../src/initiation/transport/siptransporthelper.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+
+// ===== STUN =====
+
+// a binding request like the ones sent during ICE connectivity checks
+static STUNMessage iceRequest(StunMessageFactory& factory)
+{
+  STUNMessage request = factory.createRequest();
+  request.addAttribute(STUN_ATTR_ICE_CONTROLLING);
+  request.addAttribute(STUN_ATTR_PRIORITY, 0x6e0001ff);
+  request.addAttribute(STUN_ATTR_USE_CANDIDATE);
+  return request;
+}
+
+
+static void BM_STUNMessage_encode(benchmark::State& state)
+{
+  StunMessageFactory factory;
+  STUNMessage request = iceRequest(factory);
+
+  for (auto _ : state)
+  {
+    QByteArray message = factory.hostToNetwork(request);
+    benchmark::DoNotOptimize(message.data());
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_STUNMessage_encode);
+
+
+static void BM_STUNMessage_decode(benchmark::State& state)
+{
+  StunMessageFactory factory;
+  STUNMessage request = iceRequest(factory);
+  QByteArray message = factory.hostToNetwork(request);
+
+  for (auto _ : state)
+  {
+    STUNMessage decoded;
+    benchmark::DoNotOptimize(factory.networkToHost(message, decoded));
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations()*message.size());
+}
+BENCHMARK(BM_STUNMessage_decode);
+
+
+static void BM_STUNMessage_xorMappedAddress(benchmark::State& state)
+{
+  StunMessageFactory factory;
+  STUNMessage request = iceRequest(factory);
+  STUNMessage response = factory.createResponse(request);
+  response.setXorMappedAddress(QHostAddress("192.168.1.100"), 23456);
+  QByteArray message = factory.hostToNetwork(response);
+
+  for (auto _ : state)
+  {
+    STUNMessage decoded;
+    std::pair<QHostAddress, uint16_t> address;
+
+    factory.networkToHost(message, decoded);
+    benchmark::DoNotOptimize(decoded.getXorMappedAddress(address));
+  }
+
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_STUNMessage_xorMappedAddress);
+
+
+// ===== SIP =====
+
+static const QString INVITE_HEADER =
+    "INVITE sip:bob@biloxi.example.com SIP/2.0\r\n"
+    "Via: SIP/2.0/TCP client.atlanta.example.com:5060;branch=z9hG4bK74bf9;rport\r\n"
+    "Max-Forwards: 70\r\n"
+    "From: Alice <sip:alice@atlanta.example.com>;tag=9fxced76sl\r\n"
+    "To: Bob <sip:bob@biloxi.example.com>\r\n"
+    "Call-ID: 3848276298220188511@atlanta.example.com\r\n"
+    "CSeq: 1 INVITE\r\n"
+    "Contact: <sip:alice@client.atlanta.example.com;transport=tcp>\r\n"
+    "Allow: INVITE, ACK, CANCEL, BYE, OPTIONS, REGISTER\r\n"
+    "Supported: 100rel, timer\r\n"
+    "User-Agent: Kvazzup\r\n"
+    "Content-Type: application/sdp\r\n"
+    "Content-Length: 244\r\n\r\n";
+
+static const QString INVITE_BODY =
+    "v=0\r\n"
+    "o=alice 2890844526 2890844526 IN IP4 client.atlanta.example.com\r\n"
+    "s=HEVC Video Call\r\n"
+    "c=IN IP4 192.0.2.101\r\n"
+    "t=0 0\r\n"
+    "m=audio 49170 RTP/AVP 96\r\n"
+    "a=rtpmap:96 opus/48000/2\r\n"
+    "a=sendrecv\r\n"
+    "m=video 51372 RTP/AVP 97\r\n"
+    "a=rtpmap:97 H265/90000\r\n"
+    "a=sendrecv\r\n";
+
+
+static void BM_SIP_parseHeader(benchmark::State& state)
+{
+  for (auto _ : state)
+  {
+    QString header = INVITE_HEADER;
+    QString firstLine = "";
+    QList<SIPField> fields;
+
+    headerToFields(header, firstLine, fields);
+
+    std::shared_ptr<SIPMessageHeader> message =
+        std::shared_ptr<SIPMessageHeader> (new SIPMessageHeader);
+
+    benchmark::DoNotOptimize(fieldsToMessageHeader(fields, message));
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations()*INVITE_HEADER.size());
+}
+BENCHMARK(BM_SIP_parseHeader);
+
+
+static void BM_SIP_parseSDP(benchmark::State& state)
+{
+  for (auto _ : state)
+  {
+    QString body = INVITE_BODY;
+    QVariant content;
+
+    parseContent(content, MT_APPLICATION_SDP, body);
+    benchmark::DoNotOptimize(content.isValid());
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations()*INVITE_BODY.size());
+}
+BENCHMARK(BM_SIP_parseSDP);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../../src/statisticsinterface.h"
+
+// Statistics which are thrown away so that they do not affect the results.
+
+class BenchmarkStats : public StatisticsInterface
+{
+public:
+  virtual void addSession(uint32_t sessionID) {}
+  virtual void removeSession(uint32_t sessionID) {}
+
+  virtual void videoInfo(double framerate, QSize resolution) {}
+  virtual void audioInfo(uint32_t sampleRate, uint16_t channelCount) {}
+
+  virtual void incomingMedia(uint32_t sessionID, QString name) {}
+  virtual void outgoingMedia(uint32_t sessionID, QString name) {}
+
+  virtual void selectedICEPair(uint32_t sessionID, std::shared_ptr<ICEPair> pair) {}
+
+  virtual void sendDelay(QString type, uint32_t delay) {}
+  virtual void receiveDelay(uint32_t sessionID, QString type, int32_t delay) {}
+  virtual void presentPackage(uint32_t sessionID, QString type) {}
+  virtual void addEncodedPacket(QString type, uint32_t size) {}
+
+  virtual void addSendPacket(uint32_t size) {}
+  virtual void addReceivePacket(uint32_t sessionID, QString type, uint32_t size) {}
+  virtual void addRTCPPacket(uint32_t sessionID, QString type,
+                             uint8_t  fraction,
+                             int32_t  lost,
+                             uint32_t last_seq,
+                             uint32_t jitter) {}
+
+  virtual uint32_t addFilter(QString type, QString identifier, uint64_t TID)
+  {
+    return 0;
+  }
+  virtual void removeFilter(uint32_t id) {}
+
+  virtual void updateBufferStatus(uint32_t id, uint16_t buffersize,
+                                  uint16_t maxBufferSize) {}
+  virtual void packetDropped(uint32_t id) {}
+
+  virtual void updateQueueLatency(uint32_t id, LatencyPercentiles latency) {}
+  virtual void updateProcessingLatency(uint32_t id, LatencyPercentiles latency) {}
+
+  virtual void addSentSIPMessage(const QString& headerType, const QString& header,
+                                 const QString& bodyType,   const QString& body) {}
+  virtual void addReceivedSIPMessage(const QString& headerType, const QString& header,
+                                     const QString& bodyType,   const QString& body) {}
+};
@@ -0,0 +1,42 @@
+#include <benchmark/benchmark.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+// The results are printed as JSON unless another format is asked for, so
+// that they can be stored and compared between releases. Use
+// --benchmark_out=<file> to write them to a file instead.
+
+int main(int argc, char **argv)
+{
+  std::vector<char*> args(argv, argv + argc);
+
+  std::string jsonFormat = "--benchmark_format=json";
+  bool formatGiven = false;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strncmp(argv[i], "--benchmark_format", 18) == 0)
+    {
+      formatGiven = true;
+    }
+  }
+
+  if (!formatGiven)
+  {
+    args.push_back(&jsonFormat[0]);
+  }
+
+  int count = (int)args.size();
+  benchmark::Initialize(&count, args.data());
+
+  if (benchmark::ReportUnrecognizedArguments(count, args.data()))
+  {
+    return 1;
+  }
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
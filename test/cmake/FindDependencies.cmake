@@ -21,3 +21,16 @@ add_library(GTest::GMock     ALIAS gmock)
 add_library(GTest::GMockMain ALIAS gmock_main)
 add_library(GTest::GTest     ALIAS gtest)
 add_library(GTest::GTestMain ALIAS gtest_main)
+
+# Google Benchmark
+FetchContent_Declare(
+        googlebenchmark
+        GIT_REPOSITORY https://github.com/google/benchmark.git
+        GIT_TAG        v1.8.3
+)
+
+set(BENCHMARK_ENABLE_TESTING        OFF CACHE BOOL "" FORCE)
+set(BENCHMARK_ENABLE_GTEST_TESTS    OFF CACHE BOOL "" FORCE)
+set(BENCHMARK_ENABLE_INSTALL        OFF CACHE BOOL "" FORCE)
+
+FetchContent_MakeAvailable(googlebenchmark)
@@ -0,0 +1,276 @@
+#include "../src/media/processing/yuvconversions.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+
+// The vector versions must produce exactly the same output as the C versions,
+// including widths where the row has to be finished in C.
+static const std::vector<std::pair<uint16_t, uint16_t>> testResolutions = {
+    {1280, 720}, {642, 6}, {34, 4}, {30, 2}, {2, 2}
+};
+
+
+// YUV420 input may also have odd sizes
+static const std::vector<std::pair<uint16_t, uint16_t>> oddResolutions = {
+    {853, 480}, {853, 479}, {17, 3}
+};
+
+
+static size_t yuv420Size(uint16_t width, uint16_t height)
+{
+    return width*height + 2*((width + 1)/2)*((height + 1)/2);
+}
+
+
+static std::vector<uint8_t> randomFrame(size_t size)
+{
+    std::mt19937 generator(size);
+    std::uniform_int_distribution<int> distribution(0, 255);
+
+    std::vector<uint8_t> frame(size);
+    for (auto& byte : frame)
+    {
+        byte = uint8_t(distribution(generator));
+    }
+    return frame;
+}
+
+
+#define REQUIRE_AVX2() \
+    if (!is_avx2_available()) GTEST_SKIP() << "AVX2 not available"
+
+
+TEST(ConversionTest, yuv420_to_rgb) {
+    REQUIRE_AVX2();
+    for (auto& res : testResolutions)
+    {
+        uint16_t width = res.first;
+        uint16_t height = res.second;
+        std::vector<uint8_t> input = randomFrame(width*height*3/2);
+        std::vector<uint8_t> expected(width*height*4);
+        std::vector<uint8_t> output(width*height*4);
+
+        yuv420_to_rgb_i_c(input.data(), expected.data(), width, height);
+        yuv420_to_rgb_i_avx2(input.data(), output.data(), width, height);
+        EXPECT_EQ(expected, output) << width << "x" << height;
+
+        // converted in two parts like the threaded conversion does
+        std::fill(output.begin(), output.end(), 0);
+        uint16_t middle = height/4*2;
+        yuv420_to_rgb_i_avx2_rows(input.data(), output.data(), width, height, 0, middle);
+        yuv420_to_rgb_i_avx2_rows(input.data(), output.data(), width, height, middle, height);
+        EXPECT_EQ(expected, output) << width << "x" << height << " in rows";
+    }
+}
+
+
+TEST(ConversionTest, yuv420_to_rgb_odd_size) {
+    for (auto& res : oddResolutions)
+    {
+        uint16_t width = res.first;
+        uint16_t height = res.second;
+        uint16_t chromaWidth = (width + 1)/2;
+        size_t chromaSize = chromaWidth*((height + 1)/2);
+
+        // each row of U has its own value, so a wrong stride or V offset
+        // shows up as a wrong color
+        std::vector<uint8_t> input(yuv420Size(width, height), 100);
+        uint8_t* planeU = input.data() + width*height;
+        for (size_t i = 0; i < chromaSize; ++i)
+        {
+            planeU[i] = 40 + (i/chromaWidth)%5*10;
+        }
+        std::fill(input.end() - chromaSize, input.end(), 200);
+
+        std::vector<uint8_t> expected(width*height*4);
+        yuv420_to_rgb_i_c(input.data(), expected.data(), width, height);
+        for (int y = 0; y < height; ++y)
+        {
+            uint8_t pixelYUV[3] = {100, uint8_t(40 + (y/2)%5*10), 200};
+            uint8_t pixel[4];
+            yuv420_to_rgb_i_c(pixelYUV, pixel, 1, 1);
+            for (int x = 0; x < width; ++x)
+            {
+                ASSERT_TRUE(std::equal(pixel, pixel + 4, expected.begin() + (y*width + x)*4))
+                    << width << "x" << height << " pixel " << x << "," << y;
+            }
+        }
+
+        input = randomFrame(yuv420Size(width, height));
+        yuv420_to_rgb_i_c(input.data(), expected.data(), width, height);
+
+        std::vector<uint8_t> output(width*height*4);
+        uint16_t middle = height/4*2;
+        yuv420_to_rgb_i_c_rows(input.data(), output.data(), width, height, 0, middle);
+        yuv420_to_rgb_i_c_rows(input.data(), output.data(), width, height, middle, height);
+        EXPECT_EQ(expected, output) << width << "x" << height << " in rows";
+
+        if (is_sse41_available())
+        {
+            std::fill(output.begin(), output.end(), 0);
+            yuv420_to_rgb_i_sse41_rows(input.data(), output.data(), width, height, 0, middle);
+            yuv420_to_rgb_i_sse41_rows(input.data(), output.data(), width, height, middle, height);
+            EXPECT_EQ(expected, output) << width << "x" << height << " SSE4.1";
+        }
+
+        if (is_avx2_available())
+        {
+            std::fill(output.begin(), output.end(), 0);
+            yuv420_to_rgb_i_avx2_rows(input.data(), output.data(), width, height, 0, middle);
+            yuv420_to_rgb_i_avx2_rows(input.data(), output.data(), width, height, middle, height);
+            EXPECT_EQ(expected, output) << width << "x" << height << " AVX2";
+
+            uint16_t outWidth = width/2 + 1;
+            uint16_t outHeight = height/2 + 1;
+            std::vector<uint8_t> scaledExpected(outWidth*outHeight*4);
+            std::vector<uint8_t> scaled(outWidth*outHeight*4);
+            yuv420_to_rgb_scaled_c(input.data(), scaledExpected.data(), width, height,
+                                   outWidth, outHeight, true, true);
+            yuv420_to_rgb_scaled_avx2(input.data(), scaled.data(), width, height,
+                                      outWidth, outHeight, true, true);
+            EXPECT_EQ(scaledExpected, scaled) << width << "x" << height << " scaled";
+        }
+    }
+}
+
+
+TEST(ConversionTest, yuv420_to_rgb_scaled) {
+    REQUIRE_AVX2();
+    for (auto& res : testResolutions)
+    {
+        uint16_t width = res.first;
+        uint16_t height = res.second;
+        std::vector<uint8_t> input = randomFrame(width*height*3/2);
+
+        for (int flags = 0; flags < 4; ++flags)
+        {
+            bool mirror = flags & 1;
+            bool flip = flags & 2;
+            uint16_t outWidth = width/2 + 2;
+            uint16_t outHeight = height/2 + 2;
+            std::vector<uint8_t> expected(outWidth*outHeight*4);
+            std::vector<uint8_t> output(outWidth*outHeight*4);
+
+            yuv420_to_rgb_scaled_c(input.data(), expected.data(), width, height,
+                                   outWidth, outHeight, mirror, flip);
+            yuv420_to_rgb_scaled_avx2(input.data(), output.data(), width, height,
+                                      outWidth, outHeight, mirror, flip);
+            EXPECT_EQ(expected, output) << width << "x" << height << " flags " << flags;
+
+            std::fill(output.begin(), output.end(), 0);
+            uint16_t middle = outHeight/3;
+            yuv420_to_rgb_scaled_avx2_rows(input.data(), output.data(), width, height,
+                                           outWidth, outHeight, mirror, flip, 0, middle);
+            yuv420_to_rgb_scaled_avx2_rows(input.data(), output.data(), width, height,
+                                           outWidth, outHeight, mirror, flip, middle, outHeight);
+            EXPECT_EQ(expected, output) << width << "x" << height << " flags " << flags << " in rows";
+        }
+    }
+}
+
+
+TEST(ConversionTest, rgb_to_yuv420) {
+    REQUIRE_AVX2();
+    for (auto& res : testResolutions)
+    {
+        uint16_t width = res.first;
+        uint16_t height = res.second;
+        std::vector<uint8_t> input = randomFrame(width*height*4);
+        std::vector<uint8_t> expected(width*height*3/2);
+        std::vector<uint8_t> output(width*height*3/2);
+
+        rgb_to_yuv420_i_c(input.data(), expected.data(), width, height);
+        rgb_to_yuv420_i_avx2(input.data(), output.data(), width, height);
+        EXPECT_EQ(expected, output) << width << "x" << height;
+    }
+}
+
+
+TEST(ConversionTest, yuyv_to_yuv420) {
+    REQUIRE_AVX2();
+    for (auto& res : testResolutions)
+    {
+        uint16_t width = res.first;
+        uint16_t height = res.second;
+        std::vector<uint8_t> input = randomFrame(width*height*2);
+        std::vector<uint8_t> expected(width*height*3/2);
+        std::vector<uint8_t> output(width*height*3/2);
+
+        yuyv_to_yuv420_c(input.data(), expected.data(), width, height);
+        yuyv_to_yuv420_avx2(input.data(), output.data(), width, height);
+        EXPECT_EQ(expected, output) << width << "x" << height;
+
+        std::fill(output.begin(), output.end(), 0);
+        uint16_t middle = height/4*2;
+        yuyv_to_yuv420_avx2_rows(input.data(), output.data(), width, height, 0, middle);
+        yuyv_to_yuv420_avx2_rows(input.data(), output.data(), width, height, middle, height);
+        EXPECT_EQ(expected, output) << width << "x" << height << " in rows";
+    }
+}
+
+
+TEST(ConversionTest, nv12_to_yuv420) {
+    REQUIRE_AVX2();
+    for (auto& res : testResolutions)
+    {
+        uint16_t width = res.first;
+        uint16_t height = res.second;
+        std::vector<uint8_t> input = randomFrame(width*height*3/2);
+        std::vector<uint8_t> expected(width*height*3/2);
+        std::vector<uint8_t> output(width*height*3/2);
+
+        nv12_to_yuv420_c(input.data(), expected.data(), width, height);
+        nv12_to_yuv420_avx2(input.data(), output.data(), width, height);
+        EXPECT_EQ(expected, output) << width << "x" << height;
+
+        std::fill(output.begin(), output.end(), 0);
+        uint16_t middle = height/4*2;
+        nv12_to_yuv420_avx2_rows(input.data(), output.data(), width, height, 0, middle);
+        nv12_to_yuv420_avx2_rows(input.data(), output.data(), width, height, middle, height);
+        EXPECT_EQ(expected, output) << width << "x" << height << " in rows";
+    }
+}
+
+
+TEST(ConversionTest, half_rgb) {
+    REQUIRE_AVX2();
+    for (auto& res : testResolutions)
+    {
+        uint16_t width = res.first;
+        uint16_t height = res.second;
+        std::vector<uint8_t> input = randomFrame(width*height*4);
+        std::vector<uint8_t> expected(width*height);
+        std::vector<uint8_t> output(width*height);
+
+        half_rgb(input.data(), expected.data(), width, height);
+        half_rgb_avx2(input.data(), output.data(), width, height);
+        EXPECT_EQ(expected, output) << width << "x" << height;
+    }
+}
+
+
+TEST(ConversionTest, flip_rgb) {
+    REQUIRE_AVX2();
+    for (auto& res : testResolutions)
+    {
+        uint16_t width = res.first;
+        uint16_t height = res.second;
+        std::vector<uint8_t> input = randomFrame(width*height*4);
+
+        for (int flags = 1; flags < 4; ++flags)
+        {
+            bool horizontally = flags & 1;
+            bool vertically = flags & 2;
+            std::vector<uint8_t> expected(width*height*4);
+            std::vector<uint8_t> output(width*height*4);
+
+            flip_rgb(input.data(), expected.data(), width, height, horizontally, vertically);
+            flip_rgb_avx2(input.data(), output.data(), width, height, horizontally, vertically);
+            EXPECT_EQ(expected, output) << width << "x" << height << " flags " << flags;
+        }
+    }
+}
@@ -0,0 +1,181 @@
+#include "../src/media/processing/filter.h"
+#include "../src/media/resourceallocator.h"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <memory>
+
+
+// A filter which is not started, the test takes its input directly
+class QueueFilter : public Filter
+{
+public:
+    QueueFilter(std::shared_ptr<ResourceAllocator> hwResources):
+        Filter("Test", "Queue", nullptr, hwResources, DT_HEVCVIDEO, DT_HEVCVIDEO)
+    {}
+
+    void send(std::unique_ptr<Data> output)
+    {
+        sendOutput(std::move(output));
+    }
+
+    std::unique_ptr<Data> take()
+    {
+        return getInput();
+    }
+
+protected:
+
+    void process()
+    {}
+};
+
+
+static std::unique_ptr<Data> encodedFrame()
+{
+    std::unique_ptr<Data> frame(new Data);
+    frame->source = DS_LOCAL;
+    frame->type = DT_HEVCVIDEO;
+    frame->data_size = 10;
+    frame->data = std::shared_ptr<uchar[]>(new uchar[frame->data_size]);
+    frame->presentationTime = 1234;
+
+    frame->vInfo.emplace();
+    frame->vInfo->width = 640;
+    frame->vInfo->height = 360;
+    frame->vInfo->framerateNumerator = 30;
+    frame->vInfo->framerateDenominator = 1;
+    frame->vInfo->spatialLayer = 1;
+    frame->vInfo->temporalLayer = 1;
+    frame->vInfo->nalUnits = std::make_shared<const std::vector<NalUnit>>(
+          std::vector<NalUnit>{{4, 6}});
+    return frame;
+}
+
+
+TEST(FilterTest, fanOutKeepsVideoInfo) {
+    std::shared_ptr<ResourceAllocator> hwResources = std::make_shared<ResourceAllocator>();
+    std::shared_ptr<QueueFilter> source = std::make_shared<QueueFilter>(hwResources);
+    std::shared_ptr<QueueFilter> first = std::make_shared<QueueFilter>(hwResources);
+    std::shared_ptr<QueueFilter> second = std::make_shared<QueueFilter>(hwResources);
+
+    source->addOutConnection(first);
+    source->addOutConnection(second);
+
+    std::unique_ptr<Data> frame = encodedFrame();
+    std::shared_ptr<const std::vector<NalUnit>> nalUnits = frame->vInfo->nalUnits;
+    source->send(std::move(frame));
+
+    // the first receiver gets a copy and the last one the original
+    for (auto& receiver : {first, second})
+    {
+        std::unique_ptr<Data> received = receiver->take();
+        ASSERT_TRUE(received != nullptr);
+        ASSERT_TRUE(received->vInfo != nullptr);
+        EXPECT_EQ(received->data_size, 10u);
+        EXPECT_EQ(received->vInfo->spatialLayer, 1);
+        EXPECT_EQ(received->vInfo->temporalLayer, 1);
+        EXPECT_EQ(received->vInfo->nalUnits, nalUnits);
+    }
+}
+
+
+// like the self view, which outlives the graph in front of it
+class FusableFilter : public QueueFilter
+{
+public:
+    FusableFilter(std::shared_ptr<ResourceAllocator> hwResources):
+        QueueFilter(hwResources)
+    {}
+
+    virtual bool isFusable() const
+    {
+        return true;
+    }
+};
+
+
+TEST(FilterTest, fusesAgainAfterRebuild) {
+    std::shared_ptr<ResourceAllocator> hwResources = std::make_shared<ResourceAllocator>();
+    std::shared_ptr<FusableFilter> view = std::make_shared<FusableFilter>(hwResources);
+    std::shared_ptr<QueueFilter> camera = std::make_shared<QueueFilter>(hwResources);
+
+    ASSERT_TRUE(view->setFusion(true));
+    camera->addOutConnection(view);
+    EXPECT_TRUE(view->isFused());
+
+    // the camera graph is torn down and built again like the graph does it
+    // when the camera changes
+    camera->removeOutConnections();
+    camera = std::make_shared<QueueFilter>(hwResources);
+
+    ASSERT_TRUE(view->setFusion(true));
+    camera->addOutConnection(view);
+    EXPECT_TRUE(view->isFused());
+
+    // a second input still unfuses
+    std::shared_ptr<QueueFilter> screenShare = std::make_shared<QueueFilter>(hwResources);
+    screenShare->addOutConnection(view);
+    EXPECT_FALSE(view->isFused());
+}
+
+
+// one NAL unit of the given type with a start code
+static std::unique_ptr<Data> hevcNalUnit(uint8_t type, int id)
+{
+    std::unique_ptr<Data> nal = encodedFrame();
+    uchar* data = nal->data.get();
+    memset(data, 0, nal->data_size);
+    data[3] = 1;
+    data[4] = type << 1;
+    data[5] = 1;
+    data[6] = 0x80; // the first slice of the picture
+    nal->vInfo->nalUnits = nullptr;
+    nal->presentationTime = id;
+    return nal;
+}
+
+
+TEST(FilterTest, gopPolicyDropsWholeAccessUnits) {
+    std::shared_ptr<ResourceAllocator> hwResources = std::make_shared<ResourceAllocator>();
+    std::shared_ptr<QueueFilter> filter = std::make_shared<QueueFilter>(hwResources);
+
+    // three pictures fit in 100 ms at 30 fps
+    int keyframeRequests = 0;
+    filter->setBackpressurePolicy(std::make_shared<HEVCGOPPolicy>(100, [&keyframeRequests]()
+    {
+        ++keyframeRequests;
+    }));
+
+    int id = 0;
+    for (uint8_t type : {VPS_NUT, SPS_NUT, PPS_NUT, IDR_W_RADL, TRAIL_R, TRAIL_R,
+                         VPS_NUT, SPS_NUT, PPS_NUT, IDR_W_RADL})
+    {
+        filter->putInput(hevcNalUnit(type, ++id));
+    }
+
+    // the first GOP is discarded and the second one kept from its VPS onwards
+    for (int expected = 7; expected <= 10; ++expected)
+    {
+        std::unique_ptr<Data> nal = filter->take();
+        ASSERT_TRUE(nal != nullptr);
+        EXPECT_EQ(nal->presentationTime, expected);
+    }
+    EXPECT_EQ(filter->take(), nullptr);
+    EXPECT_EQ(keyframeRequests, 0);
+
+    // without a random access point in queue, an intra frame is requested
+    for (int i = 0; i < 4; ++i)
+    {
+        filter->putInput(hevcNalUnit(TRAIL_R, ++id));
+    }
+    EXPECT_EQ(filter->take(), nullptr);
+    EXPECT_EQ(keyframeRequests, 1);
+
+    filter->putInput(hevcNalUnit(TRAIL_R, ++id));
+    filter->putInput(hevcNalUnit(IDR_W_RADL, ++id));
+    std::unique_ptr<Data> nal = filter->take();
+    ASSERT_TRUE(nal != nullptr);
+    EXPECT_EQ(nal->presentationTime, id);
+}